@@ -0,0 +1,268 @@
+#include <vulkaninja/vulkaninja.hpp>
+
+using namespace vulkaninja;
+
+std::string vertCode = R"(
+#version 450
+layout(binding = 0) uniform DrawData {
+    vec4 offset;
+    vec4 color;
+};
+layout(location = 0) out vec4 outColor;
+vec3 positions[] = vec3[](vec3(-1, -1, 0), vec3(0, 1, 0), vec3(1, -1, 0));
+void main() {
+    gl_Position = vec4(positions[gl_VertexIndex] * 0.1 + offset.xyz, 1);
+    outColor = color;
+})";
+
+std::string fragCode = R"(
+#version 450
+layout(location = 0) in vec4 inColor;
+layout(location = 0) out vec4 outColor;
+void main() {
+    outColor = inColor;
+})";
+
+// Compares per-draw resource binding through pooled descriptor sets (set + update + bind),
+// VK_KHR_push_descriptor (one push per draw) and a single dynamic uniform buffer set (one offset per draw).
+class PushDescriptorBenchmark : public App
+{
+public:
+    PushDescriptorBenchmark() :
+        App({
+            .width              = 1280,
+            .height             = 720,
+            .title              = "PushDescriptorBenchmark",
+            .vsync              = false,
+            .extensions         = {Extension::ePushDescriptor},
+            .descriptorPoolSize = s_MAX_IN_FLIGHT_COUNT * s_DRAW_COUNT + 16, // Pooled sets and the others
+        })
+    {}
+
+    void onStart() override
+    {
+        std::vector<ShaderHandle> shaders(2);
+
+        std::string           shaderMessage;
+        std::vector<uint32_t> spv;
+
+        if (!ShaderCompiler::compileShaderFromSource(vertCode,
+                                                     ShaderCompiler::ShaderStage::eVertex,
+                                                     "main",
+                                                     "PushDescriptorBenchmark.vert",
+                                                     spv,
+                                                     shaderMessage))
+        {
+            spdlog::error(shaderMessage);
+            exit(1);
+        }
+
+        shaders[0] = m_Context.createShader({
+            .code  = spv,
+            .stage = vk::ShaderStageFlagBits::eVertex,
+        });
+
+        if (!ShaderCompiler::compileShaderFromSource(fragCode,
+                                                     ShaderCompiler::ShaderStage::eFragment,
+                                                     "main",
+                                                     "PushDescriptorBenchmark.frag",
+                                                     spv,
+                                                     shaderMessage))
+        {
+            spdlog::error(shaderMessage);
+            exit(1);
+        }
+
+        shaders[1] = m_Context.createShader({
+            .code  = spv,
+            .stage = vk::ShaderStageFlagBits::eFragment,
+        });
+
+        // Uniform buffers are shared by the pooled and push paths so that only the binding cost differs.
+        // NOTE: The draw data does not change, so one buffer per draw is written once.
+        uint32_t inFlightCount = m_Swapchain->getInFlightCount();
+        VKN_ASSERT(inFlightCount <= s_MAX_IN_FLIGHT_COUNT, "Too many frames in flight: {}", inFlightCount);
+        uniformBuffers.resize(s_DRAW_COUNT);
+        for (uint32_t i = 0; i < s_DRAW_COUNT; i++)
+        {
+            uniformBuffers[i] = m_Context.createBuffer({
+                .usage  = BufferUsage::Uniform,
+                .memory = MemoryUsage::Host,
+                .size   = sizeof(DrawData),
+            });
+            DrawData data = getDrawData(i);
+            uniformBuffers[i]->copy(&data);
+        }
+
+        // Pooled path: one set per draw and per frame in flight
+        pooledDescSets.resize(inFlightCount * s_DRAW_COUNT);
+        for (auto& descSet : pooledDescSets)
+        {
+            descSet = m_Context.createDescriptorSet({
+                .shaders = ArrayProxy<ShaderHandle>(shaders),
+            });
+        }
+        pooledPipeline = m_Context.createGraphicsPipeline({
+            .descSetLayouts = pooledDescSets.front()->getLayouts(),
+            .vertexShader   = shaders[0],
+            .fragmentShader = shaders[1],
+            .colorFormats   = {vk::Format::eB8G8R8A8Unorm},
+        });
+
+        // Push path: a single layout-only set
+        pushDescSet = m_Context.createDescriptorSet({
+            .shaders           = ArrayProxy<ShaderHandle>(shaders),
+            .pushDescriptorSet = 0,
+        });
+        pushPipeline = m_Context.createGraphicsPipeline({
+            .descSetLayouts = pushDescSet->getLayouts(),
+            .vertexShader   = shaders[0],
+            .fragmentShader = shaders[1],
+            .colorFormats   = {vk::Format::eB8G8R8A8Unorm},
+        });
+
+        // Dynamic path: a single set bound to the frame allocator, only the offset changes per draw
+        uniformAllocator = m_Context.createFrameUniformAllocator({
+            .frameSize  = s_DRAW_COUNT * 256,
+            .frameCount = inFlightCount,
+        });
+        dynamicDescSet = m_Context.createDescriptorSet({
+            .shaders        = ArrayProxy<ShaderHandle>(shaders),
+            .dynamicBuffers = {"DrawData"},
+        });
+        dynamicDescSet->set("DrawData", uniformAllocator->getBuffer(), sizeof(DrawData));
+        dynamicDescSet->update();
+        dynamicPipeline = m_Context.createGraphicsPipeline({
+            .descSetLayouts = dynamicDescSet->getLayouts(),
+            .vertexShader   = shaders[0],
+            .fragmentShader = shaders[1],
+            .colorFormats   = {vk::Format::eB8G8R8A8Unorm},
+        });
+
+        gpuTimer = m_Context.createGPUTimer({});
+    }
+
+    void onRender(const CommandBufferHandle& commandBuffer) override
+    {
+        if (frame > 0)
+        {
+            ImGui::RadioButton("Pooled", &mode, eModePooled);
+            ImGui::RadioButton("Push descriptors", &mode, eModePush);
+            ImGui::RadioButton("Dynamic offsets", &mode, eModeDynamic);
+            ImGui::Text("Draws: %u", s_DRAW_COUNT);
+            ImGui::Text("CPU record: %.3f ms", cpuTime);
+            ImGui::Text("GPU timer: %.3f ms", gpuTimer->elapsedInMilli());
+        }
+
+        uint32_t frameOffset = m_Swapchain->getCurrentInFlightIndex() * s_DRAW_COUNT;
+        uniformAllocator->beginFrame(m_Swapchain->getCurrentInFlightIndex());
+        if (mode == eModeDynamic)
+        {
+            for (uint32_t i = 0; i < s_DRAW_COUNT; i++)
+            {
+                dynamicOffsets[i] = uniformAllocator->push(getDrawData(i));
+            }
+        }
+
+        commandBuffer->clearColorImage(getCurrentColorImage(), {0.0f, 0.0f, 0.0f, 1.0f});
+        commandBuffer->setViewport(Window::getWidth(), Window::getHeight());
+        commandBuffer->setScissor(Window::getWidth(), Window::getHeight());
+        commandBuffer->beginTimestamp(gpuTimer);
+        commandBuffer->beginRendering(
+            getCurrentColorImage(), nullptr, {0, 0}, {Window::getWidth(), Window::getHeight()});
+
+        CPUTimer timer;
+        if (mode == eModePush)
+        {
+            commandBuffer->bindPipeline(pushPipeline);
+            for (uint32_t i = 0; i < s_DRAW_COUNT; i++)
+            {
+                pushDescSet->set("DrawData", {uniformBuffers[i]});
+                commandBuffer->pushDescriptorSet(pushPipeline, pushDescSet);
+                commandBuffer->draw(3, 1, 0, 0);
+            }
+        }
+        else if (mode == eModeDynamic)
+        {
+            commandBuffer->bindPipeline(dynamicPipeline);
+            for (uint32_t i = 0; i < s_DRAW_COUNT; i++)
+            {
+                commandBuffer->bindDescriptorSet(dynamicPipeline, dynamicDescSet, 0, {dynamicOffsets[i]});
+                commandBuffer->draw(3, 1, 0, 0);
+            }
+        }
+        else
+        {
+            // NOTE: Sets are handed out in a different order every frame, as a per-frame allocator would,
+            // so each one is rewritten like a push descriptor instead of skipping the unchanged update.
+            commandBuffer->bindPipeline(pooledPipeline);
+            for (uint32_t i = 0; i < s_DRAW_COUNT; i++)
+            {
+                const auto& descSet = pooledDescSets[frameOffset + (i + frame) % s_DRAW_COUNT];
+                descSet->set("DrawData", {uniformBuffers[i]});
+                descSet->update();
+                commandBuffer->bindDescriptorSet(pooledPipeline, descSet);
+                commandBuffer->draw(3, 1, 0, 0);
+            }
+        }
+        cpuTime = timer.elapsedInMilli();
+
+        commandBuffer->endRendering();
+        commandBuffer->endTimestamp(gpuTimer);
+        frame++;
+    }
+
+    struct DrawData
+    {
+        float offset[4];
+        float color[4];
+    };
+
+    static auto getDrawData(uint32_t draw) -> DrawData
+    {
+        float t = static_cast<float>(draw) / static_cast<float>(s_DRAW_COUNT);
+        return {
+            .offset = {t * 1.8f - 0.9f, 0.0f, 0.0f, 0.0f},
+            .color  = {t, 1.0f - t, 0.5f, 1.0f},
+        };
+    }
+
+    enum Mode
+    {
+        eModePooled,
+        eModePush,
+        eModeDynamic,
+    };
+
+    // NOTE: Enough draws for the binding cost to dominate the CPU time.
+    // Pooled sets are allocated per frame in flight, so the descriptor pool is sized for both.
+    static constexpr uint32_t s_DRAW_COUNT          = 1024;
+    static constexpr uint32_t s_MAX_IN_FLIGHT_COUNT = 3;
+
+    std::vector<BufferHandle>          uniformBuffers;
+    std::vector<DescriptorSetHandle>   pooledDescSets;
+    DescriptorSetHandle                pushDescSet;
+    DescriptorSetHandle                dynamicDescSet;
+    FrameUniformAllocatorHandle        uniformAllocator;
+    std::array<uint32_t, s_DRAW_COUNT> dynamicOffsets {};
+    GraphicsPipelineHandle             pooledPipeline;
+    GraphicsPipelineHandle             pushPipeline;
+    GraphicsPipelineHandle             dynamicPipeline;
+    GPUTimerHandle                     gpuTimer;
+    int                                mode    = eModePush;
+    float                              cpuTime = 0.0f;
+    int                                frame   = 0;
+};
+
+int main()
+{
+    try
+    {
+        PushDescriptorBenchmark app {};
+        app.run();
+    }
+    catch (const std::exception& e)
+    {
+        spdlog::error(e.what());
+    }
+}
@@ -0,0 +1,22 @@
+-- target defination, name: bench_push_descriptor
+target("bench_push_descriptor")
+    -- set target kind: executable
+    set_kind("binary")
+
+    -- add source files
+    add_files("main.cpp")
+
+    -- add deps
+    add_deps("vulkaninja")
+
+    -- add rules
+    add_rules("copy_assets")
+
+    -- set values
+    set_values("asset_files", "assets/**")
+
+    -- add defines
+    add_defines("VKN_ENABLE_EXTENSION", "VULKAN_HPP_DISPATCH_LOADER_DYNAMIC=1")
+
+    -- set target directory
+    set_targetdir("$(buildir)/$(plat)/$(arch)/$(mode)/examples/bench_push_descriptor")
@@ -69,7 +69,7 @@ public:
         });
 
         pipeline = m_Context.createGraphicsPipeline({
-            .descSetLayout  = descSet->getLayout(),
+            .descSetLayouts = descSet->getLayouts(),
             .vertexShader   = shaders[0],
             .fragmentShader = shaders[1],
         });
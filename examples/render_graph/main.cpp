@@ -0,0 +1,125 @@
+#include <vulkaninja/vulkaninja.hpp>
+
+#include <algorithm>
+
+using namespace vulkaninja;
+
+// Compiles an offline graph without a device and checks the pass order, culling and barrier placement.
+// Returns nonzero if any check fails.
+class RenderGraphCheck
+{
+public:
+    void check(bool condition, const char* message)
+    {
+        if (!condition)
+        {
+            spdlog::error("Failed: {}", message);
+            failureCount++;
+        }
+    }
+
+    auto findBarrier(const RenderGraphCompiledPass& compiledPass, RenderGraphResource resource)
+        -> const RenderGraphBarrier*
+    {
+        auto it = std::ranges::find(compiledPass.barriers, resource, &RenderGraphBarrier::resource);
+        return it != compiledPass.barriers.end() ? &*it : nullptr;
+    }
+
+    void run()
+    {
+        RenderGraphCreateInfo createInfo {};
+        RenderGraph           graph {createInfo};
+
+        ResourceState colorState = getResourceState(ResourceUsage::eColorAttachment, createInfo.shaderStages);
+        ResourceState readState  = getResourceState(ResourceUsage::eShaderRead, createInfo.shaderStages);
+
+        ImageCreateInfo imageInfo {
+            .extent = {1280, 720, 1},
+            .format = vk::Format::eR16G16B16A16Sfloat,
+        };
+        RenderGraphResource swapchain = graph.importImage("swapchain", nullptr, ResourceState {});
+        RenderGraphResource gbuffer   = graph.createImage("gbuffer", imageInfo);
+        RenderGraphResource debug     = graph.createImage("debug", imageInfo);
+        RenderGraphResource hdr       = graph.createImage("hdr", imageInfo);
+
+        uint32_t gbufferPass = graph.addPass({
+            .name   = "gbuffer",
+            .writes = {{gbuffer, ResourceUsage::eColorAttachment}},
+        });
+        uint32_t debugPass = graph.addPass({
+            .name   = "debug",
+            .writes = {{debug, ResourceUsage::eColorAttachment}},
+        });
+        uint32_t lightingPass = graph.addPass({
+            .name   = "lighting",
+            .reads  = {{gbuffer, ResourceUsage::eShaderRead}},
+            .writes = {{hdr, ResourceUsage::eColorAttachment}},
+        });
+        uint32_t compositePass = graph.addPass({
+            .name   = "composite",
+            .reads  = {{gbuffer, ResourceUsage::eShaderRead}, {hdr, ResourceUsage::eShaderRead}},
+            .writes = {{swapchain, ResourceUsage::eColorAttachment}},
+        });
+        graph.compile();
+
+        // Passes whose results are never read are culled, the rest keep their dependency order
+        const auto& compiledPasses = graph.getCompiledPasses();
+        check(graph.isCulled(debugPass), "debug is culled");
+        check(compiledPasses.size() == 3, "three passes are compiled");
+        if (compiledPasses.size() != 3)
+        {
+            return;
+        }
+        check(compiledPasses[0].pass == gbufferPass, "gbuffer runs first");
+        check(compiledPasses[1].pass == lightingPass, "lighting runs second");
+        check(compiledPasses[2].pass == compositePass, "composite runs last");
+
+        // Transient images alive at once cannot share an image, unused ones are never created
+        check(graph.getPhysicalImageCount() == 2, "gbuffer and hdr have their own images");
+        check(graph.getPhysicalImageIndex(debug) == UINT32_MAX, "debug has no image");
+
+        // The first use discards the contents, each later use waits for the previous write
+        const RenderGraphBarrier* barrier = findBarrier(compiledPasses[0], gbuffer);
+        check(barrier && barrier->srcState.layout == vk::ImageLayout::eUndefined && barrier->dstState == colorState,
+              "gbuffer is cleared into a color attachment");
+        check(compiledPasses[0].barriers.size() == 1, "gbuffer pass has one barrier");
+
+        barrier = findBarrier(compiledPasses[1], gbuffer);
+        check(barrier && barrier->srcState == colorState && barrier->dstState == readState,
+              "lighting waits for the gbuffer writes");
+        barrier = findBarrier(compiledPasses[1], hdr);
+        check(barrier && barrier->srcState.layout == vk::ImageLayout::eUndefined, "hdr is discarded on first use");
+
+        // Reads after reads in the same stages need no barrier
+        check(!findBarrier(compiledPasses[2], gbuffer), "composite reads gbuffer without a barrier");
+        barrier = findBarrier(compiledPasses[2], hdr);
+        check(barrier && barrier->srcState == colorState && barrier->dstState == readState,
+              "composite waits for the hdr writes");
+        barrier = findBarrier(compiledPasses[2], swapchain);
+        check(barrier && barrier->dstState == colorState, "swapchain becomes a color attachment");
+
+        check(graph.getFinalState(swapchain) == colorState, "swapchain ends as a color attachment");
+    }
+
+    int failureCount = 0;
+};
+
+int main()
+{
+    try
+    {
+        RenderGraphCheck graphCheck {};
+        graphCheck.run();
+        if (graphCheck.failureCount > 0)
+        {
+            spdlog::error("{} checks failed.", graphCheck.failureCount);
+            return 1;
+        }
+        spdlog::info("All checks passed.");
+    }
+    catch (const std::exception& e)
+    {
+        spdlog::error(e.what());
+        return 1;
+    }
+}
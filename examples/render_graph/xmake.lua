@@ -0,0 +1,16 @@
+-- target defination, name: render_graph
+target("render_graph")
+    -- set target kind: executable
+    set_kind("binary")
+
+    -- add source files
+    add_files("main.cpp")
+
+    -- add deps
+    add_deps("vulkaninja")
+
+    -- add defines
+    add_defines("VKN_ENABLE_EXTENSION", "VULKAN_HPP_DISPATCH_LOADER_DYNAMIC=1")
+
+    -- set target directory
+    set_targetdir("$(buildir)/$(plat)/$(arch)/$(mode)/examples/render_graph")
@@ -1 +1,3 @@
-includes("hello_graphics")
\ No newline at end of file
+includes("hello_graphics")
+includes("bench_push_descriptor")
+includes("render_graph")
\ No newline at end of file
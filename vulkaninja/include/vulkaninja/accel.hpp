@@ -7,8 +7,52 @@
 
 namespace vulkaninja
 {
+    // Triangle geometry of a BottomAccel. Buffers need BufferUsage::AccelInput.
+    struct AccelGeometry
+    {
+        BufferHandle vertexBuffer;
+        BufferHandle indexBuffer;
+
+        // Optional vk::TransformMatrixKHR applied to the vertices when building,
+        // e.g. to merge static meshes placed in the same space into one BottomAccel.
+        // NOTE: The address, i.e. buffer address + transformOffset, must be aligned to 16 bytes.
+        BufferHandle transformBuffer;
+
+        vk::DeviceSize vertexOffset    = 0;
+        vk::DeviceSize indexOffset     = 0; // Aligned to the index size
+        vk::DeviceSize transformOffset = 0;
+
+        // NOTE: Compact formats, e.g. eR16G16B16A16Sfloat, eR16G16B16A16Snorm and eUint16, cut the build bandwidth.
+        // Check vertex formats with isAccelVertexFormatSupported().
+        vk::Format    vertexFormat = vk::Format::eR32G32B32Sfloat;
+        vk::IndexType indexType    = vk::IndexType::eUint32;
+
+        uint32_t vertexStride;
+        uint32_t maxVertexCount;
+        uint32_t maxTriangleCount;
+        uint32_t triangleCount;
+
+        vk::GeometryFlagsKHR geometryFlags = vk::GeometryFlagBitsKHR::eOpaque;
+    };
+
+    // Procedural geometry of a BottomAccel, made of vk::AabbPositionsKHR boxes and traced with a procedural hit group.
+    // The buffer needs BufferUsage::AccelInput.
+    struct AccelAabbGeometry
+    {
+        BufferHandle aabbBuffer;
+
+        vk::DeviceSize offset = 0; // Aligned to 8 bytes
+        uint32_t       stride = sizeof(vk::AabbPositionsKHR);
+
+        uint32_t maxAabbCount;
+        uint32_t aabbCount;
+
+        vk::GeometryFlagsKHR geometryFlags = vk::GeometryFlagBitsKHR::eOpaque;
+    };
+
     struct BottomAccelCreateInfo
     {
+        // Single geometry, used if `geometries` and `aabbGeometries` are empty
         BufferHandle vertexBuffer;
         BufferHandle indexBuffer;
 
@@ -19,11 +63,21 @@ namespace vulkaninja
 
         vk::GeometryFlagsKHR geometryFlags = vk::GeometryFlagBitsKHR::eOpaque;
 
+        // Built into one structure, where each geometry is indexed by gl_GeometryIndexEXT
+        // NOTE: A structure holds either triangles or AABBs, so set only one of these.
+        ArrayProxy<AccelGeometry>     geometries;
+        ArrayProxy<AccelAabbGeometry> aabbGeometries;
+
         vk::BuildAccelerationStructureFlagsKHR buildFlags =
             vk::BuildAccelerationStructureFlagBitsKHR::ePreferFastTrace |
             vk::BuildAccelerationStructureFlagBitsKHR::eAllowUpdate;
 
         vk::AccelerationStructureBuildTypeKHR buildType = vk::AccelerationStructureBuildTypeKHR::eDevice;
+
+        // Adds eAllowCompaction so that an AccelCompactor can shrink the structure after its build.
+        // Best for static geometry built with ePreferFastTrace.
+        // NOTE: A compacted structure has no room for a build, so afterwards only updates with the same counts work.
+        bool compact = false;
     };
 
     struct AccelInstance
@@ -37,6 +91,13 @@ namespace vulkaninja
         uint32_t customIndex = 0;
     };
 
+    // Entry of the transform stream read by CommandBuffer::updateTopAccelTransforms
+    struct AccelTransformUpdate
+    {
+        uint32_t               instanceIndex;
+        vk::TransformMatrixKHR transform;
+    };
+
     inline vk::TransformMatrixKHR toVkMatrix(const glm::mat4& matrix)
     {
         const glm::mat4 transposedMatrix = glm::transpose(matrix);
@@ -47,6 +108,12 @@ namespace vulkaninja
         return vkMatrix;
     }
 
+    // Whether BottomAccels can read vertex positions in `format`
+    auto isAccelVertexFormatSupported(const Context& context, vk::Format format) -> bool;
+
+    // Returns the first supported format of `candidates`, or eR32G32B32Sfloat, which every device supports
+    auto chooseAccelVertexFormat(const Context& context, ArrayProxy<vk::Format> candidates) -> vk::Format;
+
     struct TopAccelCreateInfo
     {
         ArrayProxy<AccelInstance> accelInstances;
@@ -58,37 +125,83 @@ namespace vulkaninja
             vk::BuildAccelerationStructureFlagBitsKHR::eAllowUpdate;
 
         vk::AccelerationStructureBuildTypeKHR buildType = vk::AccelerationStructureBuildTypeKHR::eDevice;
+
+        // Creates the compute pipeline of CommandBuffer::updateTopAccelTransforms
+        bool transformUpdates = false;
+
+        // Capacity of the allocation, which grows geometrically when updateInstances() exceeds it.
+        // 0 means the size of accelInstances.
+        uint32_t maxInstanceCount = 0;
+
+        // Staging buffers of the instance uploads are kept per frame in flight, see TopAccel::beginFrame()
+        uint32_t frameCount = 1;
     };
 
     class BottomAccel
     {
         friend class CommandBuffer;
+        friend class AccelCompactor;
 
     public:
         BottomAccel(const Context& context, const BottomAccelCreateInfo& createInfo);
 
         auto getBufferAddress() const -> uint64_t { return m_Buffer->getAddress(); }
 
+        // Scratch needed by a build, e.g. to size the scratch buffer of CommandBuffer::buildBottomAccels
+        auto getScratchSize() const -> vk::DeviceSize { return m_ScratchSize; }
+
+        auto getGeometryCount() const -> uint32_t { return static_cast<uint32_t>(m_Geometries.size()); }
+
+        // Updates the first geometry
         void update(const BufferHandle& vertexBuffer, const BufferHandle& indexBuffer, uint32_t triangleCount);
 
-        bool shouldRebuild() const { return m_LastPrimitiveCount != m_PrimitiveCount; }
+        // NOTE: The offsets given at creation are kept
+        void updateGeometry(uint32_t            geometryIndex,
+                            const BufferHandle& vertexBuffer,
+                            const BufferHandle& indexBuffer,
+                            uint32_t            triangleCount);
+
+        void updateAabbGeometry(uint32_t geometryIndex, const BufferHandle& aabbBuffer, uint32_t aabbCount);
+
+        bool shouldRebuild() const;
+
+        auto isCompacted() const -> bool { return m_Compacted; }
 
     private:
+        struct Geometry
+        {
+            vk::GeometryTypeKHR                               type = vk::GeometryTypeKHR::eTriangles;
+            vk::AccelerationStructureGeometryTrianglesDataKHR triangles;
+            vk::AccelerationStructureGeometryAabbsDataKHR     aabbs;
+            vk::GeometryFlagsKHR                              flags;
+            BufferHandle                                      vertexBuffer;
+            BufferHandle                                      indexBuffer;
+            BufferHandle                                      transformBuffer;
+            BufferHandle                                      aabbBuffer;
+            vk::DeviceSize                                    vertexOffset = 0;
+            vk::DeviceSize                                    indexOffset  = 0;
+            vk::DeviceSize                                    aabbOffset   = 0;
+
+            uint32_t maxPrimitiveCount  = 0;
+            uint32_t lastPrimitiveCount = 0;
+            uint32_t primitiveCount     = 0;
+        };
+
+        auto getGeometries() const -> std::vector<vk::AccelerationStructureGeometryKHR>;
+        auto getBuildRanges() const -> std::vector<vk::AccelerationStructureBuildRangeInfoKHR>;
+
         const Context* m_Context;
 
         vk::UniqueAccelerationStructureKHR m_Accel;
 
-        BufferHandle m_Buffer;
-        BufferHandle m_ScratchBuffer;
+        BufferHandle   m_Buffer;
+        vk::DeviceSize m_ScratchSize       = 0;
+        vk::DeviceSize m_UpdateScratchSize = 0;
 
-        vk::AccelerationStructureGeometryTrianglesDataKHR m_TrianglesData;
-        vk::GeometryFlagsKHR                              m_GeometryFlags;
-        vk::BuildAccelerationStructureFlagsKHR            m_BuildFlags;
-        vk::AccelerationStructureBuildTypeKHR             m_BuildType;
-
-        uint32_t m_MaxPrimitiveCount;
-        uint32_t m_LastPrimitiveCount;
-        uint32_t m_PrimitiveCount;
+        std::vector<Geometry>                  m_Geometries;
+        vk::BuildAccelerationStructureFlagsKHR m_BuildFlags;
+        vk::AccelerationStructureBuildTypeKHR  m_BuildType;
+        bool                                   m_Compacted = false; // Set by AccelCompactor
     };
 
     class TopAccel
@@ -98,22 +211,72 @@ namespace vulkaninja
     public:
         TopAccel(const Context& context, const TopAccelCreateInfo& createInfo);
 
+        // NOTE: The structure is recreated when the capacity grows, so rewrite the descriptors using it
+        // when getGeneration() changes after a build or update.
         auto getAccel() const -> vk::AccelerationStructureKHR { return *m_Accel; }
 
+        // Incremented each time the structure and its buffers are recreated
+        auto getGeneration() const -> uint32_t { return m_Generation; }
+
+        // Selects the staging buffer of this frame for the next instance upload.
+        // NOTE: The GPU must have finished with this frame's staging buffer,
+        // e.g. after waiting the in-flight fence of the same frame index.
+        // A second upload in the same frame goes through a temporary buffer kept alive by the command buffer.
+        void beginFrame(uint32_t frameIndex);
+
         auto getInfo() const -> vk::WriteDescriptorSetAccelerationStructureKHR { return {*m_Accel}; }
 
-        void updateInstances(ArrayProxy<AccelInstance> accelInstances) const;
+        auto getInstanceCount() const -> uint32_t { return m_PrimitiveCount; }
+        auto getMaxInstanceCount() const -> uint32_t { return m_MaxInstanceCount; }
+
+        // Re-encodes every instance on the CPU. They are uploaded by the next build or update.
+        // If the count changed, the next update falls back to a build.
+        // NOTE: For transforms only, prefer CommandBuffer::updateTopAccelTransforms.
+        void updateInstances(ArrayProxy<AccelInstance> accelInstances);
+
+        bool shouldRebuild() const { return m_BuiltPrimitiveCount != m_PrimitiveCount; }
 
     private:
+        struct StagingFrame
+        {
+            BufferHandle buffer; // Sized to the capacity
+            bool         isUsed = false;
+        };
+
+        void allocate(uint32_t maxInstanceCount);
+
+        // Grows the allocation if needed and uploads the instances written by the CPU, if any.
+        // BottomAccel addresses are resolved again, since compaction moves the structures.
+        void uploadInstances(const CommandBuffer& commandBuffer);
+
+        void updateTransforms(const CommandBuffer& commandBuffer,
+                              vk::DeviceAddress    transformUpdates,
+                              uint32_t             updateCount);
+
         const Context* m_Context;
 
         vk::UniqueAccelerationStructureKHR m_Accel;
 
-        BufferHandle m_Buffer;
-        BufferHandle m_InstanceBuffer;
-        BufferHandle m_ScratchBuffer;
+        std::vector<vk::AccelerationStructureInstanceKHR> m_Instances;
+        std::vector<BottomAccelHandle>                    m_BottomAccels; // Per instance
+        bool                                              m_InstancesDirty = true;
+
+        ShaderHandle          m_TransformShader;
+        ComputePipelineHandle m_TransformPipeline;
+
+        BufferHandle   m_Buffer;
+        BufferHandle   m_InstanceBuffer; // Device local
+        vk::DeviceSize m_ScratchSize       = 0;
+        vk::DeviceSize m_UpdateScratchSize = 0;
+
+        std::vector<StagingFrame> m_StagingFrames;
+        uint32_t                  m_FrameIndex = 0;
+
+        uint32_t m_MaxInstanceCount    = 0;
+        uint32_t m_PrimitiveCount      = 0;
+        uint32_t m_BuiltPrimitiveCount = UINT32_MAX; // UINT32_MAX until the first build
+        uint32_t m_Generation          = 0;
 
-        uint32_t                                          m_PrimitiveCount;
         vk::AccelerationStructureGeometryInstancesDataKHR m_InstancesData;
         vk::GeometryFlagsKHR                              m_GeometryFlags;
         vk::BuildAccelerationStructureFlagsKHR            m_BuildFlags;
@@ -0,0 +1,66 @@
+#pragma once
+
+#include "vulkaninja/array_proxy.hpp"
+#include "vulkaninja/context.hpp"
+
+#include <string>
+#include <vector>
+
+namespace vulkaninja
+{
+    struct AccelCompactorCreateInfo
+    {
+        // Replaced structures are released per frame in flight, see beginFrame()
+        uint32_t frameCount = 1;
+
+        std::string debugName;
+    };
+
+    // Shrinks BottomAccels created with `compact` to their compacted size without waiting for the GPU:
+    // 1. query() after the builds, in the same command buffer.
+    // 2. compact() on later frames. Once the sizes of a query are available, it records copies into
+    //    right-sized structures and swaps them into the BottomAccels.
+    // 3. The replaced structures are released when beginFrame() comes back to the frame of the copies.
+    // NOTE: Acceleration structure addresses change. TopAccels resolve them again at their next build or update,
+    // so build or update the TopAccels referencing compacted BottomAccels, e.g. when compact() returns a nonzero count.
+    // A compacted BottomAccel can only be updated with its primitive counts, see BottomAccelCreateInfo::compact.
+    class AccelCompactor
+    {
+    public:
+        AccelCompactor(const Context& context, const AccelCompactorCreateInfo& createInfo);
+
+        // NOTE: The GPU must have finished with this frame's copies,
+        // e.g. after waiting the in-flight fence of the same frame index.
+        void beginFrame(uint32_t frameIndex);
+
+        // Records the compacted size queries of BottomAccels built earlier in this command buffer
+        void query(const CommandBufferHandle& commandBuffer, ArrayProxy<BottomAccelHandle> bottomAccels);
+
+        // Returns the number of BottomAccels compacted by this call
+        auto compact(const CommandBufferHandle& commandBuffer) -> uint32_t;
+
+        auto hasPendingQueries() const -> bool { return !m_Queries.empty(); }
+
+    private:
+        struct Query
+        {
+            vk::UniqueQueryPool            queryPool;
+            std::vector<BottomAccelHandle> bottomAccels;
+        };
+
+        struct RetiredAccel
+        {
+            vk::UniqueAccelerationStructureKHR accel;
+            BufferHandle                       buffer;
+        };
+
+        const Context* m_Context = nullptr;
+
+        std::vector<Query> m_Queries;
+
+        std::vector<std::vector<RetiredAccel>> m_RetiredAccels; // Per frame
+        uint32_t                               m_FrameIndex = 0;
+
+        std::string m_DebugName;
+    };
+} // namespace vulkaninja
@@ -1,6 +1,7 @@
 #pragma once
 
 #include "vulkaninja/context.hpp"
+#include "vulkaninja/resource_state.hpp"
 
 namespace vulkaninja
 {
@@ -12,6 +13,10 @@ namespace vulkaninja
 
         size_t size = 0;
 
+        // If true, the buffer is shared by all queue families without ownership transfers,
+        // e.g. when written by async compute and read by graphics. This may cost some bandwidth.
+        bool concurrent = false;
+
         std::string debugName;
     };
 
@@ -27,6 +32,10 @@ namespace vulkaninja
         auto getInfo() const -> vk::DescriptorBufferInfo { return {*m_Buffer, 0, m_Size}; }
         auto getAddress() const -> vk::DeviceAddress;
 
+        // Tracked by CommandBuffer at record time
+        auto getState() const -> const ResourceState& { return m_State; }
+        void setState(const ResourceState& state) { m_State = state; }
+
         auto map() -> void*;
         void unmap();
         void copy(const void* data);
@@ -39,6 +48,7 @@ namespace vulkaninja
         vk::UniqueBuffer       m_Buffer;
         vk::UniqueDeviceMemory m_Memory;
         vk::DeviceSize         m_Size = 0u;
+        ResourceState          m_State;
 
         // For host buffer
         void* m_Mapped = nullptr;
@@ -2,6 +2,11 @@
 
 #include "vulkaninja/array_proxy.hpp"
 #include "vulkaninja/context.hpp"
+#include "vulkaninja/resource_state.hpp"
+
+#include <array>
+#include <memory>
+#include <optional>
 
 namespace vulkaninja
 {
@@ -19,6 +24,17 @@ namespace vulkaninja
     class Buffer;
     class DescriptorSet;
 
+    // Calls dropped by the shadow state of a CommandBuffer since begin()
+    struct ElidedCallCounts
+    {
+        uint32_t pipelines      = 0;
+        uint32_t descriptorSets = 0;
+        uint32_t vertexBuffers  = 0;
+        uint32_t indexBuffers   = 0;
+        uint32_t viewports      = 0;
+        uint32_t scissors       = 0;
+    };
+
     class CommandBuffer
     {
     public:
@@ -31,20 +47,38 @@ namespace vulkaninja
             context {&ctx}, commandBuffer {commandBuffer, {ctx.getDevice(), commandPool}}, queueFlags {queueFlags}
         {}
 
+        ~CommandBuffer();
+
         auto getQueueFlags() const -> vk::QueueFlags;
 
         void begin(vk::CommandBufferUsageFlags flags = {}) const;
         void end() const;
 
-        void bindDescriptorSet(PipelineHandle pipeline, DescriptorSetHandle descSet) const;
+        void bindDescriptorSet(PipelineHandle       pipeline,
+                               DescriptorSetHandle  descSet,
+                               uint32_t             set            = 0,
+                               ArrayProxy<uint32_t> dynamicOffsets = {}) const;
+        // Binds a set allocated outside of DescriptorSet, e.g. from a pool owned by a built-in pass
+        void bindDescriptorSet(PipelineHandle       pipeline,
+                               vk::DescriptorSet    descSet,
+                               uint32_t             set            = 0,
+                               ArrayProxy<uint32_t> dynamicOffsets = {}) const;
+        void pushDescriptorSet(PipelineHandle                     pipeline,
+                               ArrayProxy<vk::WriteDescriptorSet> writes,
+                               uint32_t                           set = 0) const;
+        void pushDescriptorSet(PipelineHandle pipeline, DescriptorSetHandle descSet) const;
         void bindPipeline(PipelineHandle pipeline) const;
         void pushConstants(PipelineHandle pipeline, const void* pushData) const;
 
         void bindVertexBuffer(BufferHandle buffer, vk::DeviceSize offset = 0) const;
         void bindIndexBuffer(BufferHandle buffer, vk::DeviceSize offset = 0) const;
 
+        // Traces with the default SBT of the pipeline, see RayTracingPipeline::getSBT()
         void traceRays(RayTracingPipelineHandle pipeline, uint32_t countX, uint32_t countY, uint32_t countZ) const;
 
+        // Traces with the bound pipeline and records built for it
+        void traceRays(ShaderBindingTableHandle sbt, uint32_t countX, uint32_t countY, uint32_t countZ) const;
+
         void dispatch(uint32_t countX, uint32_t countY, uint32_t countZ) const;
         void dispatchIndirect(BufferHandle buffer, vk::DeviceSize offset) const;
 
@@ -63,6 +97,8 @@ namespace vulkaninja
         void endRendering() const;
 
         // draw
+        // NOTE: Barriers cannot be recorded inside rendering, so every resource must be declared
+        // before beginRendering(), which flushes them.
         void draw(uint32_t vertexCount, uint32_t instanceCount, uint32_t firstVertex, uint32_t firstInstance) const;
         void drawIndexed(uint32_t indexCount,
                          uint32_t instanceCount = 1,
@@ -72,10 +108,11 @@ namespace vulkaninja
         void drawMeshTasks(uint32_t groupCountX, uint32_t groupCountY, uint32_t groupCountZ) const;
 
         // Indirect draw
+        // NOTE: Declare ResourceUsage::eIndirectBuffer on the buffer and countBuffer before beginRendering().
         void drawIndirect(BufferHandle   buffer,
                           vk::DeviceSize offset    = 0,
                           uint32_t       drawCount = 1,
-                          uint32_t       stride    = sizeof(vk::DrawIndexedIndirectCommand)) const;
+                          uint32_t       stride    = sizeof(vk::DrawIndirectCommand)) const;
         void drawIndexedIndirect(BufferHandle   buffer,
                                  vk::DeviceSize offset    = 0,
                                  uint32_t       drawCount = 1,
@@ -83,7 +120,51 @@ namespace vulkaninja
         void
         drawMeshTasksIndirect(BufferHandle buffer, vk::DeviceSize offset, uint32_t drawCount, uint32_t stride) const;
 
+        // Indirect draw with the draw count read from countBuffer, clamped to maxDrawCount
+        // NOTE: Requires the drawIndirectCount feature, which App enables if supported.
+        void drawIndirectCount(BufferHandle   buffer,
+                               vk::DeviceSize offset,
+                               BufferHandle   countBuffer,
+                               vk::DeviceSize countOffset,
+                               uint32_t       maxDrawCount,
+                               uint32_t       stride = sizeof(vk::DrawIndirectCommand)) const;
+        void drawIndexedIndirectCount(BufferHandle   buffer,
+                                      vk::DeviceSize offset,
+                                      BufferHandle   countBuffer,
+                                      vk::DeviceSize countOffset,
+                                      uint32_t       maxDrawCount,
+                                      uint32_t       stride = sizeof(vk::DrawIndexedIndirectCommand)) const;
+        void drawMeshTasksIndirectCount(BufferHandle   buffer,
+                                        vk::DeviceSize offset,
+                                        BufferHandle   countBuffer,
+                                        vk::DeviceSize countOffset,
+                                        uint32_t       maxDrawCount,
+                                        uint32_t       stride = sizeof(vk::DrawMeshTasksIndirectCommandEXT)) const;
+
+        // Resource state
+        // NOTE: Barriers are computed from the state tracked on each image/buffer and the declared usage.
+        // They are deferred and flushed as one batched barrier before the next action command.
+        // Call flushBarriers() before recording raw commands through `commandBuffer`.
+        void declareUsage(ImageHandle image, ResourceUsage usage) const;
+        void declareUsage(BufferHandle buffer, ResourceUsage usage) const;
+        void flushBarriers() const;
+
+        // Keeps a resource alive until the next begin(), e.g. one replaced while earlier frames may still use it.
+        // NOTE: Fences signal after all earlier submissions to the queue, so those frames are done by then too.
+        void keepAlive(std::shared_ptr<void> resource) const { m_RetainedResources.push_back(std::move(resource)); }
+
+        // Queue family ownership transfer, e.g. for an image written by async compute and read by graphics.
+        // Record release on the queue that last used the resource and acquire with the same usage on `dstQueue`,
+        // then order the two submissions with a semaphore.
+        // NOTE: Both are plain declareUsage() calls if the queues share a family.
+        // Resources created with `concurrent` need no transfer at all.
+        void releaseOwnership(ImageHandle image, vk::QueueFlags dstQueue, ResourceUsage usage) const;
+        void releaseOwnership(BufferHandle buffer, vk::QueueFlags dstQueue, ResourceUsage usage) const;
+        void acquireOwnership(ImageHandle image, vk::QueueFlags srcQueue, ResourceUsage usage) const;
+        void acquireOwnership(BufferHandle buffer, vk::QueueFlags srcQueue, ResourceUsage usage) const;
+
         // barrier
+        // NOTE: Explicit barriers are recorded immediately after the pending ones and do not update the tracked state.
         void bufferBarrier(const vk::ArrayProxy<const vk::BufferMemoryBarrier>& bufferMemoryBarriers,
                            vk::PipelineStageFlags                               srcStageMask,
                            vk::PipelineStageFlags                               dstStageMask,
@@ -108,6 +189,16 @@ namespace vulkaninja
                           vk::AccessFlags         dstAccessMask,
                           vk::DependencyFlags     dependencyFlags = {}) const;
 
+        // Synchronization2 barriers with per-barrier stages.
+        // NOTE: Converted to a single vkCmdPipelineBarrier if synchronization2 is not enabled.
+        void bufferBarrier(const vk::ArrayProxy<const vk::BufferMemoryBarrier2>& bufferMemoryBarriers) const;
+        void imageBarrier(const vk::ArrayProxy<const vk::ImageMemoryBarrier2>& imageMemoryBarriers) const;
+
+        // Buffer, image and global memory barriers recorded as one command
+        void pipelineBarrier(const vk::ArrayProxy<const vk::BufferMemoryBarrier2>& bufferMemoryBarriers,
+                             const vk::ArrayProxy<const vk::ImageMemoryBarrier2>&  imageMemoryBarriers,
+                             const vk::ArrayProxy<const vk::MemoryBarrier2>&       memoryBarriers = nullptr) const;
+
         void memoryBarrier(vk::PipelineStageFlags srcStageMask,
                            vk::PipelineStageFlags dstStageMask,
                            vk::AccessFlags        srcAccessMask,
@@ -115,6 +206,7 @@ namespace vulkaninja
                            vk::DependencyFlags    dependencyFlags = {});
 
         // image
+        // NOTE: Deferred like declareUsage(), with stages and access derived from the layout
         void transitionLayout(ImageHandle image, vk::ImageLayout newLayout) const;
 
         void blitImage(ImageHandle srcImage, ImageHandle dstImage, vk::ImageBlit blit, vk::Filter filter) const;
@@ -126,6 +218,10 @@ namespace vulkaninja
 
         void copyImageToBuffer(ImageHandle srcImage, BufferHandle dstBuffer) const;
 
+        // Min/max depth pyramid in one compute dispatch, see DepthPyramid.
+        // NOTE: Unlike generateMipmaps, which blits with linear filtering, texels are reduced conservatively.
+        void buildDepthPyramid(DepthPyramidHandle depthPyramid) const;
+
         // buffer
         void fillBuffer(BufferHandle   dstBuffer,
                         uint32_t       data,
@@ -134,6 +230,16 @@ namespace vulkaninja
 
         void copyBuffer(BufferHandle buffer, const void* data) const;
 
+        // Copies the first `size` bytes of srcBuffer, e.g. from a staging buffer kept alive with keepAlive()
+        void copyBuffer(BufferHandle srcBuffer, BufferHandle dstBuffer, vk::DeviceSize size) const;
+
+        // Inline copy of up to 65536 bytes, without staging.
+        // NOTE: dstOffset and size must be multiples of 4.
+        void updateBuffer(BufferHandle   dstBuffer,
+                          vk::DeviceSize dstOffset,
+                          vk::DeviceSize size,
+                          const void*    data) const;
+
         void copyBufferToImage(BufferHandle                    srcBuffer,
                                ImageHandle                     dstImage,
                                ArrayProxy<vk::BufferImageCopy> copyRegions = {}) const;
@@ -141,12 +247,27 @@ namespace vulkaninja
         // accel struct
         void updateTopAccel(TopAccelHandle topAccel) const;
 
+        // Writes the transforms of a dirty list of instances in one dispatch, e.g. before updateTopAccel().
+        // `transformUpdates` points to `updateCount` AccelTransformUpdate, e.g. in a FrameUniformAllocator.
+        void updateTopAccelTransforms(TopAccelHandle    topAccel,
+                                      vk::DeviceAddress transformUpdates,
+                                      uint32_t          updateCount) const;
+
         void updateBottomAccel(BottomAccelHandle bottomAccel) const;
 
         void buildTopAccel(TopAccelHandle topAccel) const;
 
         void buildBottomAccel(BottomAccelHandle bottomAccel) const;
 
+        // Builds with one vkCmdBuildAccelerationStructuresKHR per batch instead of one per BLAS.
+        // Scratch is sub-allocated from `scratchBuffer`, whose size is the memory budget of a batch,
+        // and batches reusing it are separated by a barrier.
+        void buildBottomAccels(ArrayProxy<BottomAccelHandle> bottomAccels, BufferHandle scratchBuffer) const;
+
+        // Same with scratch borrowed from the Context, up to `scratchBudget` bytes per batch
+        void buildBottomAccels(ArrayProxy<BottomAccelHandle> bottomAccels,
+                               vk::DeviceSize                scratchBudget = 64 * 1024 * 1024) const;
+
         // timestamp
         void beginTimestamp(GPUTimerHandle gpuTimer) const;
         void endTimestamp(GPUTimerHandle gpuTimer) const;
@@ -163,8 +284,69 @@ namespace vulkaninja
         void beginDebugLabel(const char* labelName) const;
         void endDebugLabel() const;
 
+        // Shadow state
+        // NOTE: Binds and dynamic states identical to the current ones are dropped.
+        // Call invalidateState() after binding through `commandBuffer` directly, e.g. in ImGui rendering.
+        void invalidateState() const;
+        auto getElidedCallCounts() const -> const ElidedCallCounts& { return m_ElidedCallCounts; }
+
         const Context*          context = nullptr;
         vk::UniqueCommandBuffer commandBuffer;
         vk::QueueFlags          queueFlags;
+
+    private:
+        void addImageBarrier(Image& image, const ResourceState& dstState) const;
+        void addBufferBarrier(Buffer& buffer, const ResourceState& dstState) const;
+        void checkDrawBarriers() const;
+        void recordBarriers(const vk::ArrayProxy<const vk::BufferMemoryBarrier2>& bufferBarriers,
+                            const vk::ArrayProxy<const vk::ImageMemoryBarrier2>&  imageBarriers,
+                            const vk::ArrayProxy<const vk::MemoryBarrier2>&       memoryBarriers = nullptr) const;
+
+        // Inputs and destination of a build or update
+        void declareBuildUsage(const BottomAccel& bottomAccel) const;
+        void declareBuildUsage(const TopAccel& topAccel) const;
+        void recordBottomAccelBuilds(ArrayProxy<BottomAccelHandle> bottomAccels,
+                                     vk::DeviceAddress             scratchAddress,
+                                     vk::DeviceSize                scratchSize) const;
+
+        // Scratch of acceleration structure builds, borrowed from the Context until the next begin()
+        auto allocateScratch(vk::DeviceSize size) const -> vk::DeviceAddress;
+
+        void recordPipelineBarrier(const vk::ArrayProxy<const vk::BufferMemoryBarrier2>& bufferBarriers,
+                                   const vk::ArrayProxy<const vk::ImageMemoryBarrier2>&  imageBarriers,
+                                   const vk::ArrayProxy<const vk::MemoryBarrier2>&       memoryBarriers) const;
+
+        // Pending barriers
+        mutable std::vector<vk::ImageMemoryBarrier2>  m_ImageBarriers;
+        mutable std::vector<vk::BufferMemoryBarrier2> m_BufferBarriers;
+        mutable bool                                  m_IsRendering = false; // Between begin/endRendering()
+
+        mutable std::vector<BufferHandle> m_ScratchBuffers;
+        mutable vk::DeviceSize            m_ScratchOffset = 0; // In the last scratch buffer
+
+        mutable std::vector<std::shared_ptr<void>> m_RetainedResources;
+
+        // Shadow state, per bind point: graphics, compute and ray tracing
+        // NOTE: Bound sets are forgotten when a different pipeline layout is used,
+        // since it may disturb them. Viewport and scissor are dynamic in every pipeline, so binds keep them.
+        struct BoundDescriptorSets
+        {
+            vk::PipelineLayout                 layout;
+            std::vector<vk::DescriptorSet>     descSets;
+            std::vector<std::vector<uint32_t>> dynamicOffsets;
+        };
+        auto getBoundDescriptorSets(vk::PipelineBindPoint bindPoint,
+                                    vk::PipelineLayout    layout,
+                                    uint32_t              set) const -> BoundDescriptorSets&;
+
+        mutable std::array<vk::Pipeline, 3>        m_BoundPipelines;
+        mutable std::array<BoundDescriptorSets, 3> m_BoundDescriptorSets;
+        mutable vk::Buffer                         m_BoundVertexBuffer;
+        mutable vk::DeviceSize                     m_BoundVertexOffset = 0;
+        mutable vk::Buffer                         m_BoundIndexBuffer;
+        mutable vk::DeviceSize                     m_BoundIndexOffset = 0;
+        mutable std::optional<vk::Viewport>        m_Viewport;
+        mutable std::optional<vk::Rect2D>          m_Scissor;
+        mutable ElidedCallCounts                   m_ElidedCallCounts;
     };
 } // namespace vulkaninja
\ No newline at end of file
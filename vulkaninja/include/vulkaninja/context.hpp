@@ -8,6 +8,9 @@
 #include <spdlog/spdlog.h>
 #include <vulkan/vulkan.hpp>
 
+#include "vulkaninja/array_proxy.hpp"
+#include "vulkaninja/sampler.hpp"
+
 namespace std
 {
     template<>
@@ -40,6 +43,14 @@ namespace vulkaninja
     struct TopAccelCreateInfo;
     struct GPUTimerCreateInfo;
     struct FenceCreateInfo;
+    struct SemaphoreCreateInfo;
+    struct FrameUniformAllocatorCreateInfo;
+    struct RenderGraphCreateInfo;
+    struct GPUCullingCreateInfo;
+    struct DepthPyramidCreateInfo;
+    struct MipGeneratorCreateInfo;
+    struct ShaderBindingTableCreateInfo;
+    struct AccelCompactorCreateInfo;
     class Buffer;
     class Image;
     class Mesh;
@@ -55,21 +66,37 @@ namespace vulkaninja
     class GPUTimer;
     class CommandBuffer;
     class Fence;
-
-    using BufferHandle             = std::shared_ptr<Buffer>;
-    using ImageHandle              = std::shared_ptr<Image>;
-    using ShaderHandle             = std::shared_ptr<Shader>;
-    using DescriptorSetHandle      = std::shared_ptr<DescriptorSet>;
-    using PipelineHandle           = std::shared_ptr<Pipeline>;
-    using GraphicsPipelineHandle   = std::shared_ptr<GraphicsPipeline>;
-    using MeshShaderPipelineHandle = std::shared_ptr<MeshShaderPipeline>;
-    using ComputePipelineHandle    = std::shared_ptr<ComputePipeline>;
-    using RayTracingPipelineHandle = std::shared_ptr<RayTracingPipeline>;
-    using BottomAccelHandle        = std::shared_ptr<BottomAccel>;
-    using TopAccelHandle           = std::shared_ptr<TopAccel>;
-    using GPUTimerHandle           = std::shared_ptr<GPUTimer>;
-    using CommandBufferHandle      = std::shared_ptr<CommandBuffer>;
-    using FenceHandle              = std::shared_ptr<Fence>;
+    class Semaphore;
+    class FrameUniformAllocator;
+    class RenderGraph;
+    class GPUCulling;
+    class DepthPyramid;
+    class MipGenerator;
+    class ShaderBindingTable;
+    class AccelCompactor;
+
+    using BufferHandle                = std::shared_ptr<Buffer>;
+    using ImageHandle                 = std::shared_ptr<Image>;
+    using ShaderHandle                = std::shared_ptr<Shader>;
+    using DescriptorSetHandle         = std::shared_ptr<DescriptorSet>;
+    using PipelineHandle              = std::shared_ptr<Pipeline>;
+    using GraphicsPipelineHandle      = std::shared_ptr<GraphicsPipeline>;
+    using MeshShaderPipelineHandle    = std::shared_ptr<MeshShaderPipeline>;
+    using ComputePipelineHandle       = std::shared_ptr<ComputePipeline>;
+    using RayTracingPipelineHandle    = std::shared_ptr<RayTracingPipeline>;
+    using BottomAccelHandle           = std::shared_ptr<BottomAccel>;
+    using TopAccelHandle              = std::shared_ptr<TopAccel>;
+    using GPUTimerHandle              = std::shared_ptr<GPUTimer>;
+    using CommandBufferHandle         = std::shared_ptr<CommandBuffer>;
+    using FenceHandle                 = std::shared_ptr<Fence>;
+    using SemaphoreHandle             = std::shared_ptr<Semaphore>;
+    using FrameUniformAllocatorHandle = std::shared_ptr<FrameUniformAllocator>;
+    using RenderGraphHandle           = std::shared_ptr<RenderGraph>;
+    using GPUCullingHandle            = std::shared_ptr<GPUCulling>;
+    using DepthPyramidHandle          = std::shared_ptr<DepthPyramid>;
+    using MipGeneratorHandle          = std::shared_ptr<MipGenerator>;
+    using ShaderBindingTableHandle    = std::shared_ptr<ShaderBindingTable>;
+    using AccelCompactorHandle        = std::shared_ptr<AccelCompactor>;
 
     // clang-format off
 namespace BufferUsage {
@@ -174,6 +201,14 @@ namespace QueueFlags{
 }
     // clang-format on
 
+    // Semaphore waited or signaled by Context::submit
+    struct SubmitSemaphore
+    {
+        vk::Semaphore          semaphore;
+        vk::PipelineStageFlags stage = vk::PipelineStageFlagBits::eAllCommands; // Ignored for signals
+        uint64_t               value = 0;                                       // Ignored for binary semaphores
+    };
+
     class Context
     {
         friend class CommandBuffer;
@@ -187,10 +222,13 @@ namespace QueueFlags{
 
         void initPhysicalDevice(vk::SurfaceKHR surface = {});
 
+        // NOTE: descriptorPoolSize is both the maximum number of sets and the count of each descriptor type
+        // in the pool that DescriptorSet allocates from.
         void initDevice(const std::vector<const char*>&   deviceExtensions,
                         const vk::PhysicalDeviceFeatures& deviceFeatures,
                         const void*                       deviceCreateInfoPNext,
-                        bool                              enableRayTracing);
+                        bool                              enableRayTracing,
+                        uint32_t                          descriptorPoolSize = 100);
 
         // Getter
         auto getInstance() const -> vk::Instance { return *m_Instance; }
@@ -205,9 +243,18 @@ namespace QueueFlags{
 
         auto getCommandPool(vk::QueueFlags flag = QueueFlags::General) const -> vk::CommandPool;
 
+        // If the device has no family for Compute or Transfer, its queue falls back to the General queue.
+        // Work submitted there is still ordered by semaphores, but does not run asynchronously.
+        auto hasDedicatedQueue(vk::QueueFlags flag) const -> bool { return m_Queues.contains(flag); }
+
+        // Distinct queue families, e.g. for resources created with concurrent sharing
+        auto getQueueFamilies() const -> std::vector<uint32_t>;
+
         auto getDescriptorPool() const -> vk::DescriptorPool { return *m_DescriptorPool; }
 
         // Command buffer
+        // NOTE: The command buffer reports the flags of the queue it runs on, e.g. General for a Compute request
+        // on a device without a dedicated compute family.
         auto allocateCommandBuffer(vk::QueueFlags flag = QueueFlags::General) const -> CommandBufferHandle;
 
         void submit(CommandBufferHandle    commandBuffer,
@@ -218,6 +265,12 @@ namespace QueueFlags{
 
         void submit(CommandBufferHandle commandBuffer, FenceHandle fence = {}) const;
 
+        // Submits to the queue of the command buffer, e.g. to order async compute and graphics work
+        void submit(CommandBufferHandle         commandBuffer,
+                    ArrayProxy<SubmitSemaphore> waitSemaphores,
+                    ArrayProxy<SubmitSemaphore> signalSemaphores,
+                    FenceHandle                 fence = {}) const;
+
         void oneTimeSubmit(const std::function<void(CommandBufferHandle)>& command,
                            vk::QueueFlags                                  flag = QueueFlags::General) const;
 
@@ -238,6 +291,23 @@ namespace QueueFlags{
 
         auto getPhysicalDeviceLimits() const -> vk::PhysicalDeviceLimits;
 
+        // Pipeline stages of all shader types enabled on the device
+        auto getShaderStages() const -> vk::PipelineStageFlags2 { return m_ShaderStages; }
+
+        // If false, barriers are recorded through vkCmdPipelineBarrier
+        auto synchronization2Enabled() const -> bool { return m_Synchronization2; }
+
+        // Sampler
+        // NOTE: Samplers are cached by their full state and live as long as the context.
+        auto getOrCreateSampler(const SamplerCreateInfo& createInfo) const -> vk::Sampler;
+
+        // Acceleration structure scratch
+        // NOTE: Device-local buffers borrowed by a CommandBuffer for its builds and returned by its next begin(),
+        // so their memory is reused once the GPU has finished with the previous recording.
+        auto getAccelScratchAlignment() const -> vk::DeviceSize { return m_AccelScratchAlignment; }
+        auto acquireScratchBuffer(vk::DeviceSize minSize) const -> BufferHandle;
+        void releaseScratchBuffers(std::vector<BufferHandle>& scratchBuffers) const;
+
         // Debug
         auto debugEnabled() const -> bool { return m_DebugMessenger.get(); }
 
@@ -279,6 +349,23 @@ namespace QueueFlags{
 
         auto createFence(const FenceCreateInfo& createInfo) const -> FenceHandle;
 
+        auto createSemaphore(const SemaphoreCreateInfo& createInfo) const -> SemaphoreHandle;
+
+        auto createFrameUniformAllocator(const FrameUniformAllocatorCreateInfo& createInfo) const
+            -> FrameUniformAllocatorHandle;
+
+        auto createRenderGraph(const RenderGraphCreateInfo& createInfo) const -> RenderGraphHandle;
+
+        auto createGPUCulling(const GPUCullingCreateInfo& createInfo) const -> GPUCullingHandle;
+
+        auto createDepthPyramid(const DepthPyramidCreateInfo& createInfo) const -> DepthPyramidHandle;
+
+        auto createMipGenerator(const MipGeneratorCreateInfo& createInfo) const -> MipGeneratorHandle;
+
+        auto createShaderBindingTable(const ShaderBindingTableCreateInfo& createInfo) const -> ShaderBindingTableHandle;
+
+        auto createAccelCompactor(const AccelCompactorCreateInfo& createInfo) const -> AccelCompactorHandle;
+
     private:
         static auto VKAPI_CALL debugCallback(VkDebugUtilsMessageSeverityFlagBitsEXT messageSeverity,
                                              VkDebugUtilsMessageTypeFlagsEXT /*messageTypes*/,
@@ -305,6 +392,7 @@ namespace QueueFlags{
             vk::UniqueCommandPool commandPool;
         };
         auto getThreadQueue(vk::QueueFlags flag) const -> const ThreadQueue&;
+        auto resolveQueueFlags(vk::QueueFlags flag) const -> vk::QueueFlags;
 
         vk::UniqueInstance               m_Instance;
         vk::UniqueDebugUtilsMessengerEXT m_DebugMessenger;
@@ -315,5 +403,18 @@ namespace QueueFlags{
         mutable std::map<vk::QueueFlags, std::vector<ThreadQueue>> m_Queues;
         std::unordered_map<vk::QueueFlags, uint32_t>               m_QueueFamilies;
         vk::UniqueDescriptorPool                                   m_DescriptorPool;
+
+        vk::PipelineStageFlags2 m_ShaderStages;
+        bool                    m_Synchronization2 = false;
+
+        bool                                                              m_SamplerAnisotropy = false;
+        mutable std::mutex                                                m_SamplerMutex;
+        mutable std::unordered_map<SamplerCreateInfo, vk::UniqueSampler> m_Samplers;
+
+        static constexpr vk::DeviceSize s_SCRATCH_BLOCK_SIZE = 32 * 1024 * 1024;
+
+        vk::DeviceSize                    m_AccelScratchAlignment = 1;
+        mutable std::mutex                m_ScratchMutex;
+        mutable std::vector<BufferHandle> m_ScratchBuffers; // Free blocks
     };
 } // namespace vulkaninja
\ No newline at end of file
@@ -0,0 +1,71 @@
+#pragma once
+
+#include "vulkaninja/context.hpp"
+
+#include <array>
+#include <string>
+#include <vector>
+
+namespace vulkaninja
+{
+    enum class DepthReduction
+    {
+        eMin, // Farthest depth with reversed depth
+        eMax, // Farthest depth with standard depth
+    };
+
+    struct DepthPyramidCreateInfo
+    {
+        // Read at mip 0. Needs a view and eSampled usage.
+        ImageHandle depthImage;
+
+        // NOTE: Defaults to standard depth, as GPUCullingCreateInfo::reversedDepth does
+        DepthReduction reduction = DepthReduction::eMax;
+
+        std::string debugName;
+    };
+
+    // Hierarchical depth (HiZ) built by CommandBuffer::buildDepthPyramid in a single compute dispatch.
+    // Level 0 copies the depth image and each level reduces 2x2 texels of the previous one,
+    // rounding odd sizes up so that every texel covers its whole footprint.
+    // NOTE: The descriptor set is written once, so create a new pyramid when the depth image is recreated.
+    class DepthPyramid
+    {
+        friend class CommandBuffer;
+
+    public:
+        // A single workgroup reduces 64x64 texels down to level 6,
+        // so levels past it are reduced by the last workgroup to finish.
+        static constexpr uint32_t s_MAX_LEVELS = 13;
+
+        DepthPyramid(const Context& context, const DepthPyramidCreateInfo& createInfo);
+
+        // R32Sfloat with a nearest sampler, e.g. for GPUCullingDispatchInfo::depthPyramid
+        auto getImage() const -> ImageHandle { return m_Image; }
+        auto getReduction() const -> DepthReduction { return m_Reduction; }
+
+        // Size of level 0. The image is padded to a power of two, and level N holds
+        // the depth extent divided by 2^N and rounded up.
+        auto getDepthExtent() const -> std::array<uint32_t, 2> { return m_DepthExtent; }
+
+    private:
+        void build(const CommandBuffer& commandBuffer) const;
+
+        const Context* m_Context = nullptr;
+
+        DepthReduction          m_Reduction = DepthReduction::eMax;
+        std::array<uint32_t, 2> m_DepthExtent {};
+
+        ImageHandle                      m_DepthImage;
+        ImageHandle                      m_Image;
+        std::vector<vk::UniqueImageView> m_LevelViews;
+        BufferHandle                     m_CounterBuffer; // Workgroups done, reset by the last one
+
+        ShaderHandle          m_Shader;
+        DescriptorSetHandle   m_DescSet;
+        ComputePipelineHandle m_Pipeline;
+
+        uint32_t m_GroupCountX = 0;
+        uint32_t m_GroupCountY = 0;
+    };
+} // namespace vulkaninja
@@ -6,8 +6,11 @@
 
 #include <spirv_cross/spirv_glsl.hpp>
 
+#include <cstddef>
+#include <optional>
 #include <unordered_map>
 #include <variant>
+#include <vector>
 
 namespace vulkaninja
 {
@@ -17,6 +20,20 @@ namespace vulkaninja
         ArrayProxy<std::pair<const char*, std::variant<ArrayProxy<BufferHandle>, uint32_t>>>   buffers;
         ArrayProxy<std::pair<const char*, std::variant<ArrayProxy<ImageHandle>, uint32_t>>>    images;
         ArrayProxy<std::pair<const char*, std::variant<ArrayProxy<TopAccelHandle>, uint32_t>>> accels;
+
+        // Set indices to allocate from the pool. If empty, every set found in the shaders is allocated.
+        // NOTE: Layouts are created for all sets regardless,
+        // so any DescriptorSet built from the same shaders can provide the full pipeline layout.
+        ArrayProxy<uint32_t> sets;
+
+        // Uniform / storage buffers bound as eUniformBufferDynamic / eStorageBufferDynamic.
+        // Bind them with set(name, buffer, range) and pass one offset per dynamic binding,
+        // in binding order, to CommandBuffer::bindDescriptorSet.
+        ArrayProxy<const char*> dynamicBuffers;
+
+        // If set, this set index is created for VK_KHR_push_descriptor and is not allocated from the pool.
+        // Resources are then written at record time by CommandBuffer::pushDescriptorSet.
+        std::optional<uint32_t> pushDescriptorSet;
     };
 
     class DescriptorSet
@@ -30,29 +47,74 @@ namespace vulkaninja
         void set(const std::string& name, ArrayProxy<ImageHandle> images);
         void set(const std::string& name, ArrayProxy<TopAccelHandle> accels);
 
-        vk::DescriptorSetLayout getLayout() const { return *m_DescSetLayout; }
-        vk::DescriptorSet       getDescriptorSet() const { return *m_DescSet; }
+        // Binds [0, range) of the buffer, e.g. one slice of a FrameUniformAllocator for a dynamic binding
+        void set(const std::string& name, BufferHandle buffer, vk::DeviceSize range);
+
+        auto getLayout(uint32_t set = 0) const -> vk::DescriptorSetLayout;
+        auto getDescriptorSet(uint32_t set = 0) const -> vk::DescriptorSet;
+
+        // Layouts of all sets, indexed by the `set` decoration
+        auto getLayouts() const -> ArrayProxy<vk::DescriptorSetLayout>
+        {
+            return ArrayProxy<vk::DescriptorSetLayout>(m_Layouts);
+        }
+        auto getSetCount() const -> uint32_t { return static_cast<uint32_t>(m_Sets.size()); }
+
+        auto getPushDescriptorSet() const -> std::optional<uint32_t> { return m_PushDescriptorSet; }
+
+        // Writes of all resources in the push descriptor set with a null dstSet
+        auto getPushWrites() -> const std::vector<vk::WriteDescriptorSet>&;
 
     private:
+        struct Descriptor;
+
         void addResources(ShaderHandle shader);
         void updateBindingMap(const spirv_cross::Resource&     resource,
                               const spirv_cross::CompilerGLSL& glsl,
                               vk::ShaderStageFlags             stage,
                               vk::DescriptorType               type);
 
-        const Context*                m_Context;
-        vk::UniqueDescriptorSet       m_DescSet;
-        vk::UniqueDescriptorSetLayout m_DescSetLayout;
+        void markDirty(Descriptor& descriptor, bool countChanged);
+        void createUpdateTemplate(uint32_t set);
+        void updateWithTemplate(uint32_t set);
+        void updateDirtyBindings(uint32_t set);
+        void packInfos(const Descriptor& descriptor);
+
+        const Context* m_Context;
 
         using BufferInfos = std::vector<vk::DescriptorBufferInfo>;
         using ImageInfos  = std::vector<vk::DescriptorImageInfo>;
-        using AccelInfos  = std::vector<vk::WriteDescriptorSetAccelerationStructureKHR>;
+        using AccelInfos  = std::vector<vk::AccelerationStructureKHR>;
         struct Descriptor
         {
+            uint32_t                                          set = 0;
             vk::DescriptorSetLayoutBinding                    binding;
             std::variant<BufferInfos, ImageInfos, AccelInfos> infos;
+
+            // Set by set() when the infos differ from what was last written
+            bool dirty = false;
+
+            // Byte offset of this binding inside the template data of its set
+            size_t templateOffset = 0;
+        };
+
+        struct Set
+        {
+            vk::UniqueDescriptorSetLayout layout;
+            vk::UniqueDescriptorSet       descSet;
+
+            // NOTE: The template is compiled lazily on the first update and
+            // only recompiled when the number of descriptors of a binding changes.
+            vk::UniqueDescriptorUpdateTemplate updateTemplate;
+            std::vector<std::byte>             templateData;
         };
 
         std::unordered_map<std::string, Descriptor> m_Descriptors;
+        std::vector<Set>                            m_Sets;
+        std::vector<vk::DescriptorSetLayout>        m_Layouts;
+
+        std::optional<uint32_t>                                     m_PushDescriptorSet;
+        std::vector<vk::WriteDescriptorSet>                         m_PushWrites;
+        std::vector<vk::WriteDescriptorSetAccelerationStructureKHR> m_PushAccelWrites;
     };
-} // namespace vulkaninja
\ No newline at end of file
+} // namespace vulkaninja
@@ -35,6 +35,8 @@ namespace vulkaninja
         eShaderObject,
         eDeviceFault,
         eExtendedDynamicState,
+        ePushDescriptor,
+        eSynchronization2,
     };
 
     enum class Layer
@@ -63,9 +65,20 @@ namespace vulkaninja
         ArrayProxy<Layer>     layers;
         ArrayProxy<Extension> extensions;
 
+        // Maximum sets, and descriptors of each type, in the context descriptor pool
+        uint32_t descriptorPoolSize = 100;
+
         // UI
         UIStyle     style        = UIStyle::eVulkan;
         const char* imguiIniFile = nullptr;
+
+        // Async compute
+        // If true, onCompute() is recorded on the Compute queue and submitted before the frame,
+        // whose graphics submission waits for it at `computeWaitStage`.
+        // The later the stage, the more rasterization overlaps the compute work,
+        // e.g. eFragmentShader if only fragment shaders read its results.
+        bool                   asyncCompute     = false;
+        vk::PipelineStageFlags computeWaitStage = vk::PipelineStageFlagBits::eAllCommands;
     };
 
     class App
@@ -78,6 +91,12 @@ namespace vulkaninja
         virtual void onStart() {}
         virtual void onUpdate(float dt) {}
         virtual void onRender(const CommandBufferHandle& commandBuffer) {}
+
+        // Called before onRender() with a command buffer of the Compute queue if `asyncCompute` is enabled.
+        // NOTE: It may run while the previous frame is still rendering, so keep a copy per frame in flight
+        // of the resources it writes. Resources used by both queues need `concurrent` sharing or
+        // CommandBuffer::releaseOwnership() / acquireOwnership().
+        virtual void onCompute(const CommandBufferHandle& commandBuffer) {}
         virtual void onShutdown() {}
 
         void terminate() { m_Running = false; }
@@ -97,7 +116,10 @@ namespace vulkaninja
         virtual void onWindowSize();
 
     protected:
-        void initVulkan(ArrayProxy<Layer> requiredLayers, ArrayProxy<Extension> requiredExtensions, bool vsync);
+        void initVulkan(ArrayProxy<Layer>     requiredLayers,
+                        ArrayProxy<Extension> requiredExtensions,
+                        bool                  vsync,
+                        uint32_t              descriptorPoolSize = 100);
 
         void initImGui(UIStyle style, const char* imguiIniFile);
 
@@ -107,6 +129,12 @@ namespace vulkaninja
         vk::UniqueSurfaceKHR       m_Surface;
         std::unique_ptr<Swapchain> m_Swapchain;
         bool                       m_Running = true;
+
+        // Async compute
+        std::vector<CommandBufferHandle> m_ComputeCommandBuffers; // Per frame in flight
+        SemaphoreHandle                  m_ComputeSemaphore;      // Timeline signaled with m_ComputeValue
+        uint64_t                         m_ComputeValue = 0;
+        vk::PipelineStageFlags           m_ComputeWaitStage;
     };
 } // namespace vulkaninja
 
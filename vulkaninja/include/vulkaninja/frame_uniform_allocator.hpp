@@ -0,0 +1,67 @@
+#pragma once
+
+#include "vulkaninja/context.hpp"
+
+#include <cstring>
+
+namespace vulkaninja
+{
+    struct FrameUniformAllocatorCreateInfo
+    {
+        // Bytes available to each frame
+        vk::DeviceSize frameSize = 0;
+
+        // Number of frames in flight sharing the ring
+        uint32_t frameCount = 3;
+
+        // Add vk::BufferUsageFlagBits::eStorageBuffer to also use slices as dynamic storage buffers
+        vk::BufferUsageFlags usage = BufferUsage::Uniform;
+
+        std::string debugName;
+    };
+
+    struct FrameUniformAllocation
+    {
+        void*    data   = nullptr;
+        uint32_t offset = 0; // dynamic offset for CommandBuffer::bindDescriptorSet
+    };
+
+    // Bump allocator over a persistently mapped host-visible ring buffer.
+    // Each frame in flight owns one region, which is rewound by beginFrame().
+    class FrameUniformAllocator
+    {
+    public:
+        FrameUniformAllocator(const Context& context, const FrameUniformAllocatorCreateInfo& createInfo);
+
+        // NOTE: The GPU must have finished with this frame's region,
+        // e.g. after waiting the in-flight fence of the same frame index.
+        void beginFrame(uint32_t frameIndex);
+
+        auto allocate(vk::DeviceSize size) -> FrameUniformAllocation;
+
+        template<typename T>
+        auto push(const T& data) -> uint32_t
+        {
+            FrameUniformAllocation allocation = allocate(sizeof(T));
+            std::memcpy(allocation.data, &data, sizeof(T));
+            return allocation.offset;
+        }
+
+        auto getBuffer() const -> BufferHandle { return m_Buffer; }
+        auto getAlignment() const -> vk::DeviceSize { return m_Alignment; }
+        auto getFrameSize() const -> vk::DeviceSize { return m_FrameSize; }
+
+    private:
+        const Context* m_Context = nullptr;
+
+        BufferHandle m_Buffer;
+        uint8_t*     m_Mapped = nullptr;
+
+        vk::DeviceSize m_Alignment  = 1;
+        vk::DeviceSize m_FrameSize  = 0;
+        uint32_t       m_FrameCount = 0;
+
+        vk::DeviceSize m_FrameBegin = 0;
+        vk::DeviceSize m_Head       = 0;
+    };
+} // namespace vulkaninja
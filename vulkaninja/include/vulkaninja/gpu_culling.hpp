@@ -0,0 +1,85 @@
+#pragma once
+
+#include "vulkaninja/mesh.hpp"
+
+namespace vulkaninja
+{
+    enum class CullingBounds
+    {
+        eSphere, // vec4(center, radius) per instance
+        eAABB,   // vec4(min, 0), vec4(max, 0) per instance
+    };
+
+    struct GPUCullingCreateInfo
+    {
+        uint32_t maxInstanceCount = 0;
+
+        CullingBounds bounds = CullingBounds::eSphere;
+
+        // Test against a depth pyramid holding the farthest depth of each texel,
+        // i.e. DepthReduction::eMax, or DepthReduction::eMin if reversedDepth is set.
+        bool occlusion     = true;
+        bool reversedDepth = false;
+
+        // Descriptor sets of the depth pyramid are kept per frame in flight, see beginFrame()
+        uint32_t frameCount = 1;
+
+        std::string debugName;
+    };
+
+    struct GPUCullingDispatchInfo
+    {
+        // NOTE: Input buffers are read through buffer device addresses, e.g. created with BufferUsage::Storage.
+        BufferHandle boundsBuffer; // World space bounds, see CullingBounds
+        BufferHandle drawBuffer;   // One vk::DrawIndexedIndirectCommand per instance, e.g. from Mesh::buildDrawCommands
+        uint32_t     instanceCount = 0;
+
+        glm::mat4 viewProj {1.0f};
+
+        // Built by CommandBuffer::buildDepthPyramid. Ignored if occlusion is disabled.
+        // NOTE: A new pyramid is written to the descriptor set of the current frame, see beginFrame().
+        DepthPyramidHandle depthPyramid;
+    };
+
+    // Compacts the draws of visible instances into an indirect buffer with an atomic count,
+    // to be drawn by CommandBuffer::drawIndexedIndirectCount(getDrawBuffer(), 0, getCountBuffer(), 0, max).
+    // The CPU cost does not depend on the number of instances.
+    // NOTE: cull() declares eIndirectBuffer on both buffers, so the barrier is flushed by the next
+    // beginRendering() and must not be left for a draw inside rendering.
+    class GPUCulling
+    {
+    public:
+        GPUCulling(const Context& context, const GPUCullingCreateInfo& createInfo);
+
+        // NOTE: The GPU must have finished with this frame's descriptor set,
+        // e.g. after waiting the in-flight fence of the same frame index.
+        void beginFrame(uint32_t frameIndex);
+
+        void cull(const CommandBufferHandle& commandBuffer, const GPUCullingDispatchInfo& dispatchInfo);
+
+        auto getDrawBuffer() const -> BufferHandle { return m_DrawBuffer; }
+        auto getCountBuffer() const -> BufferHandle { return m_CountBuffer; }
+        auto getMaxInstanceCount() const -> uint32_t { return m_MaxInstanceCount; }
+
+    private:
+        struct Frame
+        {
+            DescriptorSetHandle descSet;
+            ImageHandle         depthPyramid; // Written to descSet
+        };
+
+        const Context* m_Context = nullptr;
+
+        uint32_t m_MaxInstanceCount = 0;
+        bool     m_Occlusion        = false;
+        bool     m_ReversedDepth    = false;
+
+        BufferHandle m_DrawBuffer;
+        BufferHandle m_CountBuffer;
+
+        ShaderHandle          m_Shader;
+        ComputePipelineHandle m_Pipeline;
+        std::vector<Frame>    m_Frames;
+        uint32_t              m_FrameIndex = 0;
+    };
+} // namespace vulkaninja
@@ -1,8 +1,10 @@
 #pragma once
 
 #include "vulkaninja/context.hpp"
+#include "vulkaninja/resource_state.hpp"
 
 #include <filesystem>
+#include <optional>
 
 namespace vulkaninja
 {
@@ -13,13 +15,6 @@ namespace vulkaninja
         vk::ImageAspectFlags aspect = vk::ImageAspectFlagBits::eColor;
     };
 
-    struct SamplerCreateInfo
-    {
-        vk::Filter             filter      = vk::Filter::eLinear;
-        vk::SamplerAddressMode addressMode = vk::SamplerAddressMode::eRepeat;
-        vk::SamplerMipmapMode  mipmapMode  = vk::SamplerMipmapMode::eLinear;
-    };
-
     // NOTE:
     // It is assumed that the Cubemap is read from a file,
     // and the application side will only create 2D or 3D textures.
@@ -40,6 +35,14 @@ namespace vulkaninja
 
         std::optional<SamplerCreateInfo> samplerInfo;
 
+        // If true, no memory is allocated and the view is created by bindMemory(),
+        // e.g. when a RenderGraph places transient images at overlapping offsets of a shared heap.
+        bool aliasable = false;
+
+        // If true, the image is shared by all queue families without ownership transfers.
+        // This may disable compression, so prefer CommandBuffer::releaseOwnership() for render targets.
+        bool concurrent = false;
+
         // Debug
         std::string debugName;
     };
@@ -77,19 +80,43 @@ namespace vulkaninja
         auto getImage() const -> vk::Image { return m_Image; }
         auto getView() const -> vk::ImageView { return m_View; }
         auto getSampler() const -> vk::Sampler { return m_Sampler; }
-        auto getInfo() const -> vk::DescriptorImageInfo { return {m_Sampler, m_View, m_Layout}; }
+        auto getInfo() const -> vk::DescriptorImageInfo { return {m_Sampler, m_View, m_State.layout}; }
+
+        // Reference a shared sampler from the context cache
+        void setSampler(const SamplerCreateInfo& samplerInfo)
+        {
+            m_Sampler = m_Context->getOrCreateSampler(samplerInfo);
+        }
+
         auto getMipLevels() const -> uint32_t { return m_MipLevels; }
         auto getAspectMask() const -> vk::ImageAspectFlags { return m_Aspect; }
-        auto getLayout() const -> vk::ImageLayout { return m_Layout; }
+        auto getLayout() const -> vk::ImageLayout { return m_State.layout; }
         auto getExtent() const -> vk::Extent3D { return m_Extent; }
         auto getFormat() const -> vk::Format { return m_Format; }
         auto getLayerCount() const -> uint32_t { return m_LayerCount; }
         auto getViewType() const -> vk::ImageViewType { return m_ViewType; }
+        auto getUsage() const -> vk::ImageUsageFlags { return m_Usage; }
+        auto getMemoryRequirements() const -> vk::MemoryRequirements
+        {
+            return m_Context->getDevice().getImageMemoryRequirements(m_Image);
+        }
+
+        // Binds an aliasable image to memory owned by the caller and creates its view
+        void bindMemory(vk::DeviceMemory memory, vk::DeviceSize offset);
+
+        // Tracked by CommandBuffer at record time
+        auto getState() const -> const ResourceState& { return m_State; }
+        void setState(const ResourceState& state) { m_State = state; }
 
         // Ensure that data is pre-filled
         // ImageLayout is implicitly shifted to ShaderReadOnlyOptimal
+        // NOTE: Blits level by level. MipGenerator writes all levels of several images in one dispatch.
         void generateMipmaps(const CommandBuffer& commandBuffer);
 
+        // UNORM equivalent of sRGB formats, which do not support storage.
+        // Storage images of sRGB formats are created mutable and written through views of this format.
+        static auto getStorageFormat(vk::Format format) -> vk::Format;
+
         // TODO: refactor these
         static auto loadFromFile(const Context&               context,
                                  const std::filesystem::path& filepath,
@@ -119,44 +146,37 @@ namespace vulkaninja
             viewInfo.setViewType(m_ViewType);
             viewInfo.setSubresourceRange(subresourceRange);
 
-            m_View = m_Context->getDevice().createImageView(viewInfo);
-        }
-
-        void createSampler(vk::Filter filter, vk::SamplerAddressMode addressMode, vk::SamplerMipmapMode mipmapMode)
-        {
-            vk::SamplerCreateInfo samplerInfo;
-            samplerInfo.setMagFilter(filter);
-            samplerInfo.setMinFilter(filter);
-            samplerInfo.setAnisotropyEnable(VK_FALSE); // TODO: true
-            samplerInfo.setMaxLod(0.0f);
-            samplerInfo.setMinLod(0.0f);
-            if (m_MipLevels > 1)
+            // NOTE: The sRGB view of a storage image must not inherit the storage usage
+            vk::ImageViewUsageCreateInfo usageInfo {m_Usage & ~vk::ImageUsageFlagBits::eStorage};
+            if (getStorageFormat(m_Format) != m_Format && (m_Usage & vk::ImageUsageFlagBits::eStorage))
             {
-                samplerInfo.setMaxLod(static_cast<float>(m_MipLevels));
+                viewInfo.setPNext(&usageInfo);
             }
-            samplerInfo.setMipmapMode(mipmapMode);
-            samplerInfo.setAddressModeU(addressMode);
-            samplerInfo.setAddressModeV(addressMode);
-            samplerInfo.setAddressModeW(addressMode);
-            samplerInfo.setCompareEnable(VK_TRUE);
-            samplerInfo.setCompareOp(vk::CompareOp::eLess);
-            m_Sampler = m_Context->getDevice().createSampler(samplerInfo);
+
+            m_View = m_Context->getDevice().createImageView(viewInfo);
         }
 
         const Context* m_Context = nullptr;
         std::string    m_DebugName;
 
-        vk::Image         m_Image;
-        vk::DeviceMemory  m_Memory;
-        vk::ImageView     m_View;
-        vk::Sampler       m_Sampler;
-        vk::ImageViewType m_ViewType;
+        vk::Image           m_Image;
+        vk::DeviceMemory    m_Memory;
+        vk::ImageView       m_View;
+        vk::Sampler         m_Sampler; // NOTE: Owned by the context sampler cache
+        vk::ImageViewType   m_ViewType;
+        vk::ImageUsageFlags m_Usage;
+
+        std::optional<ImageViewCreateInfo> m_ViewInfo; // Created when memory is bound
 
         bool m_HasOwnership = false;
 
-        vk::ImageLayout m_Layout = vk::ImageLayout::eUndefined;
-        vk::Extent3D    m_Extent;
-        vk::Format      m_Format = {};
+        ResourceState m_State;
+        vk::Extent3D  m_Extent;
+
+        // Layout before a queue family ownership transfer released by CommandBuffer::releaseOwnership().
+        // The acquire barrier must repeat the layouts of the release.
+        std::optional<vk::ImageLayout> m_ReleasedLayout;
+        vk::Format    m_Format = {};
 
         uint32_t m_MipLevels  = 1;
         uint32_t m_LayerCount = 1;
@@ -8,6 +8,8 @@
 #include <glm/glm.hpp>
 #include <glm/gtx/hash.hpp>
 
+#include "vulkaninja/accel.hpp"
+#include "vulkaninja/array_proxy.hpp"
 #include "vulkaninja/buffer.hpp"
 
 namespace vulkaninja
@@ -80,6 +82,38 @@ namespace vulkaninja
         std::string name           = "PlaneLine";
     };
 
+    class Mesh;
+
+    // Meshes concatenated into one vertex and one index buffer
+    struct MergedMeshCreateInfo
+    {
+        ArrayProxy<Mesh> meshes;
+        MeshUsage        usage = MeshUsage::eGraphics;
+        std::string      name  = "Merged";
+    };
+
+    // Location of a mesh in vertex and index buffers shared with other meshes
+    struct MeshRange
+    {
+        uint32_t firstIndex   = 0;
+        uint32_t indexCount   = 0;
+        int32_t  vertexOffset = 0;
+    };
+
+    // Formats written by Mesh::createAccelGeometries, e.g. with vertexFormat chosen by chooseAccelVertexFormat().
+    // Supports eR32G32B32Sfloat, eR16G16B16(A16)Sfloat and eR16G16B16(A16)Snorm.
+    struct AccelMeshFormat
+    {
+        vk::Format    vertexFormat = vk::Format::eR32G32B32Sfloat;
+        vk::IndexType indexType    = vk::IndexType::eUint32;
+    };
+
+    struct MeshDraw
+    {
+        uint32_t range         = 0; // Index in Mesh::ranges
+        uint32_t instanceCount = 1;
+    };
+
     class Mesh
     {
     public:
@@ -95,6 +129,18 @@ namespace vulkaninja
         static auto createCubeMesh(const Context& context, CubeMeshCreateInfo createInfo) -> Mesh;
         static auto createPlaneLineMesh(const Context& context, PlaneLineMeshCreateInfo createInfo) -> Mesh;
         static auto createCubeLineMesh(const Context& context, CubeLineMeshCreateInfo createInfo) -> Mesh;
+        static auto createMergedMesh(const Context& context, MergedMeshCreateInfo createInfo) -> Mesh;
+
+        // Packs one command per draw of a merged mesh, to be drawn by drawIndexedIndirect(Count)
+        // with this mesh bound. firstInstance runs over the instances of all draws,
+        // so shaders can fetch per-instance data with gl_InstanceIndex across the whole stream.
+        auto buildDrawCommands(ArrayProxy<MeshDraw> draws) const -> std::vector<vk::DrawIndexedIndirectCommand>;
+
+        // Writes positions and indices in `format` to new buffers for BottomAccelCreateInfo::geometries,
+        // with one geometry per range of a merged mesh. SNORM positions are normalized to the bounds of
+        // their geometry, whose transform scales them back.
+        // NOTE: Geometries with more than 65536 vertices keep 32-bit indices.
+        auto createAccelGeometries(const AccelMeshFormat& format = {}) const -> std::vector<AccelGeometry>;
 
         auto getVertexCount() const -> uint32_t { return static_cast<uint32_t>(vertices.size()); }
         auto getIndicesCount() const -> uint32_t { return static_cast<uint32_t>(indices.size()); }
@@ -109,6 +155,9 @@ namespace vulkaninja
 
         std::vector<Vertex>   vertices;
         std::vector<uint32_t> indices;
+
+        // Meshes merged into this one, in input order
+        std::vector<MeshRange> ranges;
     };
 } // namespace vulkaninja
 
@@ -0,0 +1,80 @@
+#pragma once
+
+#include "vulkaninja/array_proxy.hpp"
+#include "vulkaninja/context.hpp"
+
+#include <array>
+#include <string>
+#include <vector>
+
+namespace vulkaninja
+{
+    struct MipGeneratorCreateInfo
+    {
+        // Descriptor sets, views and job buffers are allocated per frame in flight, see beginFrame()
+        uint32_t frameCount = 1;
+
+        // Dispatches recorded per frame. Each one writes up to MipGenerator::s_MAX_BATCH_SIZE images.
+        // NOTE: Images whose levels get odd sizes before the last few take several dispatches,
+        // e.g. 4 for 1920x1080 against 1 for 2048x2048.
+        uint32_t maxDispatchCount = 8;
+
+        // Array layers of 2D images, e.g. 6 per cube
+        uint32_t maxLayerCount = 6;
+
+        std::string debugName;
+    };
+
+    // Writes every mip level from level 0 with a box filter in one compute dispatch per batch of images,
+    // instead of a barrier and a blit per level. Each workgroup reduces one tile of level 0 through shared memory
+    // and the last workgroup to finish with an image layer reduces the levels left, as in FidelityFX SPD.
+    // 2D images, arrays and cubes are batched together, 3D images in a separate dispatch.
+    // sRGB images are filtered in linear space.
+    // NOTE: Images need eStorage usage and a format supporting storage images, and are left in eGeneral.
+    // Images of any format share one pipeline, which needs the shaderStorageImageReadWithoutFormat,
+    // shaderStorageImageWriteWithoutFormat and shaderStorageImageArrayDynamicIndexing features
+    // (enabled by App if supported).
+    class MipGenerator
+    {
+    public:
+        static constexpr uint32_t s_MAX_BATCH_SIZE = 16;
+        static constexpr uint32_t s_MAX_LEVELS     = 16;
+
+        MipGenerator(const Context& context, const MipGeneratorCreateInfo& createInfo);
+
+        // NOTE: The GPU must have finished with this frame's resources,
+        // e.g. after waiting the in-flight fence of the same frame index.
+        void beginFrame(uint32_t frameIndex);
+
+        void generate(const CommandBufferHandle& commandBuffer, ArrayProxy<ImageHandle> images);
+
+    private:
+        struct Frame
+        {
+            vk::UniqueDescriptorPool         descPool;
+            std::vector<vk::UniqueImageView> views;
+            BufferHandle                     jobBuffer;
+            uint32_t                         dispatchCount = 0;
+        };
+
+        void dispatch(const CommandBufferHandle& commandBuffer, const std::vector<ImageHandle>& images, bool volume);
+
+        const Context* m_Context = nullptr;
+
+        uint32_t                m_MaxDispatchCount = 0;
+        uint32_t                m_MaxLayerCount    = 0;
+        std::array<uint32_t, 3> m_MaxGroupCount    = {};
+
+        vk::UniqueDescriptorSetLayout m_DescSetLayout;
+        ShaderHandle                  m_Shader;
+        ShaderHandle                  m_VolumeShader;
+        ComputePipelineHandle         m_Pipeline;
+        ComputePipelineHandle         m_VolumePipeline;
+
+        // One counter per image and layer of a batch, reset by the last workgroup
+        BufferHandle m_CounterBuffer;
+
+        std::vector<Frame> m_Frames;
+        uint32_t           m_FrameIndex = 0;
+    };
+} // namespace vulkaninja
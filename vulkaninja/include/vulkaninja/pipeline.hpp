@@ -15,7 +15,8 @@ namespace vulkaninja
     struct GraphicsPipelineCreateInfo
     {
         // Layout
-        vk::DescriptorSetLayout descSetLayout;
+        // NOTE: Indexed by set, e.g. per-frame, per-pass, per-material and per-draw sets.
+        ArrayProxy<vk::DescriptorSetLayout> descSetLayouts;
 
         uint32_t pushSize = 0;
 
@@ -46,18 +47,18 @@ namespace vulkaninja
 
     struct ComputePipelineCreateInfo
     {
-        vk::DescriptorSetLayout descSetLayout;
-        uint32_t                pushSize = 0;
-        ShaderHandle            computeShader;
+        ArrayProxy<vk::DescriptorSetLayout> descSetLayouts;
+        uint32_t                            pushSize = 0;
+        ShaderHandle                        computeShader;
     };
 
     struct MeshShaderPipelineCreateInfo
     {
-        vk::DescriptorSetLayout descSetLayout;
-        uint32_t                pushSize = 0;
-        ShaderHandle            taskShader;
-        ShaderHandle            meshShader;
-        ShaderHandle            fragmentShader;
+        ArrayProxy<vk::DescriptorSetLayout> descSetLayouts;
+        uint32_t                            pushSize = 0;
+        ShaderHandle                        taskShader;
+        ShaderHandle                        meshShader;
+        ShaderHandle                        fragmentShader;
 
         // Viewport
         ArrayProxy<vk::Format> colorFormats;
@@ -83,28 +84,47 @@ namespace vulkaninja
         ShaderHandle missShader;
     };
 
+    // Procedural hit group if intShader is set, for AABB geometry, otherwise triangles hit group
     struct HitGroup
     {
         ShaderHandle chitShader;
         ShaderHandle ahitShader;
+        ShaderHandle intShader;
     };
 
     struct CallableGroup
     {
-        Shader callableShader;
+        ShaderHandle callableShader;
     };
 
     struct RayTracingPipelineCreateInfo
     {
-        RaygenGroup               rgenGroup;
+        RaygenGroup               rgenGroup; // Optional in libraries
         ArrayProxy<MissGroup>     missGroups;
         ArrayProxy<HitGroup>      hitGroups;
         ArrayProxy<CallableGroup> callableGroups;
 
-        vk::DescriptorSetLayout descSetLayout;
-        uint32_t                pushSize = 0;
+        ArrayProxy<vk::DescriptorSetLayout> descSetLayouts;
+        uint32_t                            pushSize = 0;
 
         uint32_t maxRayRecursionDepth = 4;
+
+        // Creates a pipeline library, e.g. with the hit group of one material, which is compiled once
+        // and can only be linked into other pipelines through `libraries`.
+        // NOTE: Libraries must share descSetLayouts, pushSize, maxRayRecursionDepth and the sizes below
+        // with the pipelines linking them, and cannot link libraries themselves.
+        bool library = false;
+
+        // Groups of each library follow the groups above in the SBT regions, in order
+        ArrayProxy<RayTracingPipelineHandle> libraries;
+
+        // Compiles the stages of the libraries again into this pipeline instead of linking their binaries,
+        // so that they are optimized together. Slower to create, faster to trace.
+        bool linkTimeOptimization = false;
+
+        // Interface of pipelines linked with libraries, in bytes
+        uint32_t maxRayPayloadSize   = 64;
+        uint32_t maxHitAttributeSize = 8; // e.g. the barycentrics of triangles
     };
 
     class Pipeline
@@ -150,24 +170,41 @@ namespace vulkaninja
         RayTracingPipeline() = delete;
         RayTracingPipeline(const Context& context, const RayTracingPipelineCreateInfo& createInfo);
 
+        // Shader group handles by kind: raygen, miss, hit then callable groups, including linked libraries.
+        // NOTE: Empty for libraries. Handles change whenever libraries are linked again, so create new SBTs then.
+        auto getGroupHandles() const -> const std::vector<uint8_t>& { return m_GroupHandles; }
+
+        auto getMissGroupCount() const -> uint32_t { return static_cast<uint32_t>(m_MissGroups.size()); }
+        auto getHitGroupCount() const -> uint32_t { return static_cast<uint32_t>(m_HitGroups.size()); }
+        auto getCallableGroupCount() const -> uint32_t { return static_cast<uint32_t>(m_CallableGroups.size()); }
+
+        auto isLibrary() const -> bool { return m_Library; }
+
+        // One record per group without inline data, used by CommandBuffer::traceRays(pipeline, ...)
+        // NOTE: Created by Context::createRayTracingPipeline(), since the table takes a handle to the pipeline.
+        auto getSBT() const -> ShaderBindingTableHandle { return m_SBT; }
+
     private:
         friend class CommandBuffer;
+        friend class Context;
 
-        void createSBT();
+        auto addStage(const ShaderHandle& shader, vk::ShaderStageFlagBits stage) -> uint32_t;
 
-        std::vector<vk::ShaderModule>                       m_ShaderModules;
+        // NOTE: Shaders are kept alive so that pipelines with link-time optimization can compile them again
+        std::vector<ShaderHandle>                           m_Shaders;
         std::vector<vk::PipelineShaderStageCreateInfo>      m_ShaderStages;
         std::vector<vk::RayTracingShaderGroupCreateInfoKHR> m_ShaderGroups;
 
-        vk::StridedDeviceAddressRegionKHR m_RaygenRegion;
-        vk::StridedDeviceAddressRegionKHR m_MissRegion;
-        vk::StridedDeviceAddressRegionKHR m_HitRegion;
-        vk::StridedDeviceAddressRegionKHR m_CallableRegion;
+        // Indices of the groups of each kind in this pipeline, after which come the groups of linked libraries
+        std::vector<uint32_t> m_RaygenGroups;
+        std::vector<uint32_t> m_MissGroups;
+        std::vector<uint32_t> m_HitGroups;
+        std::vector<uint32_t> m_CallableGroups;
 
-        BufferHandle m_SbtBuffer;
+        bool                                  m_Library = false;
+        std::vector<RayTracingPipelineHandle> m_Libraries; // Linked
 
-        uint32_t m_RgenCount = 0;
-        uint32_t m_MissCount = 0;
-        uint32_t m_HitCount  = 0;
+        std::vector<uint8_t>     m_GroupHandles;
+        ShaderBindingTableHandle m_SBT;
     };
 } // namespace vulkaninja
\ No newline at end of file
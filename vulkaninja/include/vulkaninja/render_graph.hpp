@@ -0,0 +1,211 @@
+#pragma once
+
+#include "vulkaninja/array_proxy.hpp"
+#include "vulkaninja/image.hpp"
+
+#include <functional>
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace vulkaninja
+{
+    // Index of a resource in a RenderGraph
+    using RenderGraphResource = uint32_t;
+
+    struct RenderGraphAccess
+    {
+        RenderGraphResource resource = 0;
+        ResourceUsage       usage    = ResourceUsage::eUndefined;
+    };
+
+    struct RenderGraphPassCreateInfo
+    {
+        std::string name;
+
+        ArrayProxy<RenderGraphAccess> reads;
+        ArrayProxy<RenderGraphAccess> writes;
+
+        // Passes without side effects are culled if nothing reads what they write
+        bool sideEffects = false;
+
+        std::function<void(const CommandBufferHandle&)> execute;
+    };
+
+    struct RenderGraphCreateInfo
+    {
+        // Used to compile without a context, e.g. in offline tools or tests.
+        // NOTE: Overwritten by Context::getShaderStages if the graph is created from a context.
+        vk::PipelineStageFlags2 shaderStages = vk::PipelineStageFlagBits2::eVertexShader |
+                                               vk::PipelineStageFlagBits2::eFragmentShader |
+                                               vk::PipelineStageFlagBits2::eComputeShader;
+
+        // Labels execute() and names the heaps of aliasable images
+        std::string debugName;
+    };
+
+    struct RenderGraphBarrier
+    {
+        RenderGraphResource resource = 0;
+        ResourceState       srcState;
+        ResourceState       dstState;
+    };
+
+    struct RenderGraphCompiledPass
+    {
+        uint32_t                        pass = 0; // Index in declaration order
+        std::vector<RenderGraphBarrier> barriers; // Recorded as one barrier before the pass
+
+        // Global memory barrier for aliasable images placed over memory used by other images.
+        // NOTE: Layouts are ignored. Recorded with the barriers above if aliasSrcState.stage is not empty.
+        ResourceState aliasSrcState;
+        ResourceState aliasDstState;
+    };
+
+    // Passes declare the images and buffers they read and write.
+    // compile() culls unused passes, sorts the rest, computes the minimal barriers and
+    // aliases transient images with disjoint lifetimes. It does not touch the GPU.
+    // execute() creates the transient images on first use, computes the barriers again from the states
+    // the images and buffers are in at that point, and records them as one barrier before each pass.
+    // Aliasable transient images are also placed at overlapping offsets of shared heaps there,
+    // since their sizes are only known from the device.
+    class RenderGraph
+    {
+    public:
+        RenderGraph(const Context& context, const RenderGraphCreateInfo& createInfo);
+
+        // Offline graph: compile() only
+        explicit RenderGraph(const RenderGraphCreateInfo& createInfo);
+
+        // Imported resources are kept alive by the graph and passes writing them are never culled.
+        // Without initialState, the state tracked on the image or buffer is read at compile() and execute(),
+        // so it follows the commands recorded between frames.
+        // NOTE: With initialState, e.g. for offline graphs, they must be in it when execute() is recorded.
+        auto importImage(const std::string& name, ImageHandle image, const ResourceState& initialState)
+            -> RenderGraphResource;
+        auto importImage(const std::string& name, ImageHandle image) -> RenderGraphResource;
+        auto importBuffer(const std::string& name, BufferHandle buffer, const ResourceState& initialState)
+            -> RenderGraphResource;
+        auto importBuffer(const std::string& name, BufferHandle buffer) -> RenderGraphResource;
+
+        // Transient images live only within the graph and may share an image with other transient images.
+        // If createInfo.aliasable is set, images of different descriptions share memory instead.
+        // NOTE: Usage flags are added from the declared accesses.
+        auto createImage(const std::string& name, const ImageCreateInfo& createInfo) -> RenderGraphResource;
+
+        auto addPass(const RenderGraphPassCreateInfo& createInfo) -> uint32_t;
+
+        void compile();
+
+        void execute(const CommandBufferHandle& commandBuffer);
+
+        // Valid after compile()
+        auto getCompiledPasses() const -> const std::vector<RenderGraphCompiledPass>& { return m_CompiledPasses; }
+        auto isCulled(uint32_t pass) const -> bool { return m_Passes[pass].culled; }
+        auto getFinalState(RenderGraphResource resource) const -> const ResourceState&
+        {
+            return m_Resources[resource].finalState;
+        }
+
+        // Transient images with the same physical index share one image
+        auto getPhysicalImageIndex(RenderGraphResource resource) const -> uint32_t
+        {
+            return m_Resources[resource].physicalIndex;
+        }
+        auto getPhysicalImageCount() const -> uint32_t { return static_cast<uint32_t>(m_PhysicalImages.size()); }
+
+        // Valid after execute(). Memory of all heaps, sized to the peak of aliasable images alive at once.
+        auto getHeapSize() const -> vk::DeviceSize;
+
+        // Valid in pass callbacks
+        auto getImage(RenderGraphResource resource) const -> ImageHandle;
+        auto getBuffer(RenderGraphResource resource) const -> BufferHandle;
+
+    private:
+        struct Pass
+        {
+            std::string                                     name;
+            std::vector<RenderGraphAccess>                  reads;
+            std::vector<RenderGraphAccess>                  writes;
+            bool                                            sideEffects = false;
+            std::function<void(const CommandBufferHandle&)> execute;
+
+            bool culled = false;
+        };
+
+        struct Resource
+        {
+            std::string   name;
+            bool          isImported = false;
+            bool          isBuffer   = false;
+            bool          isTracked  = false; // Imported without an initial state
+            ImageHandle   image;
+            BufferHandle  buffer;
+            ResourceState initialState;
+
+            // Transient images
+            ImageCreateInfo     createInfo;
+            vk::ImageUsageFlags usage;
+            uint32_t            physicalIndex = UINT32_MAX;
+            uint32_t            firstUse      = UINT32_MAX; // Index in m_CompiledPasses
+            uint32_t            lastUse       = 0;
+
+            ResourceState finalState;
+        };
+
+        struct PhysicalImage
+        {
+            ImageCreateInfo createInfo;
+            uint32_t        lastUse = 0;
+            ResourceState   lastState;
+            ImageHandle     image;
+
+            // The first transient placed here, whose first barrier waits for the previous frame
+            RenderGraphResource firstResource = 0;
+            uint32_t            firstUse      = 0;
+
+            // Aliasable images: other physical images overlapping in the same heap
+            std::vector<uint32_t> aliases;
+        };
+
+        struct Heap
+        {
+            vk::UniqueDeviceMemory memory;
+            vk::DeviceSize         size = 0;
+        };
+
+        // State of an accessed resource after a compiled pass
+        struct PassState
+        {
+            RenderGraphResource resource = 0;
+            ResourceState       state;
+        };
+
+        void cullPasses();
+        void sortPasses();
+        void aliasTransientImages();
+        void computeBarriers();
+        void allocateHeaps();
+        void retireHeaps();
+        auto getInitialState(const Resource& resource) const -> ResourceState;
+
+        const Context*          m_Context = nullptr;
+        vk::PipelineStageFlags2 m_ShaderStages;
+        std::string             m_DebugName;
+
+        // NOTE: Declared before every image handle, since members are destroyed in reverse order
+        // and the images must go before their memory.
+        std::vector<Heap> m_Heaps;
+
+        std::vector<Pass>                    m_Passes;
+        std::vector<Resource>                m_Resources;
+        std::vector<PhysicalImage>           m_PhysicalImages;
+        std::vector<RenderGraphCompiledPass> m_CompiledPasses;
+        std::vector<std::vector<PassState>>  m_PassStates; // Set on the images and buffers after each pass
+        bool                                 m_Compiled = false;
+
+        // Images and heaps replaced by a recompile. Handed to the command buffer of the next execute(),
+        // whose next begin() comes after the GPU has finished every frame that used them.
+        std::vector<std::shared_ptr<void>> m_RetiredResources;
+    };
+} // namespace vulkaninja
@@ -0,0 +1,75 @@
+#pragma once
+
+#include <vulkan/vulkan.hpp>
+
+#include <optional>
+
+namespace vulkaninja
+{
+    // How a command is going to use an image or a buffer.
+    // CommandBuffer::declareUsage computes barriers from the tracked state and these usages.
+    enum class ResourceUsage
+    {
+        eUndefined,
+        eTransferSrc,
+        eTransferDst,
+        eClearDst,
+        eBlitSrc,
+        eBlitDst,
+        eVertexBuffer,
+        eIndexBuffer,
+        eIndirectBuffer,
+        eUniformBuffer,
+        eShaderRead,      // Sampled image, storage image/buffer read
+        eShaderWrite,     // Storage image/buffer write
+        eShaderReadWrite, // Storage image/buffer read and write
+        eColorAttachment,
+        eDepthStencilAttachment,
+        eDepthStencilRead,
+        eAccelBuildInput,  // Vertex, index, transform and instance buffers of a build
+        eAccelBuild,       // Destination and scratch of a build
+        eAccelBuildSource, // Structures read by a build, copy or query, e.g. the BottomAccels of a TopAccel
+        eAccelRead,        // Traversal in ray tracing or ray query shaders
+        eShaderBindingTable,
+        ePresent,
+        eHostRead,
+        eHostWrite,
+    };
+
+    // Last access to a resource.
+    // NOTE: Stages and access are kept in synchronization2 flags,
+    // which are converted by toLegacyStage / toLegacyAccess if the device does not enable it.
+    struct ResourceState
+    {
+        vk::ImageLayout         layout = vk::ImageLayout::eUndefined; // Ignored for buffers
+        vk::PipelineStageFlags2 stage;
+        vk::AccessFlags2        access;
+
+        bool operator==(const ResourceState&) const = default;
+    };
+
+    static constexpr vk::AccessFlags2 WriteAccess =
+        vk::AccessFlagBits2::eShaderWrite | vk::AccessFlagBits2::eShaderStorageWrite |
+        vk::AccessFlagBits2::eColorAttachmentWrite | vk::AccessFlagBits2::eDepthStencilAttachmentWrite |
+        vk::AccessFlagBits2::eTransferWrite | vk::AccessFlagBits2::eHostWrite | vk::AccessFlagBits2::eMemoryWrite |
+        vk::AccessFlagBits2::eAccelerationStructureWriteKHR;
+
+    // NOTE: shaderStages is the set of shader stages enabled on the device, see Context::getShaderStages.
+    auto getResourceState(ResourceUsage usage, vk::PipelineStageFlags2 shaderStages) -> ResourceState;
+
+    // State for an explicit layout, e.g. from CommandBuffer::transitionLayout
+    auto getResourceState(vk::ImageLayout         layout,
+                          vk::ImageAspectFlags    aspect,
+                          vk::PipelineStageFlags2 shaderStages) -> ResourceState;
+
+    // Moves state to dstState and returns the source state of the barrier required before the access,
+    // or std::nullopt if the previous accesses already cover it.
+    // NOTE: Shared by CommandBuffer at record time and RenderGraph at compile time.
+    auto advanceState(ResourceState& state, const ResourceState& dstState, bool isImage)
+        -> std::optional<ResourceState>;
+
+    // Fallback for vkCmdPipelineBarrier
+    // NOTE: eNone maps to eTopOfPipe as a source stage and to eBottomOfPipe as a destination stage.
+    auto toLegacyStage(vk::PipelineStageFlags2 stage, bool isSrc) -> vk::PipelineStageFlags;
+    auto toLegacyAccess(vk::AccessFlags2 access) -> vk::AccessFlags;
+} // namespace vulkaninja
@@ -0,0 +1,59 @@
+#pragma once
+
+#include <functional>
+#include <optional>
+
+#include <vulkan/vulkan.hpp>
+
+namespace vulkaninja
+{
+    // Full sampler state. Samplers are shared through Context::getOrCreateSampler,
+    // so images with the same state reference the same vk::Sampler.
+    struct SamplerCreateInfo
+    {
+        vk::Filter             filter      = vk::Filter::eLinear;
+        vk::SamplerAddressMode addressMode = vk::SamplerAddressMode::eRepeat;
+        vk::SamplerMipmapMode  mipmapMode  = vk::SamplerMipmapMode::eLinear;
+
+        // Anisotropic filtering is enabled if greater than 1.
+        // NOTE: Clamped to maxSamplerAnisotropy and ignored if the feature is not enabled.
+        float maxAnisotropy = 0.0f;
+
+        float mipLodBias = 0.0f;
+        float minLod     = 0.0f;
+        float maxLod     = VK_LOD_CLAMP_NONE;
+
+        // Used only with eClampToBorder
+        vk::BorderColor borderColor = vk::BorderColor::eFloatTransparentBlack;
+
+        // Depth comparison (e.g. shadow maps) is enabled if set
+        std::optional<vk::CompareOp> compareOp;
+
+        bool operator==(const SamplerCreateInfo&) const = default;
+    };
+} // namespace vulkaninja
+
+namespace std
+{
+    template<>
+    struct hash<vulkaninja::SamplerCreateInfo>
+    {
+        std::size_t operator()(const vulkaninja::SamplerCreateInfo& info) const
+        {
+            std::size_t seed    = 0;
+            auto        combine = [&seed](std::size_t value) {
+                seed ^= value + 0x9e3779b9 + (seed << 6) + (seed >> 2);
+            };
+            combine(std::hash<uint32_t>()(static_cast<uint32_t>(info.filter)));
+            combine(std::hash<uint32_t>()(static_cast<uint32_t>(info.addressMode)));
+            combine(std::hash<uint32_t>()(static_cast<uint32_t>(info.mipmapMode)));
+            combine(std::hash<float>()(info.maxAnisotropy));
+            combine(std::hash<float>()(info.mipLodBias));
+            combine(std::hash<float>()(info.minLod));
+            combine(std::hash<float>()(info.maxLod));
+            combine(std::hash<uint32_t>()(static_cast<uint32_t>(info.borderColor)));
+            combine(std::hash<uint32_t>()(info.compareOp ? static_cast<uint32_t>(*info.compareOp) + 1 : 0));
+            return seed;
+        }
+    };
+} // namespace std
@@ -0,0 +1,36 @@
+#pragma once
+
+#include <vulkan/vulkan.hpp>
+
+namespace vulkaninja
+{
+    class Context;
+
+    struct SemaphoreCreateInfo
+    {
+        // Timeline semaphores are signaled and waited with increasing values, so one semaphore can order
+        // any number of submissions across queues. Requires the timelineSemaphore feature.
+        bool     timeline     = true;
+        uint64_t initialValue = 0;
+    };
+
+    class Semaphore
+    {
+    public:
+        Semaphore(const Context& context, const SemaphoreCreateInfo& createInfo);
+
+        auto getSemaphore() const -> vk::Semaphore { return *m_Semaphore; }
+        auto isTimeline() const -> bool { return m_Timeline; }
+
+        // Timeline semaphores only
+        auto getValue() const -> uint64_t;
+        void wait(uint64_t value) const;
+        void signal(uint64_t value) const;
+
+    private:
+        const Context* m_Context = nullptr;
+
+        vk::UniqueSemaphore m_Semaphore;
+        bool                m_Timeline = false;
+    };
+} // namespace vulkaninja
@@ -2,6 +2,8 @@
 
 #include "vulkaninja/context.hpp"
 
+#include <variant>
+
 namespace vulkaninja
 {
     struct ShaderCreateInfo
@@ -15,6 +17,15 @@ namespace vulkaninja
     public:
         Shader(const Context& context, const ShaderCreateInfo& createInfo);
 
+        // Compiles GLSL of the built-in compute passes.
+        // NOTE: Throws std::runtime_error with the compiler message on failure.
+        static auto createComputeShader(
+            const Context&                                                                      context,
+            const std::string&                                                                  code,
+            const std::string&                                                                  name,
+            const std::vector<std::variant<std::string, std::tuple<std::string, std::string>>>& keywords = {})
+            -> ShaderHandle;
+
         auto getSpvCode() const { return m_SpvCode; }
         auto getModule() const { return *m_ShaderModule; }
         auto getStage() const { return m_Stage; }
@@ -0,0 +1,107 @@
+#pragma once
+
+#include "vulkaninja/array_proxy.hpp"
+#include "vulkaninja/context.hpp"
+
+#include <string>
+#include <vector>
+
+namespace vulkaninja
+{
+    enum class ShaderRecordRegion
+    {
+        eMiss,
+        eHit,
+        eCallable,
+    };
+
+    // Handle of a group followed by inline data, read in shaders through `shaderRecordEXT`
+    struct ShaderRecord
+    {
+        // Index among the groups of the region, e.g. in RayTracingPipelineCreateInfo::hitGroups
+        uint32_t group = 0;
+
+        // Inline data of the region's data size, e.g. a material index. nullptr writes zeros.
+        const void* data = nullptr;
+    };
+
+    struct ShaderBindingTableCreateInfo
+    {
+        RayTracingPipelineHandle pipeline;
+
+        // If empty, one record per group of the region in pipeline order
+        ArrayProxy<ShaderRecord> missRecords;
+        ArrayProxy<ShaderRecord> hitRecords;
+        ArrayProxy<ShaderRecord> callableRecords;
+
+        // Bytes of inline data per record
+        uint32_t missDataSize     = 0;
+        uint32_t hitDataSize      = 0;
+        uint32_t callableDataSize = 0;
+
+        std::string debugName;
+    };
+
+    // Raygen, miss, hit and callable regions in one device-local buffer, uploaded through staging at creation.
+    // Records can be rewritten later with setRecord() and upload(), without recreating the pipeline.
+    // NOTE: Hit records are indexed by the instance sbtOffset + the geometry index * the sbtStride of traceRayEXT,
+    // so a BottomAccel with several geometries takes consecutive records.
+    class ShaderBindingTable
+    {
+    public:
+        ShaderBindingTable(const Context& context, const ShaderBindingTableCreateInfo& createInfo);
+
+        // Rewrites a record on the CPU. It is copied by the next upload().
+        void setRecord(ShaderRecordRegion region, uint32_t index, const ShaderRecord& record);
+
+        // Copies the records written since the last upload.
+        // NOTE: Records are copied with vkCmdUpdateBuffer, so this must be recorded outside of rendering.
+        void upload(const CommandBufferHandle& commandBuffer);
+
+        auto getBuffer() const -> BufferHandle { return m_Buffer; }
+
+        auto getRaygenRegion() const -> const vk::StridedDeviceAddressRegionKHR& { return m_RaygenRegion; }
+        auto getMissRegion() const -> const vk::StridedDeviceAddressRegionKHR& { return m_MissRegion; }
+        auto getHitRegion() const -> const vk::StridedDeviceAddressRegionKHR& { return m_HitRegion; }
+        auto getCallableRegion() const -> const vk::StridedDeviceAddressRegionKHR& { return m_CallableRegion; }
+
+    private:
+        struct Region
+        {
+            uint32_t       firstGroup  = 0; // In the pipeline
+            uint32_t       groupCount  = 0;
+            uint32_t       dataSize    = 0;
+            uint32_t       recordCount = 0;
+            uint32_t       stride      = 0;
+            vk::DeviceSize offset      = 0; // In the buffer
+        };
+
+        struct DirtyRecord
+        {
+            vk::DeviceSize offset;
+            uint32_t       size;
+        };
+
+        auto getRegion(ShaderRecordRegion region) -> Region&;
+        void writeRecord(const Region& region, uint32_t index, const ShaderRecord& record);
+
+        const Context* m_Context = nullptr;
+
+        // NOTE: Copied so that the table does not depend on the lifetime of the pipeline
+        std::vector<uint8_t> m_GroupHandles;
+        uint32_t             m_HandleSize = 0;
+
+        Region m_Miss;
+        Region m_Hit;
+        Region m_Callable;
+
+        vk::StridedDeviceAddressRegionKHR m_RaygenRegion;
+        vk::StridedDeviceAddressRegionKHR m_MissRegion;
+        vk::StridedDeviceAddressRegionKHR m_HitRegion;
+        vk::StridedDeviceAddressRegionKHR m_CallableRegion;
+
+        BufferHandle             m_Buffer;
+        std::vector<uint8_t>     m_Data; // CPU copy of the whole table
+        std::vector<DirtyRecord> m_DirtyRecords;
+    };
+} // namespace vulkaninja
@@ -27,6 +27,9 @@ namespace vulkaninja
 
         vk::ImageView getCurrentImageView() const { return *m_SwapchainImageViews[m_ImageIndex]; }
 
+        // NOTE: Persistent per swapchain image so that its state is tracked across commands
+        ImageHandle getCurrentColorImage() const { return m_ColorImages[m_ImageIndex]; }
+
         vk::Semaphore getCurrentImageAcquiredSemaphore() const { return *m_ImageAcquiredSemaphores[m_InflightIndex]; }
 
         vk::Semaphore getCurrentRenderCompleteSemaphore() const { return *m_RenderCompleteSemaphores[m_InflightIndex]; }
@@ -47,6 +50,7 @@ namespace vulkaninja
         vk::UniqueSwapchainKHR           m_Swapchain;
         std::vector<vk::Image>           m_SwapchainImages;
         std::vector<vk::UniqueImageView> m_SwapchainImageViews;
+        std::vector<ImageHandle>         m_ColorImages;
 
         vk::SurfaceKHR     m_Surface;
         vk::PresentModeKHR m_PresentMode;
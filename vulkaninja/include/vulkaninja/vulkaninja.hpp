@@ -5,14 +5,22 @@
 #include <imgui.h>
 #include <imgui_impl_glfw.h>
 
+#include "vulkaninja/accel_compactor.hpp"
 #include "vulkaninja/array_proxy.hpp"
 #include "vulkaninja/command_buffer.hpp"
 #include "vulkaninja/cpu_timer.hpp"
+#include "vulkaninja/depth_pyramid.hpp"
 #include "vulkaninja/descriptor_set.hpp"
 #include "vulkaninja/fence.hpp"
+#include "vulkaninja/frame_uniform_allocator.hpp"
+#include "vulkaninja/gpu_culling.hpp"
 #include "vulkaninja/gpu_timer.hpp"
+#include "vulkaninja/mip_generator.hpp"
 #include "vulkaninja/pipeline.hpp"
+#include "vulkaninja/render_graph.hpp"
+#include "vulkaninja/semaphore.hpp"
 #include "vulkaninja/shader.hpp"
+#include "vulkaninja/shader_binding_table.hpp"
 #include "vulkaninja/shader_compiler.hpp"
 
 #include "vulkaninja/extensions/app.hpp"
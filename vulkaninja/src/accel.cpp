@@ -2,37 +2,191 @@
 
 #include "vulkaninja/command_buffer.hpp"
 #include "vulkaninja/common.hpp"
+#include "vulkaninja/pipeline.hpp"
+#include "vulkaninja/shader.hpp"
+
+#include <algorithm>
+#include <cstddef>
+#include <cstring>
+#include <iterator>
+
+namespace
+{
+    // Scatters a compact stream of transforms into VkAccelerationStructureInstanceKHR
+    const std::string transformUpdateCode = R"(
+#version 460
+#extension GL_EXT_buffer_reference : require
+
+layout(local_size_x = 64) in;
+
+struct Instance {
+    float transform[12];
+    uint  customIndexAndMask;
+    uint  sbtOffsetAndFlags;
+    uvec2 reference;
+};
+
+struct TransformUpdate {
+    uint  instanceIndex;
+    float transform[12];
+};
+
+layout(buffer_reference, std430) buffer Instances { Instance instances[]; };
+layout(buffer_reference, std430) readonly buffer TransformUpdates { TransformUpdate updates[]; };
+
+layout(push_constant) uniform PushConstants {
+    Instances        instanceBuffer;
+    TransformUpdates updateBuffer;
+    uint             updateCount;
+    uint             instanceCount;
+};
+
+void main()
+{
+    uint index = gl_GlobalInvocationID.x;
+    if (index >= updateCount) {
+        return;
+    }
+
+    uint instanceIndex = updateBuffer.updates[index].instanceIndex;
+    if (instanceIndex >= instanceCount) {
+        return;
+    }
+    for (int i = 0; i < 12; i++) {
+        instanceBuffer.instances[instanceIndex].transform[i] = updateBuffer.updates[index].transform[i];
+    }
+}
+)";
+
+    struct TransformUpdatePushConstants
+    {
+        vk::DeviceAddress instanceBuffer;
+        vk::DeviceAddress updateBuffer;
+        uint32_t          updateCount;
+        uint32_t          instanceCount;
+    };
+
+    auto toVkInstance(const vulkaninja::AccelInstance& instance) -> vk::AccelerationStructureInstanceKHR
+    {
+        vk::AccelerationStructureInstanceKHR inst;
+        inst.setTransform(vulkaninja::toVkMatrix(instance.transform));
+        inst.setInstanceCustomIndex(instance.customIndex);
+        inst.setMask(0xFF);
+        inst.setInstanceShaderBindingTableRecordOffset(instance.sbtOffset);
+        inst.setFlags(vk::GeometryInstanceFlagBitsKHR::eTriangleFacingCullDisable);
+        inst.setAccelerationStructureReference(instance.bottomAccel->getBufferAddress());
+        return inst;
+    }
+} // namespace
 
 namespace vulkaninja
 {
+    auto isAccelVertexFormatSupported(const Context& context, vk::Format format) -> bool
+    {
+        vk::FormatProperties formatProps = context.getPhysicalDevice().getFormatProperties(format);
+        return static_cast<bool>(formatProps.bufferFeatures &
+                                 vk::FormatFeatureFlagBits::eAccelerationStructureVertexBufferKHR);
+    }
+
+    auto chooseAccelVertexFormat(const Context& context, ArrayProxy<vk::Format> candidates) -> vk::Format
+    {
+        for (vk::Format format : candidates)
+        {
+            if (isAccelVertexFormatSupported(context, format))
+            {
+                return format;
+            }
+        }
+        return vk::Format::eR32G32B32Sfloat;
+    }
+
     BottomAccel::BottomAccel(const Context& context, const BottomAccelCreateInfo& createInfo) :
-        m_Context {&context}, m_GeometryFlags {createInfo.geometryFlags}, m_BuildFlags {createInfo.buildFlags},
-        m_BuildType {createInfo.buildType}
+        m_Context {&context}, m_BuildFlags {createInfo.buildFlags}, m_BuildType {createInfo.buildType}
     {
-        m_TrianglesData.setVertexFormat(vk::Format::eR32G32B32Sfloat);
-        m_TrianglesData.setVertexData(createInfo.vertexBuffer->getAddress());
-        m_TrianglesData.setVertexStride(createInfo.vertexStride);
-        m_TrianglesData.setMaxVertex(createInfo.maxVertexCount);
-        m_TrianglesData.setIndexType(vk::IndexTypeValue<uint32_t>::value);
-        m_TrianglesData.setIndexData(createInfo.indexBuffer->getAddress());
+        if (createInfo.compact)
+        {
+            m_BuildFlags |= vk::BuildAccelerationStructureFlagBitsKHR::eAllowCompaction;
+        }
 
-        vk::AccelerationStructureGeometryDataKHR geometryData;
-        geometryData.setTriangles(m_TrianglesData);
+        VKN_ASSERT(createInfo.geometries.empty() || createInfo.aabbGeometries.empty(),
+                   "A BottomAccel cannot mix triangle and AABB geometries.");
 
-        vk::AccelerationStructureGeometryKHR geometry;
-        geometry.setGeometryType(vk::GeometryTypeKHR::eTriangles);
-        geometry.setGeometry({geometryData});
-        geometry.setFlags(m_GeometryFlags);
+        std::vector<AccelGeometry> accelGeometries(createInfo.geometries.begin(), createInfo.geometries.end());
+        if (accelGeometries.empty() && createInfo.aabbGeometries.empty())
+        {
+            accelGeometries.push_back({
+                .vertexBuffer     = createInfo.vertexBuffer,
+                .indexBuffer      = createInfo.indexBuffer,
+                .vertexStride     = createInfo.vertexStride,
+                .maxVertexCount   = createInfo.maxVertexCount,
+                .maxTriangleCount = createInfo.maxTriangleCount,
+                .triangleCount    = createInfo.triangleCount,
+                .geometryFlags    = createInfo.geometryFlags,
+            });
+        }
+
+        std::vector<uint32_t> maxPrimitiveCounts;
+        for (const auto& accelGeometry : accelGeometries)
+        {
+            VKN_ASSERT(isAccelVertexFormatSupported(context, accelGeometry.vertexFormat),
+                       "Vertex format {} is not supported by acceleration structures.",
+                       vk::to_string(accelGeometry.vertexFormat));
+
+            Geometry geometry;
+            geometry.triangles.setVertexFormat(accelGeometry.vertexFormat);
+            geometry.triangles.setVertexData(accelGeometry.vertexBuffer->getAddress() + accelGeometry.vertexOffset);
+            geometry.triangles.setVertexStride(accelGeometry.vertexStride);
+            geometry.triangles.setMaxVertex(accelGeometry.maxVertexCount);
+            geometry.triangles.setIndexType(accelGeometry.indexType);
+            geometry.triangles.setIndexData(accelGeometry.indexBuffer->getAddress() + accelGeometry.indexOffset);
+            if (accelGeometry.transformBuffer)
+            {
+                vk::DeviceAddress transformAddress =
+                    accelGeometry.transformBuffer->getAddress() + accelGeometry.transformOffset;
+                VKN_ASSERT(transformAddress % 16 == 0, "Transform address must be aligned to 16 bytes.");
+                geometry.triangles.setTransformData(transformAddress);
+            }
+            geometry.flags              = accelGeometry.geometryFlags;
+            geometry.vertexBuffer       = accelGeometry.vertexBuffer;
+            geometry.indexBuffer        = accelGeometry.indexBuffer;
+            geometry.transformBuffer    = accelGeometry.transformBuffer;
+            geometry.vertexOffset       = accelGeometry.vertexOffset;
+            geometry.indexOffset        = accelGeometry.indexOffset;
+            geometry.maxPrimitiveCount  = accelGeometry.maxTriangleCount;
+            geometry.lastPrimitiveCount = accelGeometry.triangleCount;
+            geometry.primitiveCount     = accelGeometry.triangleCount;
+            m_Geometries.push_back(geometry);
+            maxPrimitiveCounts.push_back(geometry.maxPrimitiveCount);
+        }
+
+        for (const auto& accelGeometry : createInfo.aabbGeometries)
+        {
+            VKN_ASSERT(accelGeometry.offset % 8 == 0 && accelGeometry.stride % 8 == 0,
+                       "AABB offset and stride must be multiples of 8.");
+
+            Geometry geometry;
+            geometry.type = vk::GeometryTypeKHR::eAabbs;
+            geometry.aabbs.setData(accelGeometry.aabbBuffer->getAddress() + accelGeometry.offset);
+            geometry.aabbs.setStride(accelGeometry.stride);
+            geometry.flags              = accelGeometry.geometryFlags;
+            geometry.aabbBuffer         = accelGeometry.aabbBuffer;
+            geometry.aabbOffset         = accelGeometry.offset;
+            geometry.maxPrimitiveCount  = accelGeometry.maxAabbCount;
+            geometry.lastPrimitiveCount = accelGeometry.aabbCount;
+            geometry.primitiveCount     = accelGeometry.aabbCount;
+            m_Geometries.push_back(geometry);
+            maxPrimitiveCounts.push_back(geometry.maxPrimitiveCount);
+        }
+
+        std::vector<vk::AccelerationStructureGeometryKHR> geometries = getGeometries();
 
         vk::AccelerationStructureBuildGeometryInfoKHR buildGeometryInfo;
         buildGeometryInfo.setType(vk::AccelerationStructureTypeKHR::eBottomLevel);
         buildGeometryInfo.setFlags(m_BuildFlags);
-        buildGeometryInfo.setGeometries(geometry);
+        buildGeometryInfo.setGeometries(geometries);
 
-        m_PrimitiveCount    = createInfo.triangleCount;
-        m_MaxPrimitiveCount = createInfo.maxTriangleCount;
         auto buildSizesInfo = m_Context->getDevice().getAccelerationStructureBuildSizesKHR(
-            m_BuildType, buildGeometryInfo, m_MaxPrimitiveCount);
+            m_BuildType, buildGeometryInfo, maxPrimitiveCounts);
 
         m_Buffer = m_Context->createBuffer({
             .usage  = BufferUsage::AccelStorage,
@@ -46,37 +200,46 @@ namespace vulkaninja
                 .setSize(buildSizesInfo.accelerationStructureSize)
                 .setType(vk::AccelerationStructureTypeKHR::eBottomLevel));
 
-        m_ScratchBuffer = m_Context->createBuffer({
-            .usage  = BufferUsage::Scratch,
-            .memory = MemoryUsage::Host,
-            .size   = buildSizesInfo.buildScratchSize,
-        });
+        // NOTE: Scratch is borrowed from the Context by the command buffer of each build
+        m_ScratchSize       = buildSizesInfo.buildScratchSize;
+        m_UpdateScratchSize = buildSizesInfo.updateScratchSize;
     }
 
     TopAccel::TopAccel(const Context& context, const TopAccelCreateInfo& createInfo) :
         m_Context {&context}, m_GeometryFlags {createInfo.geometryFlags}, m_BuildFlags {createInfo.buildFlags},
         m_BuildType {createInfo.buildType}
     {
-        std::vector<vk::AccelerationStructureInstanceKHR> instances;
         for (const auto& instance : createInfo.accelInstances)
         {
-            vk::AccelerationStructureInstanceKHR inst;
-            inst.setTransform(toVkMatrix(instance.transform));
-            inst.setInstanceCustomIndex(instance.customIndex);
-            inst.setMask(0xFF);
-            inst.setInstanceShaderBindingTableRecordOffset(instance.sbtOffset);
-            inst.setFlags(vk::GeometryInstanceFlagBitsKHR::eTriangleFacingCullDisable);
-            inst.setAccelerationStructureReference(instance.bottomAccel->getBufferAddress());
-            instances.push_back(inst);
+            m_Instances.push_back(toVkInstance(instance));
+            m_BottomAccels.push_back(instance.bottomAccel);
         }
 
-        m_PrimitiveCount = static_cast<uint32_t>(instances.size());
-        m_InstanceBuffer = m_Context->createBuffer({
+        // NOTE: Uploaded through a staging buffer by the first build
+        VKN_ASSERT(createInfo.frameCount > 0, "frameCount must be greater than 0.");
+        m_StagingFrames.resize(createInfo.frameCount);
+        m_PrimitiveCount = static_cast<uint32_t>(m_Instances.size());
+        allocate(std::max({createInfo.maxInstanceCount, m_PrimitiveCount, 1u}));
+
+        if (createInfo.transformUpdates)
+        {
+            m_TransformShader =
+                Shader::createComputeShader(*m_Context, transformUpdateCode, "TopAccel::transformUpdate.comp");
+            m_TransformPipeline = m_Context->createComputePipeline({
+                .pushSize      = sizeof(TransformUpdatePushConstants),
+                .computeShader = m_TransformShader,
+            });
+        }
+    }
+
+    void TopAccel::allocate(uint32_t maxInstanceCount)
+    {
+        m_MaxInstanceCount = maxInstanceCount;
+        m_InstanceBuffer   = m_Context->createBuffer({
             .usage  = BufferUsage::AccelInput,
-            .memory = MemoryUsage::DeviceHost,
-            .size   = sizeof(vk::AccelerationStructureInstanceKHR) * instances.size(),
+            .memory = MemoryUsage::Device,
+            .size   = sizeof(vk::AccelerationStructureInstanceKHR) * m_MaxInstanceCount,
         });
-        m_InstanceBuffer->copy(instances.data());
 
         m_InstancesData.setArrayOfPointers(false);
         m_InstancesData.setData(m_InstanceBuffer->getAddress());
@@ -91,8 +254,9 @@ namespace vulkaninja
         buildGeometryInfo.setFlags(m_BuildFlags);
         buildGeometryInfo.setGeometries(geometry);
 
+        // NOTE: Sized for the capacity, so builds with fewer instances reuse the allocation
         auto buildSizesInfo = m_Context->getDevice().getAccelerationStructureBuildSizesKHR(
-            m_BuildType, buildGeometryInfo, static_cast<uint32_t>(instances.size()));
+            m_BuildType, buildGeometryInfo, m_MaxInstanceCount);
 
         m_Buffer = m_Context->createBuffer({
             .usage  = BufferUsage::AccelStorage,
@@ -106,44 +270,203 @@ namespace vulkaninja
                 .setSize(buildSizesInfo.accelerationStructureSize)
                 .setType(vk::AccelerationStructureTypeKHR::eTopLevel));
 
-        m_ScratchBuffer = m_Context->createBuffer({
-            .usage  = BufferUsage::Scratch,
-            .memory = MemoryUsage::Device,
-            .size   = buildSizesInfo.buildScratchSize,
-        });
+        m_ScratchSize       = buildSizesInfo.buildScratchSize;
+        m_UpdateScratchSize = buildSizesInfo.updateScratchSize;
+    }
+
+    auto BottomAccel::getGeometries() const -> std::vector<vk::AccelerationStructureGeometryKHR>
+    {
+        std::vector<vk::AccelerationStructureGeometryKHR> geometries;
+        for (const auto& geometry : m_Geometries)
+        {
+            vk::AccelerationStructureGeometryDataKHR geometryData;
+            if (geometry.type == vk::GeometryTypeKHR::eAabbs)
+            {
+                geometryData.setAabbs(geometry.aabbs);
+            }
+            else
+            {
+                geometryData.setTriangles(geometry.triangles);
+            }
+
+            geometries.push_back(vk::AccelerationStructureGeometryKHR {}
+                                     .setGeometryType(geometry.type)
+                                     .setGeometry(geometryData)
+                                     .setFlags(geometry.flags));
+        }
+        return geometries;
+    }
+
+    auto BottomAccel::getBuildRanges() const -> std::vector<vk::AccelerationStructureBuildRangeInfoKHR>
+    {
+        std::vector<vk::AccelerationStructureBuildRangeInfoKHR> buildRanges;
+        for (const auto& geometry : m_Geometries)
+        {
+            vk::AccelerationStructureBuildRangeInfoKHR buildRange {};
+            buildRange.setPrimitiveCount(geometry.primitiveCount);
+            buildRanges.push_back(buildRange);
+        }
+        return buildRanges;
     }
 
     void BottomAccel::update(const BufferHandle& vertexBuffer, const BufferHandle& indexBuffer, uint32_t triangleCount)
     {
-        assert(triangleCount <= m_MaxPrimitiveCount);
+        updateGeometry(0, vertexBuffer, indexBuffer, triangleCount);
+    }
+
+    void BottomAccel::updateGeometry(uint32_t            geometryIndex,
+                                     const BufferHandle& vertexBuffer,
+                                     const BufferHandle& indexBuffer,
+                                     uint32_t            triangleCount)
+    {
+        Geometry& geometry = m_Geometries[geometryIndex];
+        assert(geometry.type == vk::GeometryTypeKHR::eTriangles);
+        assert(triangleCount <= geometry.maxPrimitiveCount);
 
-        m_TrianglesData.setVertexData(vertexBuffer->getAddress());
-        m_TrianglesData.setIndexData(indexBuffer->getAddress());
-        m_LastPrimitiveCount = m_PrimitiveCount;
-        m_PrimitiveCount     = triangleCount;
+        geometry.triangles.setVertexData(vertexBuffer->getAddress() + geometry.vertexOffset);
+        geometry.triangles.setIndexData(indexBuffer->getAddress() + geometry.indexOffset);
+        geometry.vertexBuffer       = vertexBuffer;
+        geometry.indexBuffer        = indexBuffer;
+        geometry.lastPrimitiveCount = geometry.primitiveCount;
+        geometry.primitiveCount     = triangleCount;
     }
 
-    void TopAccel::updateInstances(ArrayProxy<AccelInstance> accelInstances) const
+    void BottomAccel::updateAabbGeometry(uint32_t geometryIndex, const BufferHandle& aabbBuffer, uint32_t aabbCount)
     {
-        VKN_ASSERT(m_PrimitiveCount == accelInstances.size(),
-                   "Instance count was changed. {} == {}",
-                   m_PrimitiveCount,
-                   accelInstances.size());
+        Geometry& geometry = m_Geometries[geometryIndex];
+        assert(geometry.type == vk::GeometryTypeKHR::eAabbs);
+        assert(aabbCount <= geometry.maxPrimitiveCount);
+
+        geometry.aabbs.setData(aabbBuffer->getAddress() + geometry.aabbOffset);
+        geometry.aabbBuffer         = aabbBuffer;
+        geometry.lastPrimitiveCount = geometry.primitiveCount;
+        geometry.primitiveCount     = aabbCount;
+    }
+
+    bool BottomAccel::shouldRebuild() const
+    {
+        return std::ranges::any_of(m_Geometries, [](const Geometry& geometry) {
+            return geometry.lastPrimitiveCount != geometry.primitiveCount;
+        });
+    }
 
-        std::vector<vk::AccelerationStructureInstanceKHR> instances;
+    void TopAccel::updateInstances(ArrayProxy<AccelInstance> accelInstances)
+    {
+        m_Instances.clear();
+        m_BottomAccels.clear();
         for (const auto& instance : accelInstances)
         {
-            vk::AccelerationStructureInstanceKHR inst;
-            inst.setTransform(toVkMatrix(instance.transform));
-            inst.setInstanceCustomIndex(instance.customIndex);
-            inst.setMask(0xFF);
-            inst.setInstanceShaderBindingTableRecordOffset(instance.sbtOffset);
-            inst.setFlags(vk::GeometryInstanceFlagBitsKHR::eTriangleFacingCullDisable);
-            inst.setAccelerationStructureReference(instance.bottomAccel->getBufferAddress());
-            instances.push_back(inst);
+            m_Instances.push_back(toVkInstance(instance));
+            m_BottomAccels.push_back(instance.bottomAccel);
+        }
+        m_PrimitiveCount = static_cast<uint32_t>(accelInstances.size());
+        m_InstancesDirty = true;
+    }
+
+    void TopAccel::beginFrame(uint32_t frameIndex)
+    {
+        m_FrameIndex                         = frameIndex % static_cast<uint32_t>(m_StagingFrames.size());
+        m_StagingFrames[m_FrameIndex].isUsed = false;
+    }
+
+    void TopAccel::uploadInstances(const CommandBuffer& commandBuffer)
+    {
+        if (m_PrimitiveCount > m_MaxInstanceCount)
+        {
+            // NOTE: Earlier frames may still trace the old structure,
+            // so it lives until the command buffer is recorded again.
+            commandBuffer.keepAlive(std::make_shared<vk::UniqueAccelerationStructureKHR>(std::move(m_Accel)));
+            commandBuffer.keepAlive(m_Buffer);
+            commandBuffer.keepAlive(m_InstanceBuffer);
+            for (auto& frame : m_StagingFrames)
+            {
+                // Smaller than the new capacity, and possibly still read by frames in flight
+                commandBuffer.keepAlive(std::move(frame.buffer));
+                frame.buffer = nullptr;
+            }
+            allocate(std::max(m_PrimitiveCount, m_MaxInstanceCount * 2));
+            m_BuiltPrimitiveCount = UINT32_MAX;
+            m_Generation++;
+        }
+
+        std::vector<uint32_t> movedInstances;
+        for (uint32_t i = 0; i < m_PrimitiveCount; i++)
+        {
+            uint64_t reference = m_BottomAccels[i]->getBufferAddress();
+            if (m_Instances[i].accelerationStructureReference != reference)
+            {
+                m_Instances[i].setAccelerationStructureReference(reference);
+                movedInstances.push_back(i);
+            }
         }
 
-        // TODO: use CommandBuffer::copy()
-        m_InstanceBuffer->copy(instances.data());
+        if (m_InstancesDirty)
+        {
+            // Instances past the count are not read by builds
+            vk::DeviceSize size = sizeof(vk::AccelerationStructureInstanceKHR) * m_PrimitiveCount;
+            if (size > 0)
+            {
+                // NOTE: The staging buffer of this frame is rewritten only after beginFrame() comes back to it,
+                // so frames in flight never see it change. The copy recorded earlier in this frame has not run yet,
+                // so a second upload takes a temporary buffer instead.
+                StagingFrame& frame         = m_StagingFrames[m_FrameIndex];
+                BufferHandle  stagingBuffer = frame.isUsed ? nullptr : frame.buffer;
+                if (!stagingBuffer)
+                {
+                    stagingBuffer = m_Context->createBuffer({
+                        .usage  = BufferUsage::Staging,
+                        .memory = MemoryUsage::Host,
+                        .size   = m_InstanceBuffer->getSize(),
+                    });
+                    if (frame.isUsed)
+                    {
+                        commandBuffer.keepAlive(stagingBuffer);
+                    }
+                    else
+                    {
+                        frame.buffer = stagingBuffer;
+                    }
+                }
+                frame.isUsed = true;
+                std::memcpy(stagingBuffer->map(), m_Instances.data(), size);
+                commandBuffer.copyBuffer(stagingBuffer, m_InstanceBuffer, size);
+            }
+            m_InstancesDirty = false;
+            return;
+        }
+
+        // NOTE: Only the references are patched, so that transforms written on the GPU are kept
+        for (uint32_t i : movedInstances)
+        {
+            vk::DeviceSize offset = sizeof(vk::AccelerationStructureInstanceKHR) * i +
+                                    offsetof(VkAccelerationStructureInstanceKHR, accelerationStructureReference);
+            commandBuffer.updateBuffer(
+                m_InstanceBuffer, offset, sizeof(uint64_t), &m_Instances[i].accelerationStructureReference);
+        }
+    }
+
+    void TopAccel::updateTransforms(const CommandBuffer& commandBuffer,
+                                    vk::DeviceAddress    transformUpdates,
+                                    uint32_t             updateCount)
+    {
+        VKN_ASSERT(m_TransformPipeline, "TopAccel must be created with transformUpdates = true.");
+        if (updateCount == 0)
+        {
+            return;
+        }
+
+        // NOTE: Instances written by the CPU are uploaded first so that they do not overwrite these transforms
+        uploadInstances(commandBuffer);
+        commandBuffer.declareUsage(m_InstanceBuffer, ResourceUsage::eShaderReadWrite);
+
+        TransformUpdatePushConstants pushConstants {
+            .instanceBuffer = m_InstanceBuffer->getAddress(),
+            .updateBuffer   = transformUpdates,
+            .updateCount    = updateCount,
+            .instanceCount  = m_PrimitiveCount,
+        };
+        commandBuffer.bindPipeline(m_TransformPipeline);
+        commandBuffer.pushConstants(m_TransformPipeline, &pushConstants);
+        commandBuffer.dispatch((updateCount + 63) / 64, 1, 1);
     }
 } // namespace vulkaninja
\ No newline at end of file
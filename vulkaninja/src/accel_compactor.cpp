@@ -0,0 +1,119 @@
+#include "vulkaninja/accel_compactor.hpp"
+#include "vulkaninja/accel.hpp"
+#include "vulkaninja/command_buffer.hpp"
+#include "vulkaninja/common.hpp"
+
+#include <algorithm>
+
+namespace vulkaninja
+{
+    AccelCompactor::AccelCompactor(const Context& context, const AccelCompactorCreateInfo& createInfo) :
+        m_Context {&context}, m_RetiredAccels(createInfo.frameCount), m_DebugName {createInfo.debugName}
+    {
+        VKN_ASSERT(createInfo.frameCount > 0, "frameCount must be greater than 0.");
+    }
+
+    void AccelCompactor::beginFrame(uint32_t frameIndex)
+    {
+        m_FrameIndex = frameIndex % static_cast<uint32_t>(m_RetiredAccels.size());
+        m_RetiredAccels[m_FrameIndex].clear();
+    }
+
+    void AccelCompactor::query(const CommandBufferHandle& commandBuffer, ArrayProxy<BottomAccelHandle> bottomAccels)
+    {
+        if (bottomAccels.empty())
+        {
+            return;
+        }
+
+        // The compacted sizes are written once the builds are done
+        std::vector<vk::AccelerationStructureKHR> accels;
+        for (const auto& bottomAccel : bottomAccels)
+        {
+            VKN_ASSERT(bottomAccel->m_BuildFlags & vk::BuildAccelerationStructureFlagBitsKHR::eAllowCompaction,
+                       "BottomAccels must be created with compact = true.");
+            commandBuffer->declareUsage(bottomAccel->m_Buffer, ResourceUsage::eAccelBuildSource);
+            accels.push_back(*bottomAccel->m_Accel);
+        }
+        commandBuffer->flushBarriers();
+
+        vk::QueryPoolCreateInfo queryPoolInfo;
+        queryPoolInfo.setQueryType(vk::QueryType::eAccelerationStructureCompactedSizeKHR);
+        queryPoolInfo.setQueryCount(bottomAccels.size());
+
+        Query query;
+        query.queryPool = m_Context->getDevice().createQueryPoolUnique(queryPoolInfo);
+        query.bottomAccels.assign(bottomAccels.begin(), bottomAccels.end());
+
+        commandBuffer->commandBuffer->resetQueryPool(*query.queryPool, 0, bottomAccels.size());
+        commandBuffer->commandBuffer->writeAccelerationStructuresPropertiesKHR(
+            accels, vk::QueryType::eAccelerationStructureCompactedSizeKHR, *query.queryPool, 0);
+
+        m_Queries.push_back(std::move(query));
+    }
+
+    auto AccelCompactor::compact(const CommandBufferHandle& commandBuffer) -> uint32_t
+    {
+        uint32_t                    compactedCount = 0;
+        std::vector<vk::DeviceSize> compactedSizes;
+        std::erase_if(m_Queries, [&](Query& query) {
+            // NOTE: Without eWait, eNotReady is returned until the command buffer of the query has completed
+            auto count = static_cast<uint32_t>(query.bottomAccels.size());
+            compactedSizes.assign(count, 0);
+            vk::Result result = m_Context->getDevice().getQueryPoolResults(*query.queryPool,
+                                                                           0,
+                                                                           count,
+                                                                           count * sizeof(vk::DeviceSize), // dataSize
+                                                                           compactedSizes.data(),          // pData
+                                                                           sizeof(vk::DeviceSize),         // stride
+                                                                           vk::QueryResultFlagBits::e64);
+            if (result == vk::Result::eNotReady)
+            {
+                return false;
+            }
+            if (result != vk::Result::eSuccess)
+            {
+                throw std::runtime_error("Failed to get compacted sizes of acceleration structures");
+            }
+
+            for (uint32_t i = 0; i < count; i++)
+            {
+                BottomAccel& bottomAccel = *query.bottomAccels[i];
+
+                BufferHandle buffer = m_Context->createBuffer({
+                    .usage     = BufferUsage::AccelStorage,
+                    .memory    = MemoryUsage::Device,
+                    .size      = compactedSizes[i],
+                    .debugName = m_DebugName + "::compactedBuffer",
+                });
+                vk::UniqueAccelerationStructureKHR accel = m_Context->getDevice().createAccelerationStructureKHRUnique(
+                    vk::AccelerationStructureCreateInfoKHR {}
+                        .setBuffer(buffer->getBuffer())
+                        .setSize(compactedSizes[i])
+                        .setType(vk::AccelerationStructureTypeKHR::eBottomLevel));
+
+                // Orders the copy after the build, or a later update, of the source
+                commandBuffer->declareUsage(bottomAccel.m_Buffer, ResourceUsage::eAccelBuildSource);
+                commandBuffer->declareUsage(buffer, ResourceUsage::eAccelBuild);
+                commandBuffer->flushBarriers();
+
+                vk::CopyAccelerationStructureInfoKHR copyInfo;
+                copyInfo.setSrc(*bottomAccel.m_Accel);
+                copyInfo.setDst(*accel);
+                copyInfo.setMode(vk::CopyAccelerationStructureModeKHR::eCompact);
+                commandBuffer->commandBuffer->copyAccelerationStructureKHR(copyInfo);
+
+                // NOTE: The source is read by the copy, so it is released with this frame
+                m_RetiredAccels[m_FrameIndex].push_back({std::move(bottomAccel.m_Accel), bottomAccel.m_Buffer});
+                bottomAccel.m_Accel     = std::move(accel);
+                bottomAccel.m_Buffer    = buffer;
+                bottomAccel.m_Compacted = true;
+            }
+            compactedCount += count;
+            return true;
+        });
+
+        // NOTE: Later builds of TopAccels declare the compacted buffers, which orders them after the copies
+        return compactedCount;
+    }
+} // namespace vulkaninja
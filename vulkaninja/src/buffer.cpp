@@ -12,6 +12,13 @@ namespace vulkaninja
         vk::BufferCreateInfo bufferInfo;
         bufferInfo.setSize(m_Size);
         bufferInfo.setUsage(createInfo.usage);
+
+        std::vector<uint32_t> queueFamilies = m_Context->getQueueFamilies();
+        if (createInfo.concurrent && queueFamilies.size() > 1)
+        {
+            bufferInfo.setSharingMode(vk::SharingMode::eConcurrent);
+            bufferInfo.setQueueFamilyIndices(queueFamilies);
+        }
         m_Buffer = m_Context->getDevice().createBufferUnique(bufferInfo);
 
         // Allocate memory
@@ -3,32 +3,182 @@
 #include "vulkaninja/buffer.hpp"
 #include "vulkaninja/common.hpp"
 #include "vulkaninja/context.hpp"
+#include "vulkaninja/depth_pyramid.hpp"
 #include "vulkaninja/descriptor_set.hpp"
 #include "vulkaninja/gpu_timer.hpp"
 #include "vulkaninja/image.hpp"
 #include "vulkaninja/pipeline.hpp"
+#include "vulkaninja/shader_binding_table.hpp"
+
+#include <algorithm>
+#include <iterator>
+
+namespace
+{
+    auto getBindPointIndex(vk::PipelineBindPoint bindPoint) -> uint32_t
+    {
+        switch (bindPoint)
+        {
+            case vk::PipelineBindPoint::eGraphics:
+                return 0;
+            case vk::PipelineBindPoint::eCompute:
+                return 1;
+            default:
+                return 2;
+        }
+    }
+
+    auto alignUp(vk::DeviceSize size, vk::DeviceSize alignment) -> vk::DeviceSize
+    {
+        return (size + alignment - 1) & ~(alignment - 1);
+    }
+
+    // Stages and access that a compute or transfer queue can use.
+    // NOTE: Declared usages cover every shader stage, e.g. eShaderRead, so barriers are masked on those queues.
+    constexpr vk::PipelineStageFlags2 ComputeQueueStages =
+        vk::PipelineStageFlagBits2::eTopOfPipe | vk::PipelineStageFlagBits2::eBottomOfPipe |
+        vk::PipelineStageFlagBits2::eDrawIndirect | vk::PipelineStageFlagBits2::eComputeShader |
+        vk::PipelineStageFlagBits2::eAllTransfer | vk::PipelineStageFlagBits2::eCopy |
+        vk::PipelineStageFlagBits2::eClear | vk::PipelineStageFlagBits2::eHost |
+        vk::PipelineStageFlagBits2::eAllCommands | vk::PipelineStageFlagBits2::eAccelerationStructureBuildKHR |
+        vk::PipelineStageFlagBits2::eRayTracingShaderKHR;
+
+    constexpr vk::PipelineStageFlags2 TransferQueueStages =
+        vk::PipelineStageFlagBits2::eTopOfPipe | vk::PipelineStageFlagBits2::eBottomOfPipe |
+        vk::PipelineStageFlagBits2::eAllTransfer | vk::PipelineStageFlagBits2::eCopy |
+        vk::PipelineStageFlagBits2::eHost | vk::PipelineStageFlagBits2::eAllCommands;
+
+    constexpr vk::AccessFlags2 GraphicsOnlyAccess =
+        vk::AccessFlagBits2::eIndexRead | vk::AccessFlagBits2::eVertexAttributeRead |
+        vk::AccessFlagBits2::eInputAttachmentRead | vk::AccessFlagBits2::eColorAttachmentRead |
+        vk::AccessFlagBits2::eColorAttachmentWrite | vk::AccessFlagBits2::eDepthStencilAttachmentRead |
+        vk::AccessFlagBits2::eDepthStencilAttachmentWrite;
+
+    template<typename Barrier>
+    void maskBarrier(Barrier& barrier, vk::PipelineStageFlags2 stages)
+    {
+        barrier.srcStageMask &= stages;
+        barrier.dstStageMask &= stages;
+        barrier.srcAccessMask &= ~GraphicsOnlyAccess;
+        barrier.dstAccessMask &= ~GraphicsOnlyAccess;
+    }
+} // namespace
 
 namespace vulkaninja
 {
+    CommandBuffer::~CommandBuffer()
+    {
+        if (context)
+        {
+            context->releaseScratchBuffers(m_ScratchBuffers);
+        }
+    }
+
     auto CommandBuffer::getQueueFlags() const -> vk::QueueFlags { return queueFlags; }
 
+    auto CommandBuffer::allocateScratch(vk::DeviceSize size) const -> vk::DeviceAddress
+    {
+        vk::DeviceSize alignment = context->getAccelScratchAlignment();
+        if (!m_ScratchBuffers.empty())
+        {
+            const BufferHandle& scratchBuffer = m_ScratchBuffers.back();
+            vk::DeviceAddress   address       = alignUp(scratchBuffer->getAddress() + m_ScratchOffset, alignment);
+            if (address + size <= scratchBuffer->getAddress() + scratchBuffer->getSize())
+            {
+                m_ScratchOffset = address + size - scratchBuffer->getAddress();
+                return address;
+            }
+        }
+
+        // NOTE: Padded so that the aligned address still fits
+        m_ScratchBuffers.push_back(context->acquireScratchBuffer(size + alignment));
+        vk::DeviceAddress address = alignUp(m_ScratchBuffers.back()->getAddress(), alignment);
+        m_ScratchOffset           = address + size - m_ScratchBuffers.back()->getAddress();
+        return address;
+    }
+
     void CommandBuffer::begin(vk::CommandBufferUsageFlags flags) const
     {
         vk::CommandBufferBeginInfo beginInfo;
         beginInfo.setFlags(flags);
         commandBuffer->begin(beginInfo);
+
+        m_ImageBarriers.clear();
+        m_BufferBarriers.clear();
+        m_IsRendering = false;
+
+        // NOTE: The previous recording has completed, so its scratch can be reused by other command buffers
+        context->releaseScratchBuffers(m_ScratchBuffers);
+        m_ScratchOffset = 0;
+        m_RetainedResources.clear();
+
+        invalidateState();
+        m_ElidedCallCounts = {};
     }
 
-    void CommandBuffer::end() const { commandBuffer->end(); }
+    void CommandBuffer::end() const
+    {
+        flushBarriers();
+        commandBuffer->end();
+    }
 
-    void CommandBuffer::bindDescriptorSet(PipelineHandle pipeline, DescriptorSetHandle descSet) const
+    void CommandBuffer::bindDescriptorSet(PipelineHandle       pipeline,
+                                          DescriptorSetHandle  descSet,
+                                          uint32_t             set,
+                                          ArrayProxy<uint32_t> dynamicOffsets) const
     {
+        bindDescriptorSet(pipeline, descSet->getDescriptorSet(set), set, dynamicOffsets);
+    }
+
+    void CommandBuffer::bindDescriptorSet(PipelineHandle       pipeline,
+                                          vk::DescriptorSet    descSet,
+                                          uint32_t             set,
+                                          ArrayProxy<uint32_t> dynamicOffsets) const
+    {
+        BoundDescriptorSets& bound =
+            getBoundDescriptorSets(pipeline->getPipelineBindPoint(), pipeline->getPipelineLayout(), set);
+        if (bound.descSets[set] == descSet && std::ranges::equal(bound.dynamicOffsets[set], dynamicOffsets))
+        {
+            m_ElidedCallCounts.descriptorSets++;
+            return;
+        }
+        bound.descSets[set]       = descSet;
+        bound.dynamicOffsets[set] = {dynamicOffsets.begin(), dynamicOffsets.end()};
+
         commandBuffer->bindDescriptorSets(
-            pipeline->getPipelineBindPoint(), pipeline->getPipelineLayout(), 0, descSet->getDescriptorSet(), nullptr);
+            pipeline->getPipelineBindPoint(), pipeline->getPipelineLayout(), set, descSet, dynamicOffsets);
+    }
+
+    void CommandBuffer::pushDescriptorSet(PipelineHandle                     pipeline,
+                                          ArrayProxy<vk::WriteDescriptorSet> writes,
+                                          uint32_t                           set) const
+    {
+        // NOTE: Pushed descriptors replace whatever was bound to the set
+        getBoundDescriptorSets(pipeline->getPipelineBindPoint(), pipeline->getPipelineLayout(), set).descSets[set] =
+            nullptr;
+        commandBuffer->pushDescriptorSetKHR(
+            pipeline->getPipelineBindPoint(), pipeline->getPipelineLayout(), set, writes);
+    }
+
+    void CommandBuffer::pushDescriptorSet(PipelineHandle pipeline, DescriptorSetHandle descSet) const
+    {
+        uint32_t    set    = descSet->getPushDescriptorSet().value();
+        const auto& writes = descSet->getPushWrites();
+        getBoundDescriptorSets(pipeline->getPipelineBindPoint(), pipeline->getPipelineLayout(), set).descSets[set] =
+            nullptr;
+        commandBuffer->pushDescriptorSetKHR(
+            pipeline->getPipelineBindPoint(), pipeline->getPipelineLayout(), set, writes);
     }
 
     void CommandBuffer::bindPipeline(PipelineHandle pipeline) const
     {
+        vk::Pipeline& boundPipeline = m_BoundPipelines[getBindPointIndex(pipeline->m_BindPoint)];
+        if (boundPipeline == *pipeline->m_Pipeline)
+        {
+            m_ElidedCallCounts.pipelines++;
+            return;
+        }
+        boundPipeline = *pipeline->m_Pipeline;
         commandBuffer->bindPipeline(pipeline->m_BindPoint, *pipeline->m_Pipeline);
     }
 
@@ -40,34 +190,93 @@ namespace vulkaninja
 
     void CommandBuffer::bindVertexBuffer(BufferHandle buffer, vk::DeviceSize offset) const
     {
+        if (m_BoundVertexBuffer == buffer->getBuffer() && m_BoundVertexOffset == offset)
+        {
+            m_ElidedCallCounts.vertexBuffers++;
+            return;
+        }
+        m_BoundVertexBuffer = buffer->getBuffer();
+        m_BoundVertexOffset = offset;
         commandBuffer->bindVertexBuffers(0, buffer->getBuffer(), offset);
     }
 
     void CommandBuffer::bindIndexBuffer(BufferHandle buffer, vk::DeviceSize offset) const
     {
+        if (m_BoundIndexBuffer == buffer->getBuffer() && m_BoundIndexOffset == offset)
+        {
+            m_ElidedCallCounts.indexBuffers++;
+            return;
+        }
+        m_BoundIndexBuffer = buffer->getBuffer();
+        m_BoundIndexOffset = offset;
         commandBuffer->bindIndexBuffer(buffer->getBuffer(), offset, vk::IndexType::eUint32);
     }
 
+    void CommandBuffer::invalidateState() const
+    {
+        m_BoundPipelines      = {};
+        m_BoundDescriptorSets = {};
+        m_BoundVertexBuffer   = nullptr;
+        m_BoundIndexBuffer    = nullptr;
+        m_Viewport.reset();
+        m_Scissor.reset();
+    }
+
+    auto CommandBuffer::getBoundDescriptorSets(vk::PipelineBindPoint bindPoint,
+                                               vk::PipelineLayout    layout,
+                                               uint32_t              set) const -> BoundDescriptorSets&
+    {
+        BoundDescriptorSets& bound = m_BoundDescriptorSets[getBindPointIndex(bindPoint)];
+        if (bound.layout != layout)
+        {
+            bound.layout = layout;
+            bound.descSets.clear();
+            bound.dynamicOffsets.clear();
+        }
+        if (set >= bound.descSets.size())
+        {
+            bound.descSets.resize(set + 1);
+            bound.dynamicOffsets.resize(set + 1);
+        }
+        return bound;
+    }
+
     void
     CommandBuffer::traceRays(RayTracingPipelineHandle pipeline, uint32_t countX, uint32_t countY, uint32_t countZ) const
     {
-        commandBuffer->traceRaysKHR(
-            pipeline->m_RaygenRegion, pipeline->m_MissRegion, pipeline->m_HitRegion, {}, countX, countY, countZ);
+        VKN_ASSERT(pipeline->m_SBT, "Pipeline has no SBT. Create it with Context::createRayTracingPipeline().");
+        traceRays(pipeline->m_SBT, countX, countY, countZ);
+    }
+
+    void CommandBuffer::traceRays(ShaderBindingTableHandle sbt, uint32_t countX, uint32_t countY, uint32_t countZ) const
+    {
+        declareUsage(sbt->getBuffer(), ResourceUsage::eShaderBindingTable);
+        flushBarriers();
+        commandBuffer->traceRaysKHR(sbt->getRaygenRegion(),
+                                    sbt->getMissRegion(),
+                                    sbt->getHitRegion(),
+                                    sbt->getCallableRegion(),
+                                    countX,
+                                    countY,
+                                    countZ);
     }
 
     void CommandBuffer::dispatch(uint32_t countX, uint32_t countY, uint32_t countZ) const
     {
+        flushBarriers();
         commandBuffer->dispatch(countX, countY, countZ);
     }
 
     void CommandBuffer::dispatchIndirect(BufferHandle buffer, vk::DeviceSize offset) const
     {
+        flushBarriers();
         commandBuffer->dispatchIndirect(buffer->getBuffer(), offset);
     }
 
     void CommandBuffer::clearColorImage(ImageHandle image, std::array<float, 4> color) const
     {
-        transitionLayout(image, vk::ImageLayout::eTransferDstOptimal);
+        declareUsage(image, ResourceUsage::eClearDst);
+        flushBarriers();
         commandBuffer->clearColorImage(image->getImage(),
                                        vk::ImageLayout::eTransferDstOptimal,
                                        vk::ClearColorValue {color},
@@ -76,7 +285,8 @@ namespace vulkaninja
 
     void CommandBuffer::clearDepthStencilImage(ImageHandle image, float depth, uint32_t stencil) const
     {
-        transitionLayout(image, vk::ImageLayout::eTransferDstOptimal);
+        declareUsage(image, ResourceUsage::eClearDst);
+        flushBarriers();
         commandBuffer->clearDepthStencilImage(image->getImage(),
                                               vk::ImageLayout::eTransferDstOptimal,
                                               vk::ClearDepthStencilValue {depth, stencil},
@@ -88,6 +298,16 @@ namespace vulkaninja
                                        std::array<int32_t, 2>  offset,
                                        std::array<uint32_t, 2> extent) const
     {
+        if (colorImage)
+        {
+            declareUsage(colorImage, ResourceUsage::eColorAttachment);
+        }
+        if (depthImage)
+        {
+            declareUsage(depthImage, ResourceUsage::eDepthStencilAttachment);
+        }
+        flushBarriers();
+
         vk::RenderingInfo renderingInfo;
         renderingInfo.setRenderArea({{offset[0], offset[1]}, {extent[0], extent[1]}});
         renderingInfo.setLayerCount(1);
@@ -98,7 +318,7 @@ namespace vulkaninja
         if (colorImage)
         {
             colorAttachment.setImageView(colorImage->getView());
-            colorAttachment.setImageLayout(vk::ImageLayout::eAttachmentOptimal);
+            colorAttachment.setImageLayout(colorImage->getLayout());
             renderingInfo.setColorAttachments(colorAttachment);
         }
 
@@ -107,11 +327,12 @@ namespace vulkaninja
         if (depthImage)
         {
             depthStencilAttachment.setImageView(depthImage->getView());
-            depthStencilAttachment.setImageLayout(vk::ImageLayout::eAttachmentOptimal);
+            depthStencilAttachment.setImageLayout(depthImage->getLayout());
             renderingInfo.setPDepthAttachment(&depthStencilAttachment);
         }
 
         commandBuffer->beginRendering(renderingInfo);
+        m_IsRendering = true;
     }
 
     void CommandBuffer::beginRendering(ArrayProxy<ImageHandle> colorImages,
@@ -119,6 +340,16 @@ namespace vulkaninja
                                        std::array<int32_t, 2>  offset,
                                        std::array<uint32_t, 2> extent) const
     {
+        for (const auto& image : colorImages)
+        {
+            declareUsage(image, ResourceUsage::eColorAttachment);
+        }
+        if (depthImage)
+        {
+            declareUsage(depthImage, ResourceUsage::eDepthStencilAttachment);
+        }
+        flushBarriers();
+
         vk::RenderingInfo renderingInfo;
         renderingInfo.setRenderArea({{offset[0], offset[1]}, {extent[0], extent[1]}});
         renderingInfo.setLayerCount(1);
@@ -140,20 +371,26 @@ namespace vulkaninja
         if (depthImage)
         {
             depthStencilAttachment.setImageView(depthImage->getView());
-            depthStencilAttachment.setImageLayout(vk::ImageLayout::eAttachmentOptimal);
+            depthStencilAttachment.setImageLayout(depthImage->getLayout());
             renderingInfo.setPDepthAttachment(&depthStencilAttachment);
         }
 
         commandBuffer->beginRendering(renderingInfo);
+        m_IsRendering = true;
     }
 
-    void CommandBuffer::endRendering() const { commandBuffer->endRendering(); }
+    void CommandBuffer::endRendering() const
+    {
+        commandBuffer->endRendering();
+        m_IsRendering = false;
+    }
 
     void CommandBuffer::draw(uint32_t vertexCount,
                              uint32_t instanceCount,
                              uint32_t firstVertex,
                              uint32_t firstInstance) const
     {
+        checkDrawBarriers();
         commandBuffer->draw(vertexCount, instanceCount, firstVertex, firstInstance);
     }
 
@@ -163,17 +400,20 @@ namespace vulkaninja
                                     int32_t  vertexOffset,
                                     uint32_t firstInstance) const
     {
+        checkDrawBarriers();
         commandBuffer->drawIndexed(indexCount, instanceCount, firstIndex, vertexOffset, firstInstance);
     }
 
     void CommandBuffer::drawMeshTasks(uint32_t groupCountX, uint32_t groupCountY, uint32_t groupCountZ) const
     {
+        checkDrawBarriers();
         commandBuffer->drawMeshTasksEXT(groupCountX, groupCountY, groupCountZ);
     }
 
     void
     CommandBuffer::drawIndirect(BufferHandle buffer, vk::DeviceSize offset, uint32_t drawCount, uint32_t stride) const
     {
+        checkDrawBarriers();
         commandBuffer->drawIndirect(buffer->getBuffer(), offset, drawCount, stride);
     }
 
@@ -182,6 +422,7 @@ namespace vulkaninja
                                             uint32_t       drawCount,
                                             uint32_t       stride) const
     {
+        checkDrawBarriers();
         commandBuffer->drawIndexedIndirect(buffer->getBuffer(), offset, drawCount, stride);
     }
 
@@ -190,14 +431,52 @@ namespace vulkaninja
                                               uint32_t       drawCount,
                                               uint32_t       stride) const
     {
+        checkDrawBarriers();
         commandBuffer->drawMeshTasksIndirectEXT(buffer->getBuffer(), offset, drawCount, stride);
     }
 
+    void CommandBuffer::drawIndirectCount(BufferHandle   buffer,
+                                          vk::DeviceSize offset,
+                                          BufferHandle   countBuffer,
+                                          vk::DeviceSize countOffset,
+                                          uint32_t       maxDrawCount,
+                                          uint32_t       stride) const
+    {
+        checkDrawBarriers();
+        commandBuffer->drawIndirectCount(
+            buffer->getBuffer(), offset, countBuffer->getBuffer(), countOffset, maxDrawCount, stride);
+    }
+
+    void CommandBuffer::drawIndexedIndirectCount(BufferHandle   buffer,
+                                                 vk::DeviceSize offset,
+                                                 BufferHandle   countBuffer,
+                                                 vk::DeviceSize countOffset,
+                                                 uint32_t       maxDrawCount,
+                                                 uint32_t       stride) const
+    {
+        checkDrawBarriers();
+        commandBuffer->drawIndexedIndirectCount(
+            buffer->getBuffer(), offset, countBuffer->getBuffer(), countOffset, maxDrawCount, stride);
+    }
+
+    void CommandBuffer::drawMeshTasksIndirectCount(BufferHandle   buffer,
+                                                   vk::DeviceSize offset,
+                                                   BufferHandle   countBuffer,
+                                                   vk::DeviceSize countOffset,
+                                                   uint32_t       maxDrawCount,
+                                                   uint32_t       stride) const
+    {
+        checkDrawBarriers();
+        commandBuffer->drawMeshTasksIndirectCountEXT(
+            buffer->getBuffer(), offset, countBuffer->getBuffer(), countOffset, maxDrawCount, stride);
+    }
+
     void CommandBuffer::bufferBarrier(const vk::ArrayProxy<const vk::BufferMemoryBarrier>& bufferMemoryBarriers,
                                       vk::PipelineStageFlags                               srcStageMask,
                                       vk::PipelineStageFlags                               dstStageMask,
                                       vk::DependencyFlags                                  dependencyFlags) const
     {
+        flushBarriers();
         commandBuffer->pipelineBarrier(
             srcStageMask, dstStageMask, dependencyFlags, nullptr, bufferMemoryBarriers, nullptr);
     }
@@ -209,6 +488,7 @@ namespace vulkaninja
                                       vk::AccessFlags          dstAccessMask,
                                       vk::DependencyFlags      dependencyFlags) const
     {
+        flushBarriers();
         std::vector<vk::BufferMemoryBarrier> barriers(buffers.size());
         for (uint32_t i = 0; i < buffers.size(); i++)
         {
@@ -229,6 +509,7 @@ namespace vulkaninja
                                      vk::PipelineStageFlags                              dstStageMask,
                                      vk::DependencyFlags                                 dependencyFlags) const
     {
+        flushBarriers();
         commandBuffer->pipelineBarrier(
             srcStageMask, dstStageMask, dependencyFlags, nullptr, nullptr, imageMemoryBarriers);
     }
@@ -240,6 +521,7 @@ namespace vulkaninja
                                      vk::AccessFlags         dstAccessMask,
                                      vk::DependencyFlags     dependencyFlags) const
     {
+        flushBarriers();
         // NOTE: Since layout transition is not required,
         // oldLayout and newLayout are not specified.
         std::vector<vk::ImageMemoryBarrier> barriers(images.size());
@@ -260,86 +542,364 @@ namespace vulkaninja
         commandBuffer->pipelineBarrier(srcStageMask, dstStageMask, dependencyFlags, nullptr, nullptr, barriers);
     }
 
+    void CommandBuffer::bufferBarrier(const vk::ArrayProxy<const vk::BufferMemoryBarrier2>& bufferMemoryBarriers) const
+    {
+        flushBarriers();
+        recordBarriers(bufferMemoryBarriers, nullptr);
+    }
+
+    void CommandBuffer::imageBarrier(const vk::ArrayProxy<const vk::ImageMemoryBarrier2>& imageMemoryBarriers) const
+    {
+        flushBarriers();
+        recordBarriers(nullptr, imageMemoryBarriers);
+    }
+
+    void CommandBuffer::pipelineBarrier(const vk::ArrayProxy<const vk::BufferMemoryBarrier2>& bufferMemoryBarriers,
+                                        const vk::ArrayProxy<const vk::ImageMemoryBarrier2>&  imageMemoryBarriers,
+                                        const vk::ArrayProxy<const vk::MemoryBarrier2>&       memoryBarriers) const
+    {
+        flushBarriers();
+        if (bufferMemoryBarriers.empty() && imageMemoryBarriers.empty() && memoryBarriers.empty())
+        {
+            return;
+        }
+        recordBarriers(bufferMemoryBarriers, imageMemoryBarriers, memoryBarriers);
+    }
+
     void CommandBuffer::memoryBarrier(vk::PipelineStageFlags srcStageMask,
                                       vk::PipelineStageFlags dstStageMask,
                                       vk::AccessFlags        srcAccessMask,
                                       vk::AccessFlags        dstAccessMask,
                                       vk::DependencyFlags    dependencyFlags)
     {
+        flushBarriers();
         vk::MemoryBarrier memoryBarrier {};
         memoryBarrier.setSrcAccessMask(srcAccessMask);
         memoryBarrier.setDstAccessMask(dstAccessMask);
         commandBuffer->pipelineBarrier(srcStageMask, dstStageMask, dependencyFlags, memoryBarrier, nullptr, nullptr);
     }
 
+    void CommandBuffer::declareUsage(ImageHandle image, ResourceUsage usage) const
+    {
+        addImageBarrier(*image, getResourceState(usage, context->getShaderStages()));
+    }
+
+    void CommandBuffer::declareUsage(BufferHandle buffer, ResourceUsage usage) const
+    {
+        addBufferBarrier(*buffer, getResourceState(usage, context->getShaderStages()));
+    }
+
     void CommandBuffer::transitionLayout(ImageHandle image, vk::ImageLayout newLayout) const
     {
-        vk::PipelineStageFlags srcStageMask = vk::PipelineStageFlagBits::eAllCommands;
-        vk::PipelineStageFlags dstStageMask = vk::PipelineStageFlagBits::eAllCommands;
+        addImageBarrier(*image, getResourceState(newLayout, image->getAspectMask(), context->getShaderStages()));
+    }
+
+    void CommandBuffer::addImageBarrier(Image& image, const ResourceState& dstState) const
+    {
+        // NOTE: Only one barrier per image is allowed in a batch,
+        // so a second transition before the flush is merged into the pending one.
+        auto it = std::ranges::find(m_ImageBarriers, image.m_Image, &vk::ImageMemoryBarrier2::image);
+
+        // Declaring the same usage again before the flush, e.g. beginRendering() in a render graph pass
+        if (it != m_ImageBarriers.end() && image.m_State == dstState)
+        {
+            return;
+        }
+
+        std::optional<ResourceState> srcState = advanceState(image.m_State, dstState, true);
+        if (!srcState)
+        {
+            return;
+        }
+
+        if (it != m_ImageBarriers.end())
+        {
+            it->setNewLayout(dstState.layout);
+            it->setDstStageMask(it->dstStageMask | dstState.stage);
+            it->setDstAccessMask(it->dstAccessMask | dstState.access);
+            return;
+        }
 
         // NOTE: If oldLayout is Undefined, the image contents may be discarded
-        vk::ImageMemoryBarrier barrier {};
+        vk::ImageMemoryBarrier2 barrier {};
+        barrier.setSrcQueueFamilyIndex(VK_QUEUE_FAMILY_IGNORED);
         barrier.setDstQueueFamilyIndex(VK_QUEUE_FAMILY_IGNORED);
+        barrier.setImage(image.m_Image);
+        barrier.setOldLayout(srcState->layout);
+        barrier.setNewLayout(dstState.layout);
+        barrier.setSrcStageMask(srcState->stage);
+        barrier.setDstStageMask(dstState.stage);
+        barrier.setSrcAccessMask(srcState->access & WriteAccess);
+        barrier.setDstAccessMask(dstState.access);
+        barrier.subresourceRange.aspectMask     = image.getAspectMask();
+        barrier.subresourceRange.baseMipLevel   = 0;
+        barrier.subresourceRange.baseArrayLayer = 0;
+        barrier.subresourceRange.layerCount     = image.getLayerCount();
+        barrier.subresourceRange.levelCount     = image.getMipLevels();
+        m_ImageBarriers.push_back(barrier);
+    }
+
+    void CommandBuffer::addBufferBarrier(Buffer& buffer, const ResourceState& dstState) const
+    {
+        auto it = std::ranges::find(m_BufferBarriers, buffer.getBuffer(), &vk::BufferMemoryBarrier2::buffer);
+        if (it != m_BufferBarriers.end() && buffer.m_State == dstState)
+        {
+            return;
+        }
+
+        std::optional<ResourceState> srcState = advanceState(buffer.m_State, dstState, false);
+        if (!srcState)
+        {
+            return;
+        }
+
+        if (it != m_BufferBarriers.end())
+        {
+            it->setDstStageMask(it->dstStageMask | dstState.stage);
+            it->setDstAccessMask(it->dstAccessMask | dstState.access);
+            return;
+        }
+
+        vk::BufferMemoryBarrier2 barrier {};
         barrier.setSrcQueueFamilyIndex(VK_QUEUE_FAMILY_IGNORED);
+        barrier.setDstQueueFamilyIndex(VK_QUEUE_FAMILY_IGNORED);
+        barrier.setBuffer(buffer.getBuffer());
+        barrier.setOffset(0);
+        barrier.setSize(VK_WHOLE_SIZE);
+        barrier.setSrcStageMask(srcState->stage);
+        barrier.setDstStageMask(dstState.stage);
+        barrier.setSrcAccessMask(srcState->access & WriteAccess);
+        barrier.setDstAccessMask(dstState.access);
+        m_BufferBarriers.push_back(barrier);
+    }
+
+    void CommandBuffer::releaseOwnership(ImageHandle image, vk::QueueFlags dstQueue, ResourceUsage usage) const
+    {
+        uint32_t srcFamily = context->getQueueFamily(queueFlags);
+        uint32_t dstFamily = context->getQueueFamily(dstQueue);
+        if (srcFamily == dstFamily)
+        {
+            declareUsage(image, usage);
+            return;
+        }
+
+        // NOTE: The layout transition is done once, between the release and the acquire,
+        // so both barriers specify the same layouts. Destination stages are ignored by the release.
+        ResourceState dstState = getResourceState(usage, context->getShaderStages());
+        flushBarriers();
+
+        vk::ImageMemoryBarrier2 barrier {};
+        barrier.setSrcQueueFamilyIndex(srcFamily);
+        barrier.setDstQueueFamilyIndex(dstFamily);
         barrier.setImage(image->m_Image);
-        barrier.setOldLayout(image->m_Layout);
-        barrier.setNewLayout(newLayout);
+        barrier.setOldLayout(image->m_State.layout);
+        barrier.setNewLayout(dstState.layout);
+        barrier.setSrcStageMask(image->m_State.stage);
+        barrier.setSrcAccessMask(image->m_State.access & WriteAccess);
         barrier.subresourceRange.aspectMask     = image->getAspectMask();
         barrier.subresourceRange.baseMipLevel   = 0;
         barrier.subresourceRange.baseArrayLayer = 0;
         barrier.subresourceRange.layerCount     = image->getLayerCount();
         barrier.subresourceRange.levelCount     = image->getMipLevels();
+        recordBarriers(nullptr, barrier);
 
-        switch (image->m_Layout)
-        {
-            case vk::ImageLayout::eTransferDstOptimal:
-                barrier.srcAccessMask = vk::AccessFlagBits::eTransferWrite;
-                break;
-            case vk::ImageLayout::eTransferSrcOptimal:
-                barrier.srcAccessMask = vk::AccessFlagBits::eTransferRead;
-                break;
-            case vk::ImageLayout::eColorAttachmentOptimal:
-                barrier.srcAccessMask = vk::AccessFlagBits::eColorAttachmentRead;
-                break;
-            case vk::ImageLayout::eDepthStencilAttachmentOptimal:
-                barrier.srcAccessMask = vk::AccessFlagBits::eDepthStencilAttachmentRead;
-                break;
-            case vk::ImageLayout::eShaderReadOnlyOptimal:
-                barrier.srcAccessMask = vk::AccessFlagBits::eShaderRead;
-                break;
-            case vk::ImageLayout::ePresentSrcKHR:
-                barrier.srcAccessMask = vk::AccessFlagBits::eMemoryRead;
-                break;
-            default:
-                break;
-        }
-
-        switch (newLayout)
-        {
-            case vk::ImageLayout::eTransferDstOptimal:
-                barrier.dstAccessMask = vk::AccessFlagBits::eTransferWrite;
-                break;
-            case vk::ImageLayout::eTransferSrcOptimal:
-                barrier.dstAccessMask = vk::AccessFlagBits::eTransferRead;
-                break;
-            case vk::ImageLayout::eColorAttachmentOptimal:
-                barrier.dstAccessMask = vk::AccessFlagBits::eColorAttachmentWrite;
-                break;
-            case vk::ImageLayout::eDepthStencilAttachmentOptimal:
-                barrier.dstAccessMask = vk::AccessFlagBits::eDepthStencilAttachmentWrite;
-                break;
-            case vk::ImageLayout::eShaderReadOnlyOptimal:
-                barrier.dstAccessMask = vk::AccessFlagBits::eShaderRead;
-                break;
-            case vk::ImageLayout::ePresentSrcKHR:
-                barrier.dstAccessMask = vk::AccessFlagBits::eMemoryRead;
-                break;
-            default:
-                break;
+        // The old layout is kept for the acquire barrier
+        image->m_ReleasedLayout = image->m_State.layout;
+        image->m_State          = {.layout = dstState.layout};
+    }
+
+    void CommandBuffer::releaseOwnership(BufferHandle buffer, vk::QueueFlags dstQueue, ResourceUsage usage) const
+    {
+        uint32_t srcFamily = context->getQueueFamily(queueFlags);
+        uint32_t dstFamily = context->getQueueFamily(dstQueue);
+        if (srcFamily == dstFamily)
+        {
+            declareUsage(buffer, usage);
+            return;
+        }
+
+        flushBarriers();
+
+        vk::BufferMemoryBarrier2 barrier {};
+        barrier.setSrcQueueFamilyIndex(srcFamily);
+        barrier.setDstQueueFamilyIndex(dstFamily);
+        barrier.setBuffer(buffer->getBuffer());
+        barrier.setOffset(0);
+        barrier.setSize(VK_WHOLE_SIZE);
+        barrier.setSrcStageMask(buffer->m_State.stage);
+        barrier.setSrcAccessMask(buffer->m_State.access & WriteAccess);
+        recordBarriers(barrier, nullptr);
+
+        buffer->m_State = {};
+    }
+
+    void CommandBuffer::acquireOwnership(ImageHandle image, vk::QueueFlags srcQueue, ResourceUsage usage) const
+    {
+        uint32_t srcFamily = context->getQueueFamily(srcQueue);
+        uint32_t dstFamily = context->getQueueFamily(queueFlags);
+        if (srcFamily == dstFamily)
+        {
+            declareUsage(image, usage);
+            return;
+        }
+
+        VKN_ASSERT(image->m_ReleasedLayout, "The image must be released by the source queue first.");
+
+        // NOTE: The semaphore wait of the submission makes the released writes available,
+        // so no source stage is needed here. The layouts repeat those of the release.
+        ResourceState dstState = getResourceState(usage, context->getShaderStages());
+        dstState.layout        = image->m_State.layout;
+        flushBarriers();
+
+        vk::ImageMemoryBarrier2 barrier {};
+        barrier.setSrcQueueFamilyIndex(srcFamily);
+        barrier.setDstQueueFamilyIndex(dstFamily);
+        barrier.setImage(image->m_Image);
+        barrier.setOldLayout(*image->m_ReleasedLayout);
+        barrier.setNewLayout(image->m_State.layout);
+        barrier.setDstStageMask(dstState.stage);
+        barrier.setDstAccessMask(dstState.access);
+        barrier.subresourceRange.aspectMask     = image->getAspectMask();
+        barrier.subresourceRange.baseMipLevel   = 0;
+        barrier.subresourceRange.baseArrayLayer = 0;
+        barrier.subresourceRange.layerCount     = image->getLayerCount();
+        barrier.subresourceRange.levelCount     = image->getMipLevels();
+        recordBarriers(nullptr, barrier);
+
+        image->m_ReleasedLayout.reset();
+        image->m_State = dstState;
+    }
+
+    void CommandBuffer::acquireOwnership(BufferHandle buffer, vk::QueueFlags srcQueue, ResourceUsage usage) const
+    {
+        uint32_t srcFamily = context->getQueueFamily(srcQueue);
+        uint32_t dstFamily = context->getQueueFamily(queueFlags);
+        if (srcFamily == dstFamily)
+        {
+            declareUsage(buffer, usage);
+            return;
         }
 
-        commandBuffer->pipelineBarrier(srcStageMask, dstStageMask, {}, {}, {}, barrier);
-        image->m_Layout = newLayout;
+        ResourceState dstState = getResourceState(usage, context->getShaderStages());
+        flushBarriers();
+
+        vk::BufferMemoryBarrier2 barrier {};
+        barrier.setSrcQueueFamilyIndex(srcFamily);
+        barrier.setDstQueueFamilyIndex(dstFamily);
+        barrier.setBuffer(buffer->getBuffer());
+        barrier.setOffset(0);
+        barrier.setSize(VK_WHOLE_SIZE);
+        barrier.setDstStageMask(dstState.stage);
+        barrier.setDstAccessMask(dstState.access);
+        recordBarriers(barrier, nullptr);
+
+        buffer->m_State = dstState;
+    }
+
+    void CommandBuffer::flushBarriers() const
+    {
+        if (m_ImageBarriers.empty() && m_BufferBarriers.empty())
+        {
+            return;
+        }
+        VKN_ASSERT(!m_IsRendering,
+                   "Barriers cannot be recorded inside rendering. Declare usages before beginRendering().");
+
+        recordBarriers(m_BufferBarriers, m_ImageBarriers);
+        m_BufferBarriers.clear();
+        m_ImageBarriers.clear();
+    }
+
+    void CommandBuffer::checkDrawBarriers() const
+    {
+        VKN_ASSERT(m_IsRendering, "Draws must be recorded between beginRendering() and endRendering().");
+        VKN_ASSERT(m_ImageBarriers.empty() && m_BufferBarriers.empty(),
+                   "{} image and {} buffer barriers are pending in rendering. Declare usages before beginRendering().",
+                   m_ImageBarriers.size(),
+                   m_BufferBarriers.size());
+    }
+
+    void CommandBuffer::recordBarriers(const vk::ArrayProxy<const vk::BufferMemoryBarrier2>& bufferBarriers,
+                                       const vk::ArrayProxy<const vk::ImageMemoryBarrier2>&  imageBarriers,
+                                       const vk::ArrayProxy<const vk::MemoryBarrier2>&       memoryBarriers) const
+    {
+        if (!(queueFlags & vk::QueueFlagBits::eGraphics))
+        {
+            vk::PipelineStageFlags2 stages =
+                (queueFlags & vk::QueueFlagBits::eCompute) ? ComputeQueueStages : TransferQueueStages;
+            std::vector<vk::BufferMemoryBarrier2> maskedBufferBarriers(bufferBarriers.begin(), bufferBarriers.end());
+            std::vector<vk::ImageMemoryBarrier2>  maskedImageBarriers(imageBarriers.begin(), imageBarriers.end());
+            std::vector<vk::MemoryBarrier2>       maskedMemoryBarriers(memoryBarriers.begin(), memoryBarriers.end());
+            std::ranges::for_each(maskedBufferBarriers, [&](auto& barrier) { maskBarrier(barrier, stages); });
+            std::ranges::for_each(maskedImageBarriers, [&](auto& barrier) { maskBarrier(barrier, stages); });
+            std::ranges::for_each(maskedMemoryBarriers, [&](auto& barrier) { maskBarrier(barrier, stages); });
+            recordPipelineBarrier(maskedBufferBarriers, maskedImageBarriers, maskedMemoryBarriers);
+            return;
+        }
+        recordPipelineBarrier(bufferBarriers, imageBarriers, memoryBarriers);
+    }
+
+    void CommandBuffer::recordPipelineBarrier(
+        const vk::ArrayProxy<const vk::BufferMemoryBarrier2>& bufferBarriers,
+        const vk::ArrayProxy<const vk::ImageMemoryBarrier2>&  imageBarriers,
+        const vk::ArrayProxy<const vk::MemoryBarrier2>&       memoryBarriers) const
+    {
+        if (context->synchronization2Enabled())
+        {
+            vk::DependencyInfo dependencyInfo;
+            dependencyInfo.setMemoryBarrierCount(memoryBarriers.size());
+            dependencyInfo.setPMemoryBarriers(memoryBarriers.data());
+            dependencyInfo.setBufferMemoryBarrierCount(bufferBarriers.size());
+            dependencyInfo.setPBufferMemoryBarriers(bufferBarriers.data());
+            dependencyInfo.setImageMemoryBarrierCount(imageBarriers.size());
+            dependencyInfo.setPImageMemoryBarriers(imageBarriers.data());
+            commandBuffer->pipelineBarrier2(dependencyInfo);
+            return;
+        }
+
+        // Legacy path: one vkCmdPipelineBarrier with the union of all stages
+        vk::PipelineStageFlags               srcStageMask;
+        vk::PipelineStageFlags               dstStageMask;
+        std::vector<vk::MemoryBarrier>       legacyMemoryBarriers;
+        std::vector<vk::BufferMemoryBarrier> legacyBufferBarriers;
+        std::vector<vk::ImageMemoryBarrier>  legacyImageBarriers;
+        legacyMemoryBarriers.reserve(memoryBarriers.size());
+        legacyBufferBarriers.reserve(bufferBarriers.size());
+        legacyImageBarriers.reserve(imageBarriers.size());
+        for (const auto& barrier : memoryBarriers)
+        {
+            srcStageMask |= toLegacyStage(barrier.srcStageMask, true);
+            dstStageMask |= toLegacyStage(barrier.dstStageMask, false);
+            legacyMemoryBarriers.emplace_back(toLegacyAccess(barrier.srcAccessMask),
+                                              toLegacyAccess(barrier.dstAccessMask));
+        }
+        for (const auto& barrier : bufferBarriers)
+        {
+            srcStageMask |= toLegacyStage(barrier.srcStageMask, true);
+            dstStageMask |= toLegacyStage(barrier.dstStageMask, false);
+            legacyBufferBarriers.emplace_back(toLegacyAccess(barrier.srcAccessMask),
+                                              toLegacyAccess(barrier.dstAccessMask),
+                                              barrier.srcQueueFamilyIndex,
+                                              barrier.dstQueueFamilyIndex,
+                                              barrier.buffer,
+                                              barrier.offset,
+                                              barrier.size);
+        }
+        for (const auto& barrier : imageBarriers)
+        {
+            srcStageMask |= toLegacyStage(barrier.srcStageMask, true);
+            dstStageMask |= toLegacyStage(barrier.dstStageMask, false);
+            legacyImageBarriers.emplace_back(toLegacyAccess(barrier.srcAccessMask),
+                                             toLegacyAccess(barrier.dstAccessMask),
+                                             barrier.oldLayout,
+                                             barrier.newLayout,
+                                             barrier.srcQueueFamilyIndex,
+                                             barrier.dstQueueFamilyIndex,
+                                             barrier.image,
+                                             barrier.subresourceRange);
+        }
+        commandBuffer->pipelineBarrier(
+            srcStageMask, dstStageMask, {}, legacyMemoryBarriers, legacyBufferBarriers, legacyImageBarriers);
     }
 
     void CommandBuffer::copyImage(ImageHandle     srcImage,
@@ -358,8 +918,11 @@ namespace vulkaninja
                    dstExtent.height,
                    dstExtent.depth)
 
-        transitionLayout(srcImage, vk::ImageLayout::eTransferSrcOptimal);
-        transitionLayout(dstImage, vk::ImageLayout::eTransferDstOptimal);
+        // NOTE: Both transitions are issued in one barrier and
+        // the transitions to the new layouts are deferred to the next action command.
+        declareUsage(srcImage, ResourceUsage::eTransferSrc);
+        declareUsage(dstImage, ResourceUsage::eTransferDst);
+        flushBarriers();
 
         vk::ImageCopy copyRegion;
         copyRegion.setSrcSubresource({vk::ImageAspectFlagBits::eColor, 0, 0, 1});
@@ -377,33 +940,46 @@ namespace vulkaninja
 
     void CommandBuffer::copyImageToBuffer(ImageHandle srcImage, BufferHandle dstBuffer) const
     {
+        declareUsage(srcImage, ResourceUsage::eTransferSrc);
+        declareUsage(dstBuffer, ResourceUsage::eTransferDst);
+        flushBarriers();
         vk::BufferImageCopy region;
         region.setImageExtent(srcImage->getExtent());
         region.setImageSubresource({srcImage->getAspectMask(), 0, 0, 1});
-        commandBuffer->copyImageToBuffer(srcImage->getImage(), srcImage->getLayout(), dstBuffer->getBuffer(), region);
+        commandBuffer->copyImageToBuffer(
+            srcImage->getImage(), vk::ImageLayout::eTransferSrcOptimal, dstBuffer->getBuffer(), region);
     }
 
+    void CommandBuffer::buildDepthPyramid(DepthPyramidHandle depthPyramid) const { depthPyramid->build(*this); }
+
     void CommandBuffer::copyBufferToImage(BufferHandle                    srcBuffer,
                                           ImageHandle                     dstImage,
                                           ArrayProxy<vk::BufferImageCopy> copyRegions) const
     {
+        declareUsage(srcBuffer, ResourceUsage::eTransferSrc);
+        declareUsage(dstImage, ResourceUsage::eTransferDst);
+        flushBarriers();
         if (!copyRegions.empty())
         {
             commandBuffer->copyBufferToImage(
-                srcBuffer->getBuffer(), dstImage->getImage(), dstImage->getLayout(), copyRegions);
+                srcBuffer->getBuffer(), dstImage->getImage(), vk::ImageLayout::eTransferDstOptimal, copyRegions);
             return;
         }
         vk::BufferImageCopy region;
         region.setImageExtent(dstImage->getExtent());
         region.setImageSubresource({dstImage->getAspectMask(), 0, 0, 1});
-        commandBuffer->copyBufferToImage(srcBuffer->getBuffer(), dstImage->getImage(), dstImage->getLayout(), region);
+        commandBuffer->copyBufferToImage(
+            srcBuffer->getBuffer(), dstImage->getImage(), vk::ImageLayout::eTransferDstOptimal, region);
     }
 
     void
     CommandBuffer::blitImage(ImageHandle srcImage, ImageHandle dstImage, vk::ImageBlit blit, vk::Filter filter) const
     {
+        declareUsage(srcImage, ResourceUsage::eBlitSrc);
+        declareUsage(dstImage, ResourceUsage::eBlitDst);
+        flushBarriers();
         commandBuffer->blitImage(
-            srcImage->m_Image, srcImage->m_Layout, dstImage->m_Image, dstImage->m_Layout, blit, filter);
+            srcImage->getImage(), srcImage->getLayout(), dstImage->getImage(), dstImage->getLayout(), blit, filter);
     }
 
     void CommandBuffer::fillBuffer(BufferHandle   dstBuffer,
@@ -411,11 +987,15 @@ namespace vulkaninja
                                    vk::DeviceSize dstOffset,
                                    vk::DeviceSize size) const
     {
+        declareUsage(dstBuffer, ResourceUsage::eTransferDst);
+        flushBarriers();
         commandBuffer->fillBuffer(dstBuffer->getBuffer(), dstOffset, size, data);
     }
 
     void CommandBuffer::copyBuffer(BufferHandle buffer, const void* data) const
     {
+        declareUsage(buffer, ResourceUsage::eTransferDst);
+        flushBarriers();
         buffer->prepareStagingBuffer();
         buffer->m_StagingBuffer->copy(data);
 
@@ -423,8 +1003,33 @@ namespace vulkaninja
         commandBuffer->copyBuffer(buffer->m_StagingBuffer->getBuffer(), buffer->getBuffer(), region);
     }
 
+    void CommandBuffer::copyBuffer(BufferHandle srcBuffer, BufferHandle dstBuffer, vk::DeviceSize size) const
+    {
+        declareUsage(srcBuffer, ResourceUsage::eTransferSrc);
+        declareUsage(dstBuffer, ResourceUsage::eTransferDst);
+        flushBarriers();
+
+        vk::BufferCopy region {0, 0, size};
+        commandBuffer->copyBuffer(srcBuffer->getBuffer(), dstBuffer->getBuffer(), region);
+    }
+
+    void CommandBuffer::updateBuffer(BufferHandle   dstBuffer,
+                                     vk::DeviceSize dstOffset,
+                                     vk::DeviceSize size,
+                                     const void*    data) const
+    {
+        VKN_ASSERT(size <= 65536 && dstOffset % 4 == 0 && size % 4 == 0,
+                   "updateBuffer() takes up to 65536 bytes at offsets and sizes that are multiples of 4.");
+        declareUsage(dstBuffer, ResourceUsage::eTransferDst);
+        flushBarriers();
+        commandBuffer->updateBuffer(dstBuffer->getBuffer(), dstOffset, size, data);
+    }
+
     void CommandBuffer::updateTopAccel(TopAccelHandle topAccel) const
     {
+        topAccel->uploadInstances(*this);
+        declareBuildUsage(*topAccel);
+        flushBarriers();
         vk::AccelerationStructureGeometryKHR geometry;
         geometry.setGeometryType(vk::GeometryTypeKHR::eInstances);
         geometry.setGeometry({topAccel->m_InstancesData});
@@ -435,10 +1040,20 @@ namespace vulkaninja
         buildGeometryInfo.setFlags(topAccel->m_BuildFlags);
         buildGeometryInfo.setGeometries(geometry);
 
-        buildGeometryInfo.setMode(vk::BuildAccelerationStructureModeKHR::eUpdate); // for update
-        buildGeometryInfo.setSrcAccelerationStructure(*topAccel->m_Accel);         // for update
-        buildGeometryInfo.setDstAccelerationStructure(*topAccel->m_Accel);
-        buildGeometryInfo.setScratchData(topAccel->m_ScratchBuffer->getAddress());
+        // NOTE: Updates need the instance count of the last build, otherwise rebuild into the same allocation
+        if (topAccel->shouldRebuild())
+        {
+            buildGeometryInfo.setMode(vk::BuildAccelerationStructureModeKHR::eBuild);
+            buildGeometryInfo.setDstAccelerationStructure(*topAccel->m_Accel);
+            buildGeometryInfo.setScratchData(allocateScratch(topAccel->m_ScratchSize));
+        }
+        else
+        {
+            buildGeometryInfo.setMode(vk::BuildAccelerationStructureModeKHR::eUpdate);
+            buildGeometryInfo.setSrcAccelerationStructure(*topAccel->m_Accel);
+            buildGeometryInfo.setDstAccelerationStructure(*topAccel->m_Accel);
+            buildGeometryInfo.setScratchData(allocateScratch(topAccel->m_UpdateScratchSize));
+        }
 
         vk::AccelerationStructureBuildRangeInfoKHR buildRangeInfo {};
         buildRangeInfo.setPrimitiveCount(topAccel->m_PrimitiveCount);
@@ -446,46 +1061,52 @@ namespace vulkaninja
         buildRangeInfo.setFirstVertex(0);
         buildRangeInfo.setTransformOffset(0);
         commandBuffer->buildAccelerationStructuresKHR(buildGeometryInfo, &buildRangeInfo);
+        topAccel->m_BuiltPrimitiveCount = topAccel->m_PrimitiveCount;
     }
 
-    void CommandBuffer::updateBottomAccel(BottomAccelHandle bottomAccel) const
+    void CommandBuffer::updateTopAccelTransforms(TopAccelHandle    topAccel,
+                                                 vk::DeviceAddress transformUpdates,
+                                                 uint32_t          updateCount) const
     {
-        vk::AccelerationStructureGeometryDataKHR geometryData;
-        geometryData.setTriangles(bottomAccel->m_TrianglesData);
+        topAccel->updateTransforms(*this, transformUpdates, updateCount);
+    }
 
-        vk::AccelerationStructureGeometryKHR geometry;
-        geometry.setGeometryType(vk::GeometryTypeKHR::eTriangles);
-        geometry.setGeometry({geometryData});
-        geometry.setFlags(bottomAccel->m_GeometryFlags);
+    void CommandBuffer::updateBottomAccel(BottomAccelHandle bottomAccel) const
+    {
+        VKN_ASSERT(!bottomAccel->m_Compacted || !bottomAccel->shouldRebuild(),
+                   "A compacted BottomAccel cannot be rebuilt with different primitive counts.");
+        declareBuildUsage(*bottomAccel);
+        flushBarriers();
+        std::vector<vk::AccelerationStructureGeometryKHR>       geometries  = bottomAccel->getGeometries();
+        std::vector<vk::AccelerationStructureBuildRangeInfoKHR> buildRanges = bottomAccel->getBuildRanges();
 
         vk::AccelerationStructureBuildGeometryInfoKHR buildGeometryInfo;
         buildGeometryInfo.setType(vk::AccelerationStructureTypeKHR::eBottomLevel);
         buildGeometryInfo.setFlags(bottomAccel->m_BuildFlags);
-        buildGeometryInfo.setGeometries(geometry);
-        buildGeometryInfo.setScratchData(bottomAccel->m_ScratchBuffer->getAddress());
+        buildGeometryInfo.setGeometries(geometries);
 
         if (bottomAccel->shouldRebuild())
         {
             buildGeometryInfo.setMode(vk::BuildAccelerationStructureModeKHR::eBuild);
             buildGeometryInfo.setDstAccelerationStructure(*bottomAccel->m_Accel);
+            buildGeometryInfo.setScratchData(allocateScratch(bottomAccel->m_ScratchSize));
         }
         else
         {
             buildGeometryInfo.setMode(vk::BuildAccelerationStructureModeKHR::eUpdate);
             buildGeometryInfo.setSrcAccelerationStructure(*bottomAccel->m_Accel);
             buildGeometryInfo.setDstAccelerationStructure(*bottomAccel->m_Accel);
+            buildGeometryInfo.setScratchData(allocateScratch(bottomAccel->m_UpdateScratchSize));
         }
 
-        vk::AccelerationStructureBuildRangeInfoKHR buildRangeInfo {};
-        buildRangeInfo.setPrimitiveCount(bottomAccel->m_PrimitiveCount);
-        buildRangeInfo.setPrimitiveOffset(0);
-        buildRangeInfo.setFirstVertex(0);
-        buildRangeInfo.setTransformOffset(0);
-        commandBuffer->buildAccelerationStructuresKHR(buildGeometryInfo, &buildRangeInfo);
+        commandBuffer->buildAccelerationStructuresKHR(buildGeometryInfo, buildRanges.data());
     }
 
     void CommandBuffer::buildTopAccel(TopAccelHandle topAccel) const
     {
+        topAccel->uploadInstances(*this);
+        declareBuildUsage(*topAccel);
+        flushBarriers();
         vk::AccelerationStructureGeometryKHR geometry;
         geometry.setGeometryType(vk::GeometryTypeKHR::eInstances);
         geometry.setGeometry({topAccel->m_InstancesData});
@@ -498,7 +1119,7 @@ namespace vulkaninja
 
         buildGeometryInfo.setMode(vk::BuildAccelerationStructureModeKHR::eBuild); // for build
         buildGeometryInfo.setDstAccelerationStructure(*topAccel->m_Accel);
-        buildGeometryInfo.setScratchData(topAccel->m_ScratchBuffer->getAddress());
+        buildGeometryInfo.setScratchData(allocateScratch(topAccel->m_ScratchSize));
 
         vk::AccelerationStructureBuildRangeInfoKHR buildRangeInfo {};
         buildRangeInfo.setPrimitiveCount(topAccel->m_PrimitiveCount);
@@ -506,33 +1127,165 @@ namespace vulkaninja
         buildRangeInfo.setFirstVertex(0);
         buildRangeInfo.setTransformOffset(0);
         commandBuffer->buildAccelerationStructuresKHR(buildGeometryInfo, &buildRangeInfo);
+        topAccel->m_BuiltPrimitiveCount = topAccel->m_PrimitiveCount;
     }
 
     void CommandBuffer::buildBottomAccel(BottomAccelHandle bottomAccel) const
     {
-        vk::AccelerationStructureGeometryDataKHR geometryData;
-        geometryData.setTriangles(bottomAccel->m_TrianglesData);
-
-        vk::AccelerationStructureGeometryKHR geometry;
-        geometry.setGeometryType(vk::GeometryTypeKHR::eTriangles);
-        geometry.setGeometry({geometryData});
-        geometry.setFlags(bottomAccel->m_GeometryFlags);
+        VKN_ASSERT(!bottomAccel->m_Compacted, "A compacted BottomAccel cannot be rebuilt.");
+        declareBuildUsage(*bottomAccel);
+        flushBarriers();
+        std::vector<vk::AccelerationStructureGeometryKHR>       geometries  = bottomAccel->getGeometries();
+        std::vector<vk::AccelerationStructureBuildRangeInfoKHR> buildRanges = bottomAccel->getBuildRanges();
 
         vk::AccelerationStructureBuildGeometryInfoKHR buildGeometryInfo;
         buildGeometryInfo.setType(vk::AccelerationStructureTypeKHR::eBottomLevel);
         buildGeometryInfo.setFlags(bottomAccel->m_BuildFlags);
-        buildGeometryInfo.setGeometries(geometry);
+        buildGeometryInfo.setGeometries(geometries);
 
         buildGeometryInfo.setMode(vk::BuildAccelerationStructureModeKHR::eBuild);
         buildGeometryInfo.setDstAccelerationStructure(*bottomAccel->m_Accel);
-        buildGeometryInfo.setScratchData(bottomAccel->m_ScratchBuffer->getAddress());
+        buildGeometryInfo.setScratchData(allocateScratch(bottomAccel->m_ScratchSize));
 
-        vk::AccelerationStructureBuildRangeInfoKHR buildRangeInfo {};
-        buildRangeInfo.setPrimitiveCount(bottomAccel->m_PrimitiveCount);
-        buildRangeInfo.setPrimitiveOffset(0);
-        buildRangeInfo.setFirstVertex(0);
-        buildRangeInfo.setTransformOffset(0);
-        commandBuffer->buildAccelerationStructuresKHR(buildGeometryInfo, &buildRangeInfo);
+        commandBuffer->buildAccelerationStructuresKHR(buildGeometryInfo, buildRanges.data());
+    }
+
+    void CommandBuffer::buildBottomAccels(ArrayProxy<BottomAccelHandle> bottomAccels, BufferHandle scratchBuffer) const
+    {
+        // Waits for the previous builds using the scratch buffer
+        declareUsage(scratchBuffer, ResourceUsage::eAccelBuild);
+        recordBottomAccelBuilds(bottomAccels, scratchBuffer->getAddress(), scratchBuffer->getSize());
+    }
+
+    void CommandBuffer::buildBottomAccels(ArrayProxy<BottomAccelHandle> bottomAccels,
+                                          vk::DeviceSize                scratchBudget) const
+    {
+        vk::DeviceSize alignment    = context->getAccelScratchAlignment();
+        vk::DeviceSize totalSize    = 0;
+        vk::DeviceSize maxBuildSize = 0;
+        for (const auto& bottomAccel : bottomAccels)
+        {
+            totalSize += alignUp(bottomAccel->m_ScratchSize, alignment);
+            maxBuildSize = std::max(maxBuildSize, bottomAccel->m_ScratchSize);
+        }
+        if (totalSize == 0)
+        {
+            return;
+        }
+
+        vk::DeviceSize scratchSize = std::min(totalSize, std::max(scratchBudget, maxBuildSize));
+        recordBottomAccelBuilds(bottomAccels, allocateScratch(scratchSize), scratchSize);
+    }
+
+    void CommandBuffer::declareBuildUsage(const BottomAccel& bottomAccel) const
+    {
+        for (const auto& geometry : bottomAccel.m_Geometries)
+        {
+            for (const BufferHandle& input :
+                 {geometry.vertexBuffer, geometry.indexBuffer, geometry.transformBuffer, geometry.aabbBuffer})
+            {
+                if (input)
+                {
+                    declareUsage(input, ResourceUsage::eAccelBuildInput);
+                }
+            }
+        }
+        declareUsage(bottomAccel.m_Buffer, ResourceUsage::eAccelBuild);
+    }
+
+    void CommandBuffer::declareBuildUsage(const TopAccel& topAccel) const
+    {
+        declareUsage(topAccel.m_InstanceBuffer, ResourceUsage::eAccelBuildInput);
+        for (const auto& bottomAccel : topAccel.m_BottomAccels)
+        {
+            declareUsage(bottomAccel->m_Buffer, ResourceUsage::eAccelBuildSource);
+        }
+        declareUsage(topAccel.m_Buffer, ResourceUsage::eAccelBuild);
+    }
+
+    void CommandBuffer::recordBottomAccelBuilds(ArrayProxy<BottomAccelHandle> bottomAccels,
+                                                vk::DeviceAddress             scratchAddress,
+                                                vk::DeviceSize                scratchSize) const
+    {
+        vk::DeviceSize alignment   = context->getAccelScratchAlignment();
+        vk::DeviceSize firstOffset = alignUp(scratchAddress, alignment) - scratchAddress;
+
+        size_t geometryCount = 0;
+        for (const auto& bottomAccel : bottomAccels)
+        {
+            geometryCount += bottomAccel->getGeometryCount();
+        }
+
+        // NOTE: Reserved so that build infos keep pointing to valid geometries and ranges
+        std::vector<vk::AccelerationStructureGeometryKHR>              geometries;
+        std::vector<vk::AccelerationStructureBuildGeometryInfoKHR>     buildInfos;
+        std::vector<vk::AccelerationStructureBuildRangeInfoKHR>        rangeInfos;
+        std::vector<const vk::AccelerationStructureBuildRangeInfoKHR*> pRangeInfos;
+        geometries.reserve(geometryCount);
+        buildInfos.reserve(bottomAccels.size());
+        rangeInfos.reserve(geometryCount);
+        pRangeInfos.reserve(bottomAccels.size());
+
+        bool firstBatch  = true;
+        auto recordBatch = [&]() {
+            flushBarriers();
+            if (!firstBatch)
+            {
+                // Waits for the previous batch, which used the same scratch memory
+                vk::MemoryBarrier2 memoryBarrier {};
+                memoryBarrier.setSrcStageMask(vk::PipelineStageFlagBits2::eAccelerationStructureBuildKHR);
+                memoryBarrier.setDstStageMask(vk::PipelineStageFlagBits2::eAccelerationStructureBuildKHR);
+                memoryBarrier.setSrcAccessMask(vk::AccessFlagBits2::eAccelerationStructureWriteKHR);
+                memoryBarrier.setDstAccessMask(vk::AccessFlagBits2::eAccelerationStructureReadKHR |
+                                               vk::AccessFlagBits2::eAccelerationStructureWriteKHR);
+                recordBarriers(nullptr, nullptr, memoryBarrier);
+            }
+            firstBatch = false;
+            commandBuffer->buildAccelerationStructuresKHR(buildInfos, pRangeInfos);
+            geometries.clear();
+            buildInfos.clear();
+            rangeInfos.clear();
+            pRangeInfos.clear();
+        };
+
+        vk::DeviceSize scratchOffset = firstOffset;
+        for (const auto& bottomAccel : bottomAccels)
+        {
+            VKN_ASSERT(!bottomAccel->m_Compacted, "A compacted BottomAccel cannot be rebuilt.");
+            VKN_ASSERT(firstOffset + bottomAccel->m_ScratchSize <= scratchSize,
+                       "Scratch of {} bytes is smaller than the scratch size {} of a build.",
+                       scratchSize,
+                       bottomAccel->m_ScratchSize);
+
+            vk::DeviceSize offset = alignUp(scratchOffset, alignment);
+            if (offset + bottomAccel->m_ScratchSize > scratchSize)
+            {
+                recordBatch();
+                offset = firstOffset;
+            }
+            scratchOffset = offset + bottomAccel->m_ScratchSize;
+            declareBuildUsage(*bottomAccel);
+
+            size_t firstGeometry = geometries.size();
+            std::ranges::copy(bottomAccel->getGeometries(), std::back_inserter(geometries));
+            std::ranges::copy(bottomAccel->getBuildRanges(), std::back_inserter(rangeInfos));
+
+            vk::AccelerationStructureBuildGeometryInfoKHR buildGeometryInfo;
+            buildGeometryInfo.setType(vk::AccelerationStructureTypeKHR::eBottomLevel);
+            buildGeometryInfo.setFlags(bottomAccel->m_BuildFlags);
+            buildGeometryInfo.setGeometryCount(bottomAccel->getGeometryCount());
+            buildGeometryInfo.setPGeometries(&geometries[firstGeometry]);
+            buildGeometryInfo.setMode(vk::BuildAccelerationStructureModeKHR::eBuild);
+            buildGeometryInfo.setDstAccelerationStructure(*bottomAccel->m_Accel);
+            buildGeometryInfo.setScratchData(scratchAddress + offset);
+            buildInfos.push_back(buildGeometryInfo);
+            pRangeInfos.push_back(&rangeInfos[firstGeometry]);
+        }
+
+        if (!buildInfos.empty())
+        {
+            recordBatch();
+        }
     }
 
     void CommandBuffer::beginTimestamp(GPUTimerHandle gpuTimer) const
@@ -555,6 +1308,12 @@ namespace vulkaninja
         // Invert Y
         viewport.y      = viewport.height;
         viewport.height = -viewport.height;
+        if (m_Viewport == viewport)
+        {
+            m_ElidedCallCounts.viewports++;
+            return;
+        }
+        m_Viewport = viewport;
         commandBuffer->setViewport(0, 1, &viewport);
     }
 
@@ -569,10 +1328,25 @@ namespace vulkaninja
             0.0f,
             1.0f,
         };
+        if (m_Viewport == viewport)
+        {
+            m_ElidedCallCounts.viewports++;
+            return;
+        }
+        m_Viewport = viewport;
         commandBuffer->setViewport(0, 1, &viewport);
     }
 
-    void CommandBuffer::setScissor(const vk::Rect2D& scissor) const { commandBuffer->setScissor(0, 1, &scissor); }
+    void CommandBuffer::setScissor(const vk::Rect2D& scissor) const
+    {
+        if (m_Scissor == scissor)
+        {
+            m_ElidedCallCounts.scissors++;
+            return;
+        }
+        m_Scissor = scissor;
+        commandBuffer->setScissor(0, 1, &scissor);
+    }
 
     void CommandBuffer::setScissor(uint32_t width, uint32_t height) const
     {
@@ -580,7 +1354,7 @@ namespace vulkaninja
             {0, 0},
             {width, height},
         };
-        commandBuffer->setScissor(0, 1, &scissor);
+        setScissor(scissor);
     }
 
     void CommandBuffer::setPolygonMode(vk::PolygonMode polygonMode) const
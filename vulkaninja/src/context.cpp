@@ -1,12 +1,23 @@
 #include "vulkaninja/context.hpp"
 #include "vulkaninja/accel.hpp"
+#include "vulkaninja/accel_compactor.hpp"
 #include "vulkaninja/command_buffer.hpp"
+#include "vulkaninja/depth_pyramid.hpp"
 #include "vulkaninja/descriptor_set.hpp"
 #include "vulkaninja/fence.hpp"
+#include "vulkaninja/frame_uniform_allocator.hpp"
+#include "vulkaninja/gpu_culling.hpp"
 #include "vulkaninja/gpu_timer.hpp"
 #include "vulkaninja/image.hpp"
+#include "vulkaninja/mip_generator.hpp"
 #include "vulkaninja/pipeline.hpp"
+#include "vulkaninja/render_graph.hpp"
+#include "vulkaninja/semaphore.hpp"
 #include "vulkaninja/shader.hpp"
+#include "vulkaninja/shader_binding_table.hpp"
+
+#include <algorithm>
+#include <cstring>
 
 VULKAN_HPP_DEFAULT_DISPATCH_LOADER_DYNAMIC_STORAGE
 
@@ -155,7 +166,8 @@ namespace vulkaninja
     void Context::initDevice(const std::vector<const char*>&   deviceExtensions,
                              const vk::PhysicalDeviceFeatures& deviceFeatures,
                              const void*                       deviceCreateInfoPNext,
-                             bool                              enableRayTracing)
+                             bool                              enableRayTracing,
+                             uint32_t                          descriptorPoolSize)
     {
         // Create device
         std::unordered_map<vk::QueueFlags, std::vector<float>> queuePriorities;
@@ -183,6 +195,49 @@ namespace vulkaninja
         deviceInfo.setPNext(deviceCreateInfoPNext);
         m_Device = m_PhysicalDevice.createDeviceUnique(deviceInfo);
 
+        m_SamplerAnisotropy = deviceFeatures.samplerAnisotropy;
+
+        // NOTE: Stages of disabled features must not appear in barriers
+        auto hasExtension = [&](const char* name) {
+            return std::ranges::any_of(deviceExtensions,
+                                       [name](const char* extension) { return std::strcmp(extension, name) == 0; });
+        };
+
+        m_ShaderStages = vk::PipelineStageFlagBits2::eVertexShader | vk::PipelineStageFlagBits2::eFragmentShader |
+                         vk::PipelineStageFlagBits2::eComputeShader;
+        if (deviceFeatures.geometryShader)
+        {
+            m_ShaderStages |= vk::PipelineStageFlagBits2::eGeometryShader;
+        }
+        if (enableRayTracing)
+        {
+            m_ShaderStages |= vk::PipelineStageFlagBits2::eRayTracingShaderKHR;
+            m_AccelScratchAlignment =
+                getPhysicalDeviceProperties2<vk::PhysicalDeviceAccelerationStructurePropertiesKHR>()
+                    .minAccelerationStructureScratchOffsetAlignment;
+        }
+        if (hasExtension(VK_EXT_MESH_SHADER_EXTENSION_NAME))
+        {
+            m_ShaderStages |= vk::PipelineStageFlagBits2::eTaskShaderEXT | vk::PipelineStageFlagBits2::eMeshShaderEXT;
+        }
+
+        // NOTE: synchronization2 is core in Vulkan 1.3, so the feature decides rather than the extension.
+        // Barriers fall back to vkCmdPipelineBarrier if it is not enabled.
+        m_Synchronization2 = false;
+        for (auto next = static_cast<const vk::BaseInStructure*>(deviceCreateInfoPNext); next; next = next->pNext)
+        {
+            if (next->sType == vk::StructureType::ePhysicalDeviceSynchronization2Features)
+            {
+                m_Synchronization2 =
+                    reinterpret_cast<const vk::PhysicalDeviceSynchronization2Features*>(next)->synchronization2;
+            }
+            else if (next->sType == vk::StructureType::ePhysicalDeviceVulkan13Features)
+            {
+                m_Synchronization2 =
+                    reinterpret_cast<const vk::PhysicalDeviceVulkan13Features*>(next)->synchronization2;
+            }
+        }
+
         spdlog::info("Enabled device extensions:");
         for (const auto& extension : deviceExtensions)
         {
@@ -205,29 +260,47 @@ namespace vulkaninja
 
         // Create descriptor pool
         std::vector<vk::DescriptorPoolSize> poolSizes {
-            {vk::DescriptorType::eSampler, 100},
-            {vk::DescriptorType::eCombinedImageSampler, 100},
-            {vk::DescriptorType::eSampledImage, 100},
-            {vk::DescriptorType::eStorageImage, 100},
-            {vk::DescriptorType::eUniformBuffer, 100},
-            {vk::DescriptorType::eStorageBuffer, 100},
-            {vk::DescriptorType::eInputAttachment, 100},
+            {vk::DescriptorType::eSampler, descriptorPoolSize},
+            {vk::DescriptorType::eCombinedImageSampler, descriptorPoolSize},
+            {vk::DescriptorType::eSampledImage, descriptorPoolSize},
+            {vk::DescriptorType::eStorageImage, descriptorPoolSize},
+            {vk::DescriptorType::eUniformBuffer, descriptorPoolSize},
+            {vk::DescriptorType::eStorageBuffer, descriptorPoolSize},
+            {vk::DescriptorType::eUniformBufferDynamic, descriptorPoolSize},
+            {vk::DescriptorType::eStorageBufferDynamic, descriptorPoolSize},
+            {vk::DescriptorType::eInputAttachment, descriptorPoolSize},
         };
         if (enableRayTracing)
         {
-            poolSizes.emplace_back(vk::DescriptorType::eAccelerationStructureKHR, 100);
+            poolSizes.emplace_back(vk::DescriptorType::eAccelerationStructureKHR, descriptorPoolSize);
         }
 
         vk::DescriptorPoolCreateInfo descriptorPoolCreateInfo;
         descriptorPoolCreateInfo.setPoolSizes(poolSizes);
-        descriptorPoolCreateInfo.setMaxSets(100);
+        descriptorPoolCreateInfo.setMaxSets(descriptorPoolSize);
         descriptorPoolCreateInfo.setFlags(vk::DescriptorPoolCreateFlagBits::eFreeDescriptorSet);
         m_DescriptorPool = m_Device->createDescriptorPoolUnique(descriptorPoolCreateInfo);
     }
 
     auto Context::getQueue(vk::QueueFlags flag) const -> vk::Queue { return getThreadQueue(flag).queue; }
 
-    auto Context::getQueueFamily(vk::QueueFlags flag) const -> uint32_t { return m_QueueFamilies.at(flag); }
+    auto Context::getQueueFamily(vk::QueueFlags flag) const -> uint32_t
+    {
+        return m_QueueFamilies.at(resolveQueueFlags(flag));
+    }
+
+    auto Context::getQueueFamilies() const -> std::vector<uint32_t>
+    {
+        std::vector<uint32_t> queueFamilies;
+        for (const auto& [flag, queueFamily] : m_QueueFamilies)
+        {
+            if (std::find(queueFamilies.begin(), queueFamilies.end(), queueFamily) == queueFamilies.end())
+            {
+                queueFamilies.push_back(queueFamily);
+            }
+        }
+        return queueFamilies;
+    }
 
     auto Context::getCommandPool(vk::QueueFlags flag) const -> vk::CommandPool
     {
@@ -236,6 +309,10 @@ namespace vulkaninja
 
     auto Context::allocateCommandBuffer(vk::QueueFlags flag) const -> CommandBufferHandle
     {
+        // NOTE: Barriers are masked to the stages of the queue that actually runs the commands,
+        // so a Compute command buffer on the General fallback still waits for graphics work.
+        flag = resolveQueueFlags(flag);
+
         vk::CommandPool               commandPool = *getThreadQueue(flag).commandPool;
         vk::CommandBufferAllocateInfo commandBufferInfo;
         commandBufferInfo.setCommandPool(commandPool);
@@ -273,6 +350,46 @@ namespace vulkaninja
         queue.submit(submitInfo, fence ? fence->getFence() : nullptr);
     }
 
+    void Context::submit(CommandBufferHandle         commandBuffer,
+                         ArrayProxy<SubmitSemaphore> waitSemaphores,
+                         ArrayProxy<SubmitSemaphore> signalSemaphores,
+                         FenceHandle                 fence) const
+    {
+        vk::Queue queue = getThreadQueue(commandBuffer->getQueueFlags()).queue;
+
+        std::vector<vk::Semaphore>          waits;
+        std::vector<vk::PipelineStageFlags> waitStages;
+        std::vector<uint64_t>               waitValues;
+        for (const auto& waitSemaphore : waitSemaphores)
+        {
+            waits.push_back(waitSemaphore.semaphore);
+            waitStages.push_back(waitSemaphore.stage);
+            waitValues.push_back(waitSemaphore.value);
+        }
+
+        std::vector<vk::Semaphore> signals;
+        std::vector<uint64_t>      signalValues;
+        for (const auto& signalSemaphore : signalSemaphores)
+        {
+            signals.push_back(signalSemaphore.semaphore);
+            signalValues.push_back(signalSemaphore.value);
+        }
+
+        // NOTE: Values of binary semaphores are ignored, so they can be mixed with timeline semaphores
+        vk::TimelineSemaphoreSubmitInfo timelineInfo;
+        timelineInfo.setWaitSemaphoreValues(waitValues);
+        timelineInfo.setSignalSemaphoreValues(signalValues);
+
+        vk::SubmitInfo submitInfo;
+        submitInfo.setWaitSemaphores(waits);
+        submitInfo.setWaitDstStageMask(waitStages);
+        submitInfo.setCommandBuffers(*commandBuffer->commandBuffer);
+        submitInfo.setSignalSemaphores(signals);
+        submitInfo.setPNext(&timelineInfo);
+
+        queue.submit(submitInfo, fence ? fence->getFence() : nullptr);
+    }
+
     void Context::oneTimeSubmit(const std::function<void(CommandBufferHandle)>& command, vk::QueueFlags flag) const
     {
         CommandBufferHandle commandBuffer = allocateCommandBuffer(flag);
@@ -307,6 +424,71 @@ namespace vulkaninja
         return m_PhysicalDevice.getProperties().limits;
     }
 
+    auto Context::getOrCreateSampler(const SamplerCreateInfo& createInfo) const -> vk::Sampler
+    {
+        std::lock_guard<std::mutex> lock {m_SamplerMutex};
+        if (auto it = m_Samplers.find(createInfo); it != m_Samplers.end())
+        {
+            return *it->second;
+        }
+
+        vk::SamplerCreateInfo samplerInfo;
+        samplerInfo.setMagFilter(createInfo.filter);
+        samplerInfo.setMinFilter(createInfo.filter);
+        samplerInfo.setMipmapMode(createInfo.mipmapMode);
+        samplerInfo.setAddressModeU(createInfo.addressMode);
+        samplerInfo.setAddressModeV(createInfo.addressMode);
+        samplerInfo.setAddressModeW(createInfo.addressMode);
+        samplerInfo.setMipLodBias(createInfo.mipLodBias);
+        samplerInfo.setMinLod(createInfo.minLod);
+        samplerInfo.setMaxLod(createInfo.maxLod);
+        samplerInfo.setBorderColor(createInfo.borderColor);
+        if (m_SamplerAnisotropy && createInfo.maxAnisotropy > 1.0f)
+        {
+            samplerInfo.setAnisotropyEnable(VK_TRUE);
+            samplerInfo.setMaxAnisotropy(
+                std::min(createInfo.maxAnisotropy, getPhysicalDeviceLimits().maxSamplerAnisotropy));
+        }
+        if (createInfo.compareOp.has_value())
+        {
+            samplerInfo.setCompareEnable(VK_TRUE);
+            samplerInfo.setCompareOp(createInfo.compareOp.value());
+        }
+
+        vk::UniqueSampler sampler = getDevice().createSamplerUnique(samplerInfo);
+        return *m_Samplers.emplace(createInfo, std::move(sampler)).first->second;
+    }
+
+    auto Context::acquireScratchBuffer(vk::DeviceSize minSize) const -> BufferHandle
+    {
+        {
+            std::lock_guard<std::mutex> lock {m_ScratchMutex};
+            auto it = std::ranges::find_if(m_ScratchBuffers,
+                                           [&](const BufferHandle& buffer) { return buffer->getSize() >= minSize; });
+            if (it != m_ScratchBuffers.end())
+            {
+                BufferHandle scratchBuffer = *it;
+                m_ScratchBuffers.erase(it);
+                return scratchBuffer;
+            }
+        }
+
+        // NOTE: Most builds share a block, while larger ones get a block of their own size
+        return createBuffer({
+            .usage     = BufferUsage::Scratch,
+            .memory    = MemoryUsage::Device,
+            .size      = std::max(minSize, s_SCRATCH_BLOCK_SIZE),
+            .debugName = "Context::scratchBuffer",
+        });
+    }
+
+    void Context::releaseScratchBuffers(std::vector<BufferHandle>& scratchBuffers) const
+    {
+        std::lock_guard<std::mutex> lock {m_ScratchMutex};
+        m_ScratchBuffers.insert(m_ScratchBuffers.end(), scratchBuffers.begin(), scratchBuffers.end());
+        scratchBuffers.clear();
+    }
+
     auto Context::createShader(const ShaderCreateInfo& createInfo) const -> ShaderHandle
     {
         return std::make_shared<Shader>(*this, createInfo);
@@ -336,7 +518,12 @@ namespace vulkaninja
     auto
     Context::createRayTracingPipeline(const RayTracingPipelineCreateInfo& createInfo) const -> RayTracingPipelineHandle
     {
-        return std::make_shared<RayTracingPipeline>(*this, createInfo);
+        auto pipeline = std::make_shared<RayTracingPipeline>(*this, createInfo);
+        if (!pipeline->isLibrary())
+        {
+            pipeline->m_SBT = createShaderBindingTable({.pipeline = pipeline});
+        }
+        return pipeline;
     }
 
     auto Context::createImage(const ImageCreateInfo& createInfo) const -> ImageHandle
@@ -369,6 +556,48 @@ namespace vulkaninja
         return std::make_shared<Fence>(*this, createInfo);
     }
 
+    auto Context::createSemaphore(const SemaphoreCreateInfo& createInfo) const -> SemaphoreHandle
+    {
+        return std::make_shared<Semaphore>(*this, createInfo);
+    }
+
+    auto Context::createFrameUniformAllocator(const FrameUniformAllocatorCreateInfo& createInfo) const
+        -> FrameUniformAllocatorHandle
+    {
+        return std::make_shared<FrameUniformAllocator>(*this, createInfo);
+    }
+
+    auto Context::createRenderGraph(const RenderGraphCreateInfo& createInfo) const -> RenderGraphHandle
+    {
+        return std::make_shared<RenderGraph>(*this, createInfo);
+    }
+
+    auto Context::createGPUCulling(const GPUCullingCreateInfo& createInfo) const -> GPUCullingHandle
+    {
+        return std::make_shared<GPUCulling>(*this, createInfo);
+    }
+
+    auto Context::createDepthPyramid(const DepthPyramidCreateInfo& createInfo) const -> DepthPyramidHandle
+    {
+        return std::make_shared<DepthPyramid>(*this, createInfo);
+    }
+
+    auto Context::createMipGenerator(const MipGeneratorCreateInfo& createInfo) const -> MipGeneratorHandle
+    {
+        return std::make_shared<MipGenerator>(*this, createInfo);
+    }
+
+    auto Context::createShaderBindingTable(const ShaderBindingTableCreateInfo& createInfo) const
+        -> ShaderBindingTableHandle
+    {
+        return std::make_shared<ShaderBindingTable>(*this, createInfo);
+    }
+
+    auto Context::createAccelCompactor(const AccelCompactorCreateInfo& createInfo) const -> AccelCompactorHandle
+    {
+        return std::make_shared<AccelCompactor>(*this, createInfo);
+    }
+
     void Context::checkDeviceExtensionSupport(const std::vector<const char*>& requiredExtensions) const
     {
         std::vector<vk::ExtensionProperties> availableExtensions =
@@ -398,7 +627,7 @@ namespace vulkaninja
         std::lock_guard<std::mutex> lock(m_QueueMutex);
 
         // Find used queue
-        auto& matchedQueues = m_Queues.at(flag);
+        auto& matchedQueues = m_Queues.at(resolveQueueFlags(flag));
         for (auto& queue : matchedQueues)
         {
             if (queue.tid == tid)
@@ -425,4 +654,10 @@ namespace vulkaninja
         // Not found
         throw std::runtime_error("Failed to get new queue.");
     }
+
+    auto Context::resolveQueueFlags(vk::QueueFlags flag) const -> vk::QueueFlags
+    {
+        // Devices without a dedicated family run compute and transfer work on the General queue
+        return m_Queues.contains(flag) ? flag : QueueFlags::General;
+    }
 } // namespace vulkaninja
\ No newline at end of file
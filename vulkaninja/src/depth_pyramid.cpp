@@ -0,0 +1,289 @@
+#include "vulkaninja/depth_pyramid.hpp"
+#include "vulkaninja/buffer.hpp"
+#include "vulkaninja/command_buffer.hpp"
+#include "vulkaninja/common.hpp"
+#include "vulkaninja/descriptor_set.hpp"
+#include "vulkaninja/image.hpp"
+#include "vulkaninja/pipeline.hpp"
+#include "vulkaninja/shader.hpp"
+
+#include <algorithm>
+#include <bit>
+
+namespace
+{
+    // Single pass downsampler in the style of FidelityFX SPD.
+    // Each workgroup reduces a 64x64 tile to level 6, levels 3-6 through shared memory,
+    // and the last workgroup to increment the counter reduces the levels left.
+    // NOTE: Levels index the image array as literals, so no dynamic indexing feature is needed.
+    const std::string pyramidCode = R"(
+#version 460
+#extension GL_EXT_buffer_reference : require
+
+layout(local_size_x = 256) in;
+
+layout(binding = 0) uniform sampler2D depthImage;
+layout(binding = 1, r32f) uniform coherent image2D pyramid[MAX_LEVELS];
+
+layout(buffer_reference, std430) coherent buffer Counter { uint counter; };
+
+layout(push_constant) uniform PushConstants {
+    Counter counterBuffer;
+    ivec2   depthSize;
+    uint    groupCount;
+    int     levelCount;
+};
+
+#ifdef REDUCE_MAX
+#define NEUTRAL 0.0
+#define REDUCE(a, b) max(a, b)
+#else
+#define NEUTRAL 1.0
+#define REDUCE(a, b) min(a, b)
+#endif
+
+shared float tile[16][16];
+shared bool  isLastGroup;
+
+float reduce4(float a, float b, float c, float d)
+{
+    return REDUCE(REDUCE(a, b), REDUCE(c, d));
+}
+
+// Sizes are rounded up so that texels on odd edges are not dropped
+ivec2 getLevelSize(int level)
+{
+    return (depthSize + (1 << level) - 1) >> level;
+}
+
+bool isInside(ivec2 texel, int level)
+{
+    return all(lessThan(texel, getLevelSize(level)));
+}
+
+#define STORE(LEVEL, TEXEL, VALUE)                      \
+    if (LEVEL < levelCount && isInside(TEXEL, LEVEL)) { \
+        imageStore(pyramid[LEVEL], TEXEL, vec4(VALUE)); \
+    }
+
+#define LOAD(LEVEL, TEXEL) (isInside(TEXEL, LEVEL) ? imageLoad(pyramid[LEVEL], TEXEL).r : NEUTRAL)
+
+// Reduces 2x2 values of the tile into its top-left SIZE x SIZE corner
+#define REDUCE_TILE(LEVEL, SIZE)                                                        \
+    {                                                                                   \
+        ivec2 p     = ivec2(index % SIZE, index / SIZE);                                \
+        float value = NEUTRAL;                                                          \
+        if (index < SIZE * SIZE) {                                                      \
+            value = reduce4(tile[p.y * 2][p.x * 2], tile[p.y * 2][p.x * 2 + 1],         \
+                            tile[p.y * 2 + 1][p.x * 2], tile[p.y * 2 + 1][p.x * 2 + 1]); \
+            STORE(LEVEL, ivec2(gl_WorkGroupID.xy) * SIZE + p, value)                    \
+        }                                                                               \
+        barrier();                                                                      \
+        if (index < SIZE * SIZE) {                                                      \
+            tile[p.y][p.x] = value;                                                     \
+        }                                                                               \
+        barrier();                                                                      \
+    }
+
+// Reduces a whole level from the previous one, written by any workgroup
+#define REDUCE_LEVEL(LEVEL)                                                \
+    if (LEVEL < levelCount) {                                              \
+        ivec2 size = getLevelSize(LEVEL);                                  \
+        for (int i = index; i < size.x * size.y; i += 256) {               \
+            ivec2 p = ivec2(i % size.x, i / size.x);                       \
+            ivec2 q = p * 2;                                               \
+            float a = LOAD(LEVEL - 1, q);                                  \
+            float b = LOAD(LEVEL - 1, q + ivec2(1, 0));                    \
+            float c = LOAD(LEVEL - 1, q + ivec2(0, 1));                    \
+            float d = LOAD(LEVEL - 1, q + ivec2(1, 1));                    \
+            imageStore(pyramid[LEVEL], p, vec4(reduce4(a, b, c, d)));      \
+        }                                                                  \
+        memoryBarrierImage();                                              \
+        barrier();                                                         \
+    }
+
+void main()
+{
+    int   index = int(gl_LocalInvocationIndex);
+    ivec2 base  = ivec2(gl_WorkGroupID.xy) * 64 + ivec2(index % 16, index / 16) * 4;
+
+    // Levels 0-2: 4x4 depth texels per invocation
+    float quads[4];
+    for (int q = 0; q < 4; q++) {
+        ivec2 quad = base + ivec2(q & 1, q >> 1) * 2;
+        float depths[4];
+        for (int i = 0; i < 4; i++) {
+            ivec2 texel = quad + ivec2(i & 1, i >> 1);
+            depths[i]   = NEUTRAL;
+            if (isInside(texel, 0)) {
+                depths[i] = texelFetch(depthImage, texel, 0).r;
+                imageStore(pyramid[0], texel, vec4(depths[i]));
+            }
+        }
+        quads[q] = reduce4(depths[0], depths[1], depths[2], depths[3]);
+        STORE(1, quad / 2, quads[q])
+    }
+    float value = reduce4(quads[0], quads[1], quads[2], quads[3]);
+    STORE(2, base / 4, value)
+    tile[index / 16][index % 16] = value;
+    barrier();
+
+    // Levels 3-6 from shared memory
+    REDUCE_TILE(3, 8)
+    REDUCE_TILE(4, 4)
+    REDUCE_TILE(5, 2)
+    REDUCE_TILE(6, 1)
+
+    if (levelCount <= 7) {
+        return;
+    }
+
+    // Level 6 must be visible to the last workgroup before it is counted
+    memoryBarrierImage();
+    barrier();
+    if (index == 0) {
+        isLastGroup = atomicAdd(counterBuffer.counter, 1) == groupCount - 1;
+    }
+    barrier();
+    if (!isLastGroup) {
+        return;
+    }
+
+    REDUCE_LEVEL(7)
+    REDUCE_LEVEL(8)
+    REDUCE_LEVEL(9)
+    REDUCE_LEVEL(10)
+    REDUCE_LEVEL(11)
+    REDUCE_LEVEL(12)
+
+    // Ready for the next build
+    if (index == 0) {
+        counterBuffer.counter = 0;
+    }
+}
+)";
+
+    struct PyramidPushConstants
+    {
+        vk::DeviceAddress counterBuffer;
+        int32_t           depthWidth;
+        int32_t           depthHeight;
+        uint32_t          groupCount;
+        int32_t           levelCount;
+    };
+} // namespace
+
+namespace vulkaninja
+{
+    DepthPyramid::DepthPyramid(const Context& context, const DepthPyramidCreateInfo& createInfo) :
+        m_Context {&context}, m_Reduction {createInfo.reduction}, m_DepthImage {createInfo.depthImage}
+    {
+        VKN_ASSERT(m_DepthImage && m_DepthImage->getView(), "depthImage must have a view.");
+
+        // NOTE: Padded to a power of two so that each level can hold the rounded up size of the previous one.
+        // Texels past getLevelSize() are neither written nor read.
+        vk::Extent3D depthExtent = m_DepthImage->getExtent();
+        m_DepthExtent            = {depthExtent.width, depthExtent.height};
+
+        uint32_t width      = std::bit_ceil(depthExtent.width);
+        uint32_t height     = std::bit_ceil(depthExtent.height);
+        uint32_t levelCount = static_cast<uint32_t>(std::countr_zero(std::max(width, height))) + 1;
+        levelCount          = std::min(levelCount, s_MAX_LEVELS);
+
+        m_Image = m_Context->createImage({
+            .usage     = vk::ImageUsageFlagBits::eStorage | vk::ImageUsageFlagBits::eSampled,
+            .extent    = {width, height, 1},
+            .format    = vk::Format::eR32Sfloat,
+            .mipLevels = levelCount,
+            .viewInfo  = ImageViewCreateInfo {},
+            .samplerInfo =
+                SamplerCreateInfo {
+                    .filter      = vk::Filter::eNearest,
+                    .addressMode = vk::SamplerAddressMode::eClampToEdge,
+                    .mipmapMode  = vk::SamplerMipmapMode::eNearest,
+                },
+            .debugName = createInfo.debugName,
+        });
+
+        for (uint32_t level = 0; level < levelCount; level++)
+        {
+            vk::ImageViewCreateInfo viewInfo;
+            viewInfo.setImage(m_Image->getImage());
+            viewInfo.setViewType(vk::ImageViewType::e2D);
+            viewInfo.setFormat(vk::Format::eR32Sfloat);
+            viewInfo.setSubresourceRange({vk::ImageAspectFlagBits::eColor, level, 1, 0, 1});
+            m_LevelViews.push_back(m_Context->getDevice().createImageViewUnique(viewInfo));
+        }
+
+        m_CounterBuffer = m_Context->createBuffer({
+            .usage     = BufferUsage::Storage,
+            .memory    = MemoryUsage::Device,
+            .size      = sizeof(uint32_t),
+            .debugName = createInfo.debugName + "::counterBuffer",
+        });
+        m_Context->oneTimeSubmit(
+            [&](CommandBufferHandle commandBuffer) { commandBuffer->fillBuffer(m_CounterBuffer, 0); });
+
+        std::vector<std::variant<std::string, std::tuple<std::string, std::string>>> keywords;
+        keywords.emplace_back(std::tuple<std::string, std::string> {"MAX_LEVELS", std::to_string(s_MAX_LEVELS)});
+        if (m_Reduction == DepthReduction::eMax)
+        {
+            keywords.emplace_back("REDUCE_MAX");
+        }
+        m_Shader = Shader::createComputeShader(*m_Context, pyramidCode, "DepthPyramid.comp", keywords);
+
+        m_DescSet = m_Context->createDescriptorSet({
+            .shaders = {m_Shader},
+            .images  = {{"pyramid", s_MAX_LEVELS}},
+        });
+        m_Pipeline = m_Context->createComputePipeline({
+            .descSetLayouts = m_DescSet->getLayouts(),
+            .pushSize       = sizeof(PyramidPushConstants),
+            .computeShader  = m_Shader,
+        });
+
+        // NOTE: Written directly with the layouts declared by build(), since neither image is in them yet.
+        // Unused array elements repeat the last level.
+        vk::DescriptorImageInfo depthInfo {
+            m_Image->getSampler(), m_DepthImage->getView(), vk::ImageLayout::eShaderReadOnlyOptimal};
+        std::vector<vk::DescriptorImageInfo> levelInfos;
+        for (uint32_t level = 0; level < s_MAX_LEVELS; level++)
+        {
+            levelInfos.push_back({{}, *m_LevelViews[std::min(level, levelCount - 1)], vk::ImageLayout::eGeneral});
+        }
+
+        std::array<vk::WriteDescriptorSet, 2> writes;
+        writes[0].setDstSet(m_DescSet->getDescriptorSet());
+        writes[0].setDstBinding(0);
+        writes[0].setDescriptorType(vk::DescriptorType::eCombinedImageSampler);
+        writes[0].setImageInfo(depthInfo);
+        writes[1].setDstSet(m_DescSet->getDescriptorSet());
+        writes[1].setDstBinding(1);
+        writes[1].setDescriptorType(vk::DescriptorType::eStorageImage);
+        writes[1].setImageInfo(levelInfos);
+        m_Context->getDevice().updateDescriptorSets(writes, {});
+
+        m_GroupCountX = (depthExtent.width + 63) / 64;
+        m_GroupCountY = (depthExtent.height + 63) / 64;
+    }
+
+    void DepthPyramid::build(const CommandBuffer& commandBuffer) const
+    {
+        commandBuffer.declareUsage(m_DepthImage, ResourceUsage::eShaderRead);
+        commandBuffer.declareUsage(m_Image, ResourceUsage::eShaderWrite);
+        commandBuffer.declareUsage(m_CounterBuffer, ResourceUsage::eShaderReadWrite);
+
+        PyramidPushConstants pushConstants {
+            .counterBuffer = m_CounterBuffer->getAddress(),
+            .depthWidth    = static_cast<int32_t>(m_DepthExtent[0]),
+            .depthHeight   = static_cast<int32_t>(m_DepthExtent[1]),
+            .groupCount    = m_GroupCountX * m_GroupCountY,
+            .levelCount    = static_cast<int32_t>(m_Image->getMipLevels()),
+        };
+
+        commandBuffer.bindPipeline(m_Pipeline);
+        commandBuffer.bindDescriptorSet(m_Pipeline, m_DescSet);
+        commandBuffer.pushConstants(m_Pipeline, &pushConstants);
+        commandBuffer.dispatch(m_GroupCountX, m_GroupCountY, 1);
+    }
+} // namespace vulkaninja
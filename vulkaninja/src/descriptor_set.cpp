@@ -1,21 +1,71 @@
 #include "vulkaninja/descriptor_set.hpp"
 #include "vulkaninja/accel.hpp"
 #include "vulkaninja/buffer.hpp"
+#include "vulkaninja/common.hpp"
 
+#include <algorithm>
+#include <cstring>
 #include <ranges>
 #include <stdexcept>
 #include <vector>
 
+namespace
+{
+    // Overwrite infos in place so that repeated set() calls reuse the existing storage.
+    // Returns true if any info was changed.
+    template<typename Info, typename Handle, typename GetInfo>
+    auto assignInfos(std::vector<Info>& infos, vulkaninja::ArrayProxy<Handle> handles, GetInfo getInfo) -> bool
+    {
+        bool changed = infos.size() != handles.size();
+        infos.resize(handles.size());
+        for (uint32_t i = 0; i < handles.size(); i++)
+        {
+            Info info = getInfo(handles[i]);
+            if (infos[i] != info)
+            {
+                infos[i] = info;
+                changed  = true;
+            }
+        }
+        return changed;
+    }
+} // namespace
+
 namespace vulkaninja
 {
     DescriptorSet::DescriptorSet(const Context& context, const DescriptorSetCreateInfo& createInfo) :
-        m_Context {&context}
+        m_Context {&context}, m_PushDescriptorSet {createInfo.pushDescriptorSet}
     {
         for (const auto& shader : createInfo.shaders)
         {
             addResources(shader);
         }
 
+        for (const char* name : createInfo.dynamicBuffers)
+        {
+            VKN_ASSERT(m_Descriptors.contains(name), "Dynamic buffer {} is not found in the shaders.", name);
+
+            // NOTE: Push descriptor set layouts must not contain dynamic uniform/storage buffers
+            VKN_ASSERT(m_Descriptors[name].set != m_PushDescriptorSet,
+                       "Dynamic buffer {} cannot be in the push descriptor set {}.",
+                       name,
+                       m_Descriptors[name].set);
+
+            auto& binding = m_Descriptors[name].binding;
+            if (binding.descriptorType == vk::DescriptorType::eUniformBuffer)
+            {
+                binding.setDescriptorType(vk::DescriptorType::eUniformBufferDynamic);
+            }
+            else if (binding.descriptorType == vk::DescriptorType::eStorageBuffer)
+            {
+                binding.setDescriptorType(vk::DescriptorType::eStorageBufferDynamic);
+            }
+            else
+            {
+                throw std::runtime_error("Only uniform and storage buffers can be dynamic.");
+            }
+        }
+
         for (const auto& [name, buffers] : createInfo.buffers)
         {
             if (std::holds_alternative<uint32_t>(buffers))
@@ -50,94 +100,386 @@ namespace vulkaninja
             }
         }
 
-        std::vector<vk::DescriptorSetLayoutBinding> bindings;
+        // One layout per set decoration
+        // NOTE: Unused set indices get an empty layout since pipeline layouts cannot have holes.
+        uint32_t setCount = m_PushDescriptorSet.value_or(0) + 1;
         for (const auto& descriptor : m_Descriptors | std::views::values)
         {
-            bindings.push_back(descriptor.binding);
+            setCount = std::max(setCount, descriptor.set + 1);
         }
+        m_Sets.resize(setCount);
+        m_Layouts.resize(setCount);
 
-        vk::DescriptorSetLayoutCreateInfo layoutInfo({}, bindings);
-        m_DescSetLayout = m_Context->getDevice().createDescriptorSetLayoutUnique(layoutInfo);
+        std::vector<vk::DescriptorSetLayout> allocLayouts;
+        std::vector<uint32_t>                allocSets;
+        for (uint32_t set = 0; set < setCount; set++)
+        {
+            std::vector<vk::DescriptorSetLayoutBinding> bindings;
+            for (const auto& descriptor : m_Descriptors | std::views::values)
+            {
+                if (descriptor.set == set)
+                {
+                    bindings.push_back(descriptor.binding);
+                }
+            }
+
+            vk::DescriptorSetLayoutCreateInfo layoutInfo({}, bindings);
+            if (set == m_PushDescriptorSet)
+            {
+                layoutInfo.setFlags(vk::DescriptorSetLayoutCreateFlagBits::ePushDescriptorKHR);
+            }
+            m_Sets[set].layout = m_Context->getDevice().createDescriptorSetLayoutUnique(layoutInfo);
+            m_Layouts[set]     = *m_Sets[set].layout;
+
+            if (set != m_PushDescriptorSet && (createInfo.sets.empty() || createInfo.sets.contains(set)))
+            {
+                allocLayouts.push_back(m_Layouts[set]);
+                allocSets.push_back(set);
+            }
+        }
 
-        vk::DescriptorSetAllocateInfo allocInfo(m_Context->getDescriptorPool(), *m_DescSetLayout);
-        m_DescSet = std::move(m_Context->getDevice().allocateDescriptorSetsUnique(allocInfo).front());
+        if (allocLayouts.empty())
+        {
+            return;
+        }
+
+        vk::DescriptorSetAllocateInfo allocInfo(m_Context->getDescriptorPool(), allocLayouts);
+        auto descSets = m_Context->getDevice().allocateDescriptorSetsUnique(allocInfo);
+        for (uint32_t i = 0; i < allocSets.size(); i++)
+        {
+            m_Sets[allocSets[i]].descSet = std::move(descSets[i]);
+        }
     }
 
     void DescriptorSet::update()
     {
-        std::vector<vk::WriteDescriptorSet> descriptorWrites;
+        for (uint32_t set = 0; set < m_Sets.size(); set++)
+        {
+            // NOTE: Push descriptors are written at record time
+            if (!m_Sets[set].descSet)
+            {
+                continue;
+            }
 
-        for (const auto& [binding, infos] : m_Descriptors | std::views::values)
+            uint32_t bindingCount = 0;
+            uint32_t dirtyCount   = 0;
+            for (const auto& descriptor : m_Descriptors | std::views::values)
+            {
+                if (descriptor.set == set)
+                {
+                    bindingCount++;
+                    dirtyCount += descriptor.dirty ? 1 : 0;
+                }
+            }
+            if (dirtyCount == 0)
+            {
+                continue;
+            }
+
+            // NOTE: If most bindings have changed (e.g. the first update),
+            // one templated update over the packed data is cheaper than building a write per binding.
+            if (!m_Sets[set].updateTemplate || dirtyCount * 2 > bindingCount)
+            {
+                updateWithTemplate(set);
+            }
+            else
+            {
+                updateDirtyBindings(set);
+            }
+
+            for (auto& descriptor : m_Descriptors | std::views::values)
+            {
+                if (descriptor.set == set)
+                {
+                    descriptor.dirty = false;
+                }
+            }
+        }
+    }
+
+    auto DescriptorSet::getLayout(uint32_t set) const -> vk::DescriptorSetLayout
+    {
+        VKN_ASSERT(set < m_Sets.size(), "Set {} is out of range {}.", set, m_Sets.size());
+        return *m_Sets[set].layout;
+    }
+
+    auto DescriptorSet::getDescriptorSet(uint32_t set) const -> vk::DescriptorSet
+    {
+        VKN_ASSERT(set < m_Sets.size(), "Set {} is out of range {}.", set, m_Sets.size());
+        return *m_Sets[set].descSet;
+    }
+
+    auto DescriptorSet::getPushWrites() -> const std::vector<vk::WriteDescriptorSet>&
+    {
+        VKN_ASSERT(m_PushDescriptorSet.has_value(), "This descriptor set has no push descriptor set.");
+
+        bool dirty = m_PushWrites.empty();
+        for (auto& descriptor : m_Descriptors | std::views::values)
         {
-            if (std::holds_alternative<BufferInfos>(infos))
+            if (descriptor.set == m_PushDescriptorSet)
             {
-                const auto&            bufferInfos = std::get<BufferInfos>(infos);
-                vk::WriteDescriptorSet descriptorWrite;
-                descriptorWrite.setBufferInfo(bufferInfos);
-                descriptorWrite.setDescriptorCount(static_cast<uint32_t>(bufferInfos.size()));
-                descriptorWrite.setDescriptorType(binding.descriptorType);
-                descriptorWrite.setDstBinding(binding.binding);
-                descriptorWrite.setDstSet(*m_DescSet);
-                descriptorWrites.push_back(descriptorWrite);
+                dirty |= descriptor.dirty;
+                descriptor.dirty = false;
             }
-            else if (std::holds_alternative<ImageInfos>(infos))
+        }
+        if (!dirty)
+        {
+            return m_PushWrites;
+        }
+
+        // Reuse the storage, the writes point into the infos of m_Descriptors
+        m_PushWrites.clear();
+        m_PushAccelWrites.clear();
+        m_PushAccelWrites.reserve(m_Descriptors.size());
+        for (const auto& descriptor : m_Descriptors | std::views::values)
+        {
+            if (descriptor.set != m_PushDescriptorSet)
             {
-                const auto&            imageInfos = std::get<ImageInfos>(infos);
-                vk::WriteDescriptorSet descriptorWrite;
-                descriptorWrite.setImageInfo(imageInfos);
-                descriptorWrite.setDescriptorCount(static_cast<uint32_t>(imageInfos.size()));
-                descriptorWrite.setDescriptorType(binding.descriptorType);
-                descriptorWrite.setDstBinding(binding.binding);
-                descriptorWrite.setDstSet(*m_DescSet);
-                descriptorWrites.push_back(descriptorWrite);
+                continue;
             }
-            else if (std::holds_alternative<AccelInfos>(infos))
+
+            vk::WriteDescriptorSet descriptorWrite;
+            descriptorWrite.setDescriptorType(descriptor.binding.descriptorType);
+            descriptorWrite.setDstBinding(descriptor.binding.binding);
+            if (std::holds_alternative<BufferInfos>(descriptor.infos))
+            {
+                descriptorWrite.setBufferInfo(std::get<BufferInfos>(descriptor.infos));
+            }
+            else if (std::holds_alternative<ImageInfos>(descriptor.infos))
+            {
+                descriptorWrite.setImageInfo(std::get<ImageInfos>(descriptor.infos));
+            }
+            else if (std::holds_alternative<AccelInfos>(descriptor.infos))
             {
-                const auto&            accelInfos = std::get<AccelInfos>(infos);
-                vk::WriteDescriptorSet descriptorWrite;
+                const auto& accelInfos = std::get<AccelInfos>(descriptor.infos);
+                m_PushAccelWrites.push_back(
+                    vk::WriteDescriptorSetAccelerationStructureKHR().setAccelerationStructures(accelInfos));
                 descriptorWrite.setDescriptorCount(static_cast<uint32_t>(accelInfos.size()));
-                descriptorWrite.setDescriptorType(binding.descriptorType);
-                descriptorWrite.setDstBinding(binding.binding);
-                descriptorWrite.setDstSet(*m_DescSet);
-                descriptorWrite.setPNext(accelInfos.data());
-                descriptorWrites.push_back(descriptorWrite);
+                descriptorWrite.setPNext(&m_PushAccelWrites.back());
+            }
+            if (descriptorWrite.descriptorCount > 0)
+            {
+                m_PushWrites.push_back(descriptorWrite);
             }
         }
-
-        m_Context->getDevice().updateDescriptorSets(descriptorWrites, nullptr);
+        return m_PushWrites;
     }
 
     void DescriptorSet::set(const std::string& name, ArrayProxy<BufferHandle> buffers)
     {
-        std::vector<vk::DescriptorBufferInfo> bufferInfos;
-        for (const auto& buffer : buffers)
+        auto& descriptor = m_Descriptors[name];
+        if (!std::holds_alternative<BufferInfos>(descriptor.infos))
         {
-            bufferInfos.push_back(buffer->getInfo());
+            descriptor.infos = BufferInfos {};
+        }
+        auto& bufferInfos  = std::get<BufferInfos>(descriptor.infos);
+        bool  countChanged = bufferInfos.size() != buffers.size();
+        bool  changed      = assignInfos(bufferInfos, buffers, [](const BufferHandle& buffer) {
+            return buffer->getInfo();
+        });
+
+        descriptor.binding.descriptorCount = buffers.size();
+        if (changed)
+        {
+            markDirty(descriptor, countChanged);
+        }
+    }
+
+    void DescriptorSet::set(const std::string& name, BufferHandle buffer, vk::DeviceSize range)
+    {
+        VKN_ASSERT(range <= buffer->getSize(), "range exceeds the buffer size. {} > {}", range, buffer->getSize());
+
+        auto& descriptor = m_Descriptors[name];
+        if (!std::holds_alternative<BufferInfos>(descriptor.infos))
+        {
+            descriptor.infos = BufferInfos {};
+        }
+        auto& bufferInfos  = std::get<BufferInfos>(descriptor.infos);
+        bool  countChanged = bufferInfos.size() != 1;
+
+        vk::DescriptorBufferInfo bufferInfo {buffer->getBuffer(), 0, range};
+        if (countChanged || bufferInfos[0] != bufferInfo)
+        {
+            bufferInfos                        = {bufferInfo};
+            descriptor.binding.descriptorCount = 1;
+            markDirty(descriptor, countChanged);
         }
-        m_Descriptors[name].binding.descriptorCount = buffers.size();
-        m_Descriptors[name].infos                   = bufferInfos;
     }
 
     void DescriptorSet::set(const std::string& name, ArrayProxy<ImageHandle> images)
     {
-        ImageInfos imageInfos;
-        for (const auto& image : images)
+        auto& descriptor = m_Descriptors[name];
+        if (!std::holds_alternative<ImageInfos>(descriptor.infos))
+        {
+            descriptor.infos = ImageInfos {};
+        }
+        auto& imageInfos   = std::get<ImageInfos>(descriptor.infos);
+        bool  countChanged = imageInfos.size() != images.size();
+        bool  changed      = assignInfos(imageInfos, images, [](const ImageHandle& image) {
+            return image->getInfo();
+        });
+
+        descriptor.binding.descriptorCount = images.size();
+        if (changed)
         {
-            imageInfos.push_back(image->getInfo());
+            markDirty(descriptor, countChanged);
         }
-        m_Descriptors[name].binding.descriptorCount = images.size();
-        m_Descriptors[name].infos                   = imageInfos;
     }
 
     void DescriptorSet::set(const std::string& name, ArrayProxy<TopAccelHandle> accels)
     {
-        AccelInfos accelInfos;
-        for (const auto& accel : accels)
+        auto& descriptor = m_Descriptors[name];
+        if (!std::holds_alternative<AccelInfos>(descriptor.infos))
+        {
+            descriptor.infos = AccelInfos {};
+        }
+        auto& accelInfos   = std::get<AccelInfos>(descriptor.infos);
+        bool  countChanged = accelInfos.size() != accels.size();
+        bool  changed      = assignInfos(accelInfos, accels, [](const TopAccelHandle& accel) {
+            return accel->getAccel();
+        });
+
+        descriptor.binding.descriptorCount = accels.size();
+        if (changed)
+        {
+            markDirty(descriptor, countChanged);
+        }
+    }
+
+    void DescriptorSet::markDirty(Descriptor& descriptor, bool countChanged)
+    {
+        descriptor.dirty = true;
+
+        // Template entries hold descriptor counts, so they must be rebuilt
+        if (countChanged && descriptor.set < m_Sets.size())
+        {
+            m_Sets[descriptor.set].updateTemplate.reset();
+        }
+    }
+
+    void DescriptorSet::createUpdateTemplate(uint32_t set)
+    {
+        std::vector<vk::DescriptorUpdateTemplateEntry> entries;
+
+        size_t dataSize = 0;
+        for (auto& descriptor : m_Descriptors | std::views::values)
+        {
+            if (descriptor.set != set)
+            {
+                continue;
+            }
+
+            size_t   stride = 0;
+            uint32_t count  = 0;
+            std::visit(
+                [&](const auto& infos) {
+                    stride = sizeof(typename std::decay_t<decltype(infos)>::value_type);
+                    count  = static_cast<uint32_t>(infos.size());
+                },
+                descriptor.infos);
+            if (count == 0)
+            {
+                continue;
+            }
+
+            descriptor.templateOffset = dataSize;
+            dataSize += stride * count;
+
+            vk::DescriptorUpdateTemplateEntry entry;
+            entry.setDstBinding(descriptor.binding.binding);
+            entry.setDstArrayElement(0);
+            entry.setDescriptorCount(count);
+            entry.setDescriptorType(descriptor.binding.descriptorType);
+            entry.setOffset(descriptor.templateOffset);
+            entry.setStride(stride);
+            entries.push_back(entry);
+
+            // Every binding has to be repacked at its new offset
+            descriptor.dirty = true;
+        }
+        m_Sets[set].templateData.resize(dataSize);
+
+        vk::DescriptorUpdateTemplateCreateInfo templateInfo;
+        templateInfo.setDescriptorUpdateEntries(entries);
+        templateInfo.setTemplateType(vk::DescriptorUpdateTemplateType::eDescriptorSet);
+        templateInfo.setDescriptorSetLayout(*m_Sets[set].layout);
+        m_Sets[set].updateTemplate = m_Context->getDevice().createDescriptorUpdateTemplateUnique(templateInfo);
+    }
+
+    void DescriptorSet::updateWithTemplate(uint32_t set)
+    {
+        if (!m_Sets[set].updateTemplate)
+        {
+            createUpdateTemplate(set);
+        }
+
+        // Pack only the changed bindings, the rest of the data is still valid from the previous update
+        for (const auto& descriptor : m_Descriptors | std::views::values)
+        {
+            if (descriptor.set != set || !descriptor.dirty)
+            {
+                continue;
+            }
+            packInfos(descriptor);
+        }
+
+        m_Context->getDevice().updateDescriptorSetWithTemplate(
+            *m_Sets[set].descSet, *m_Sets[set].updateTemplate, m_Sets[set].templateData.data());
+    }
+
+    void DescriptorSet::updateDirtyBindings(uint32_t set)
+    {
+        std::vector<vk::WriteDescriptorSet>                         descriptorWrites;
+        std::vector<vk::WriteDescriptorSetAccelerationStructureKHR> accelWrites;
+        descriptorWrites.reserve(m_Descriptors.size());
+        accelWrites.reserve(m_Descriptors.size());
+
+        for (const auto& descriptor : m_Descriptors | std::views::values)
         {
-            accelInfos.push_back(accel->getInfo());
+            if (descriptor.set != set || !descriptor.dirty)
+            {
+                continue;
+            }
+
+            vk::WriteDescriptorSet descriptorWrite;
+            descriptorWrite.setDescriptorType(descriptor.binding.descriptorType);
+            descriptorWrite.setDstBinding(descriptor.binding.binding);
+            descriptorWrite.setDstSet(*m_Sets[set].descSet);
+            if (std::holds_alternative<BufferInfos>(descriptor.infos))
+            {
+                descriptorWrite.setBufferInfo(std::get<BufferInfos>(descriptor.infos));
+            }
+            else if (std::holds_alternative<ImageInfos>(descriptor.infos))
+            {
+                descriptorWrite.setImageInfo(std::get<ImageInfos>(descriptor.infos));
+            }
+            else if (std::holds_alternative<AccelInfos>(descriptor.infos))
+            {
+                const auto& accelInfos = std::get<AccelInfos>(descriptor.infos);
+                accelWrites.push_back(
+                    vk::WriteDescriptorSetAccelerationStructureKHR().setAccelerationStructures(accelInfos));
+                descriptorWrite.setDescriptorCount(static_cast<uint32_t>(accelInfos.size()));
+                descriptorWrite.setPNext(&accelWrites.back());
+            }
+            descriptorWrites.push_back(descriptorWrite);
+
+            // Keep the packed data in sync for the next templated update
+            packInfos(descriptor);
         }
-        m_Descriptors[name].binding.descriptorCount = accels.size();
-        m_Descriptors[name].infos                   = accelInfos;
+
+        m_Context->getDevice().updateDescriptorSets(descriptorWrites, nullptr);
+    }
+
+    void DescriptorSet::packInfos(const Descriptor& descriptor)
+    {
+        auto& templateData = m_Sets[descriptor.set].templateData;
+        std::visit(
+            [&](const auto& infos) {
+                using Info = typename std::decay_t<decltype(infos)>::value_type;
+                std::memcpy(
+                    templateData.data() + descriptor.templateOffset, infos.data(), infos.size() * sizeof(Info));
+            },
+            descriptor.infos);
     }
 
     void DescriptorSet::addResources(ShaderHandle shader)
@@ -175,17 +517,23 @@ namespace vulkaninja
     {
         if (m_Descriptors.contains(resource.name))
         {
-            auto& binding = m_Descriptors[resource.name].binding;
+            auto& descriptor = m_Descriptors[resource.name];
+            auto& binding    = descriptor.binding;
             if (binding.binding != glsl.get_decoration(resource.id, spv::DecorationBinding))
             {
                 throw std::runtime_error("binding does not match.");
             }
+            if (descriptor.set != glsl.get_decoration(resource.id, spv::DecorationDescriptorSet))
+            {
+                throw std::runtime_error("set does not match.");
+            }
             binding.stageFlags |= stage;
         }
         else
         {
             // FIX: If the count is 1 here, it cannot be increased later
             m_Descriptors[resource.name] = {
+                .set     = glsl.get_decoration(resource.id, spv::DecorationDescriptorSet),
                 .binding = vk::DescriptorSetLayoutBinding()
                                .setBinding(glsl.get_decoration(resource.id, spv::DecorationBinding))
                                .setDescriptorType(type)
@@ -5,6 +5,7 @@
 #include "vulkaninja/cpu_timer.hpp"
 #include "vulkaninja/extensions/window.hpp"
 #include "vulkaninja/image.hpp"
+#include "vulkaninja/semaphore.hpp"
 
 #include <stb_image.h>
 #include <stb_image_write.h>
@@ -23,8 +24,22 @@ namespace vulkaninja
 
         Window::init(createInfo.width, createInfo.height, createInfo.title, createInfo.windowResizable);
         Window::setAppPointer(this);
-        initVulkan(createInfo.layers, createInfo.extensions, createInfo.vsync);
+        initVulkan(createInfo.layers, createInfo.extensions, createInfo.vsync, createInfo.descriptorPoolSize);
         initImGui(createInfo.style, createInfo.imguiIniFile);
+
+        if (createInfo.asyncCompute)
+        {
+            if (!m_Context.hasDedicatedQueue(QueueFlags::Compute))
+            {
+                spdlog::warn("No dedicated compute queue, so onCompute() runs on the General queue.");
+            }
+            for (uint32_t i = 0; i < m_Swapchain->getInFlightCount(); i++)
+            {
+                m_ComputeCommandBuffers.push_back(m_Context.allocateCommandBuffer(QueueFlags::Compute));
+            }
+            m_ComputeSemaphore = m_Context.createSemaphore({.timeline = true});
+            m_ComputeWaitStage = createInfo.computeWaitStage;
+        }
     }
 
     void App::run()
@@ -52,6 +67,20 @@ namespace vulkaninja
 
             m_Swapchain->waitNextFrame();
 
+            // Compute
+            // NOTE: The graphics submission of the same frame waits for it,
+            // so the in-flight fence also covers the compute command buffer.
+            if (m_ComputeSemaphore)
+            {
+                auto computeCommandBuffer = m_ComputeCommandBuffers[m_Swapchain->getCurrentInFlightIndex()];
+                computeCommandBuffer->begin();
+                onCompute(computeCommandBuffer);
+                computeCommandBuffer->end();
+
+                m_ComputeValue++;
+                m_Context.submit(computeCommandBuffer, {}, {{m_ComputeSemaphore->getSemaphore(), {}, m_ComputeValue}});
+            }
+
             // Begin command buffer
             // NOTE: Since the command pool is created with the Reset flag,
             //       the command buffer is implicitly reset at begin.
@@ -73,6 +102,7 @@ namespace vulkaninja
                 ImGui::Render();
                 ImDrawData* drawData = ImGui::GetDrawData();
                 ImGui_ImplVulkan_RenderDrawData(drawData, *commandBuffer->commandBuffer);
+                commandBuffer->invalidateState();
 
                 // End render pass
                 commandBuffer->endRendering();
@@ -86,11 +116,24 @@ namespace vulkaninja
 
             // Submit
             vk::PipelineStageFlags waitStage = vk::PipelineStageFlagBits::eColorAttachmentOutput;
-            m_Context.submit(commandBuffer,
-                             waitStage,
-                             m_Swapchain->getCurrentImageAcquiredSemaphore(),
-                             m_Swapchain->getCurrentRenderCompleteSemaphore(),
-                             m_Swapchain->getCurrentFence());
+            if (m_ComputeSemaphore)
+            {
+                m_Context.submit(commandBuffer,
+                                 {
+                                     {m_Swapchain->getCurrentImageAcquiredSemaphore(), waitStage},
+                                     {m_ComputeSemaphore->getSemaphore(), m_ComputeWaitStage, m_ComputeValue},
+                                 },
+                                 {{m_Swapchain->getCurrentRenderCompleteSemaphore()}},
+                                 m_Swapchain->getCurrentFence());
+            }
+            else
+            {
+                m_Context.submit(commandBuffer,
+                                 waitStage,
+                                 m_Swapchain->getCurrentImageAcquiredSemaphore(),
+                                 m_Swapchain->getCurrentRenderCompleteSemaphore(),
+                                 m_Swapchain->getCurrentFence());
+            }
 
             // Present image
             m_Swapchain->presentImage();
@@ -109,14 +152,13 @@ namespace vulkaninja
 
     auto App::getCurrentColorImage() const -> ImageHandle
     {
-        return std::make_shared<Image>(m_Swapchain->getCurrentImage(),
-                                       m_Swapchain->getCurrentImageView(),
-                                       vk::Extent3D {Window::getWidth(), Window::getHeight(), 1},
-                                       m_Swapchain->getFormat(),
-                                       vk::ImageAspectFlagBits::eColor);
+        return m_Swapchain->getCurrentColorImage();
     }
 
-    void App::initVulkan(ArrayProxy<Layer> requiredLayers, ArrayProxy<Extension> requiredExtensions, bool vsync)
+    void App::initVulkan(ArrayProxy<Layer>     requiredLayers,
+                         ArrayProxy<Extension> requiredExtensions,
+                         bool                  vsync,
+                         uint32_t              descriptorPoolSize)
     {
         bool enableValidation = requiredLayers.contains(Layer::eValidation);
 
@@ -153,6 +195,12 @@ namespace vulkaninja
         deviceFeatures.setGeometryShader(supportedFeatures.geometryShader);
         deviceFeatures.setFillModeNonSolid(supportedFeatures.fillModeNonSolid);
         deviceFeatures.setWideLines(supportedFeatures.wideLines);
+        deviceFeatures.setSamplerAnisotropy(supportedFeatures.samplerAnisotropy);
+        // Used by MipGenerator to write images of any format through one dynamically indexed array
+        deviceFeatures.setShaderStorageImageReadWithoutFormat(supportedFeatures.shaderStorageImageReadWithoutFormat);
+        deviceFeatures.setShaderStorageImageWriteWithoutFormat(supportedFeatures.shaderStorageImageWriteWithoutFormat);
+        deviceFeatures.setShaderStorageImageArrayDynamicIndexing(
+            supportedFeatures.shaderStorageImageArrayDynamicIndexing);
 
         // Create device extensions
         std::vector deviceExtensions {VK_KHR_SWAPCHAIN_EXTENSION_NAME, VK_KHR_DYNAMIC_RENDERING_EXTENSION_NAME};
@@ -180,13 +228,40 @@ namespace vulkaninja
         {
             deviceExtensions.push_back(VK_EXT_EXTENDED_DYNAMIC_STATE_3_EXTENSION_NAME);
         }
+        if (requiredExtensions.contains(Extension::ePushDescriptor))
+        {
+            deviceExtensions.push_back(VK_KHR_PUSH_DESCRIPTOR_EXTENSION_NAME);
+        }
+
+        // NOTE: synchronization2 is enabled whenever the device supports it, even if not required.
+        // It is core in Vulkan 1.3, so the extension is only added for older devices or if required.
+        bool enableSynchronization2 =
+            requiredExtensions.contains(Extension::eSynchronization2) ||
+            m_Context.getPhysicalDevice()
+                .getFeatures2<vk::PhysicalDeviceFeatures2, vk::PhysicalDeviceSynchronization2Features>()
+                .get<vk::PhysicalDeviceSynchronization2Features>()
+                .synchronization2;
+        bool isVulkan13Device = m_Context.getPhysicalDevice().getProperties().apiVersion >= VK_API_VERSION_1_3;
+        if (requiredExtensions.contains(Extension::eSynchronization2) || (enableSynchronization2 && !isVulkan13Device))
+        {
+            deviceExtensions.push_back(VK_KHR_SYNCHRONIZATION_2_EXTENSION_NAME);
+        }
+
+        // NOTE: Vulkan 1.2 features must all be enabled through this struct if it is chained.
+        auto supportedVulkan12Features =
+            m_Context.getPhysicalDevice()
+                .getFeatures2<vk::PhysicalDeviceFeatures2, vk::PhysicalDeviceVulkan12Features>()
+                .get<vk::PhysicalDeviceVulkan12Features>();
 
-        vk::PhysicalDeviceDynamicRenderingFeatures    dynamicRenderingFeatures {true};
-        vk::PhysicalDeviceBufferDeviceAddressFeatures bufferAddressFeatures {true};
+        vk::PhysicalDeviceDynamicRenderingFeatures dynamicRenderingFeatures {true};
+        vk::PhysicalDeviceVulkan12Features         vulkan12Features;
+        vulkan12Features.setBufferDeviceAddress(true);
+        vulkan12Features.setDrawIndirectCount(supportedVulkan12Features.drawIndirectCount);
+        vulkan12Features.setTimelineSemaphore(supportedVulkan12Features.timelineSemaphore);
 
         StructureChain featuresChain;
         featuresChain.add(dynamicRenderingFeatures);
-        featuresChain.add(bufferAddressFeatures);
+        featuresChain.add(vulkan12Features);
 
         // Add ray tracing features if required and supported
         vk::PhysicalDeviceRayTracingPipelineFeaturesKHR    rayTracingPipelineFeatures {true};
@@ -228,11 +303,19 @@ namespace vulkaninja
             featuresChain.add(extendedDynamicState3Features);
         }
 
+        // Add synchronization2 features if supported, otherwise barriers use vkCmdPipelineBarrier
+        vk::PhysicalDeviceSynchronization2Features synchronization2Features {true};
+        if (enableSynchronization2)
+        {
+            featuresChain.add(synchronization2Features);
+        }
+
         // Initialize the device with the features supported
         m_Context.initDevice(deviceExtensions,
                              deviceFeatures,
                              featuresChain.pFirst,
-                             requiredExtensions.contains(Extension::eRayTracing));
+                             requiredExtensions.contains(Extension::eRayTracing),
+                             descriptorPoolSize);
 
         // Query present modes
         auto presentModes = m_Context.getPhysicalDevice().getSurfacePresentModesKHR(*m_Surface);
@@ -0,0 +1,69 @@
+#include "vulkaninja/frame_uniform_allocator.hpp"
+#include "vulkaninja/buffer.hpp"
+#include "vulkaninja/common.hpp"
+
+#include <algorithm>
+
+namespace
+{
+    auto alignUp(vk::DeviceSize size, vk::DeviceSize alignment) -> vk::DeviceSize
+    {
+        return (size + alignment - 1) & ~(alignment - 1);
+    }
+} // namespace
+
+namespace vulkaninja
+{
+    FrameUniformAllocator::FrameUniformAllocator(const Context&                         context,
+                                                 const FrameUniformAllocatorCreateInfo& createInfo) :
+        m_Context {&context}, m_FrameCount {createInfo.frameCount}
+    {
+        VKN_ASSERT(createInfo.frameSize > 0, "frameSize must be greater than 0.");
+        VKN_ASSERT(createInfo.frameCount > 0, "frameCount must be greater than 0.");
+
+        // Every slice must start at a valid dynamic offset
+        vk::PhysicalDeviceLimits limits = m_Context->getPhysicalDeviceLimits();
+        if (createInfo.usage & vk::BufferUsageFlagBits::eUniformBuffer)
+        {
+            m_Alignment = std::max(m_Alignment, limits.minUniformBufferOffsetAlignment);
+        }
+        if (createInfo.usage & vk::BufferUsageFlagBits::eStorageBuffer)
+        {
+            m_Alignment = std::max(m_Alignment, limits.minStorageBufferOffsetAlignment);
+        }
+        m_FrameSize = alignUp(createInfo.frameSize, m_Alignment);
+
+        m_Buffer = m_Context->createBuffer({
+            .usage     = createInfo.usage,
+            .memory    = MemoryUsage::Host,
+            .size      = m_FrameSize * m_FrameCount,
+            .debugName = createInfo.debugName,
+        });
+
+        // Persistently mapped
+        m_Mapped = static_cast<uint8_t*>(m_Buffer->map());
+    }
+
+    void FrameUniformAllocator::beginFrame(uint32_t frameIndex)
+    {
+        VKN_ASSERT(frameIndex < m_FrameCount, "frameIndex is out of range. {} < {}", frameIndex, m_FrameCount);
+        m_FrameBegin = m_FrameSize * frameIndex;
+        m_Head       = m_FrameBegin;
+    }
+
+    auto FrameUniformAllocator::allocate(vk::DeviceSize size) -> FrameUniformAllocation
+    {
+        vk::DeviceSize offset = m_Head;
+        vk::DeviceSize end    = offset + alignUp(size, m_Alignment);
+        if (end > m_FrameBegin + m_FrameSize)
+        {
+            throw std::runtime_error("FrameUniformAllocator is out of memory for this frame.");
+        }
+        m_Head = end;
+
+        return {
+            .data   = m_Mapped + offset,
+            .offset = static_cast<uint32_t>(offset),
+        };
+    }
+} // namespace vulkaninja
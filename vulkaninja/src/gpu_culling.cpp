@@ -0,0 +1,270 @@
+#include "vulkaninja/gpu_culling.hpp"
+#include "vulkaninja/command_buffer.hpp"
+#include "vulkaninja/common.hpp"
+#include "vulkaninja/depth_pyramid.hpp"
+#include "vulkaninja/descriptor_set.hpp"
+#include "vulkaninja/image.hpp"
+#include "vulkaninja/pipeline.hpp"
+#include "vulkaninja/shader.hpp"
+
+namespace
+{
+    // NOTE: Corners are tested in clip space, so spheres are culled as their bounding boxes.
+    const std::string cullingCode = R"(
+#version 460
+#extension GL_EXT_buffer_reference : require
+
+layout(local_size_x = 64) in;
+
+struct DrawCommand {
+    uint indexCount;
+    uint instanceCount;
+    uint firstIndex;
+    int  vertexOffset;
+    uint firstInstance;
+};
+
+layout(buffer_reference, std430) readonly buffer Bounds { vec4 bounds[]; };
+layout(buffer_reference, std430) readonly buffer InputDraws { DrawCommand inputDraws[]; };
+layout(buffer_reference, std430) writeonly buffer OutputDraws { DrawCommand outputDraws[]; };
+layout(buffer_reference, std430) buffer DrawCount { uint drawCount; };
+
+layout(push_constant) uniform PushConstants {
+    mat4        viewProj;
+    Bounds      boundsBuffer;
+    InputDraws  inputBuffer;
+    OutputDraws outputBuffer;
+    DrawCount   countBuffer;
+    ivec2       depthSize;
+    uint        instanceCount;
+    int         pyramidLevels;
+};
+
+#ifdef OCCLUSION
+layout(binding = 0) uniform sampler2D depthPyramid;
+
+#ifdef REVERSED_DEPTH
+#define FARTHEST(a, b) min(a, b)
+#define IS_BEHIND(nearest, farthest) (nearest < farthest)
+#else
+#define FARTHEST(a, b) max(a, b)
+#define IS_BEHIND(nearest, farthest) (nearest > farthest)
+#endif
+
+bool isOccluded(vec3 ndcMin, vec3 ndcMax)
+{
+    // NOTE: The viewport flips Y, so NDC +Y is the top row
+    vec2 uvMin = vec2(ndcMin.x, -ndcMax.y) * 0.5 + 0.5;
+    vec2 uvMax = vec2(ndcMax.x, -ndcMin.y) * 0.5 + 0.5;
+    uvMin = clamp(uvMin, 0.0, 1.0);
+    uvMax = clamp(uvMax, 0.0, 1.0);
+
+    // The level where the rectangle covers at most 2x2 texels
+    vec2 size  = (uvMax - uvMin) * vec2(depthSize);
+    int  level = int(ceil(log2(max(max(size.x, size.y), 1.0))));
+    if (level >= pyramidLevels) {
+        return false;
+    }
+
+    // NOTE: Level N covers the depth size divided by 2^N and rounded up, see DepthPyramid
+    ivec2 levelMax = ((depthSize + (1 << level) - 1) >> level) - 1;
+    ivec2 texelMin = min(ivec2(uvMin * vec2(depthSize)) >> level, levelMax);
+    ivec2 texelMax = min(ivec2(uvMax * vec2(depthSize)) >> level, levelMax);
+
+    float farthest = texelFetch(depthPyramid, texelMin, level).r;
+    farthest = FARTHEST(farthest, texelFetch(depthPyramid, ivec2(texelMax.x, texelMin.y), level).r);
+    farthest = FARTHEST(farthest, texelFetch(depthPyramid, ivec2(texelMin.x, texelMax.y), level).r);
+    farthest = FARTHEST(farthest, texelFetch(depthPyramid, texelMax, level).r);
+
+#ifdef REVERSED_DEPTH
+    float nearest = ndcMax.z;
+#else
+    float nearest = ndcMin.z;
+#endif
+    return IS_BEHIND(nearest, farthest);
+}
+#endif
+
+void main()
+{
+    uint index = gl_GlobalInvocationID.x;
+    if (index >= instanceCount) {
+        return;
+    }
+
+#ifdef AABB
+    vec3 boxMin = boundsBuffer.bounds[index * 2].xyz;
+    vec3 boxMax = boundsBuffer.bounds[index * 2 + 1].xyz;
+#else
+    vec4 sphere = boundsBuffer.bounds[index];
+    vec3 boxMin = sphere.xyz - sphere.w;
+    vec3 boxMax = sphere.xyz + sphere.w;
+#endif
+
+    // Culled if all corners are outside the same clip plane
+    uvec3 outsideMin  = uvec3(0);
+    uvec3 outsideMax  = uvec3(0);
+    bool  crossesNear = false;
+    vec3  ndcMin      = vec3(1.0);
+    vec3  ndcMax      = vec3(-1.0, -1.0, 0.0);
+    for (int i = 0; i < 8; i++) {
+        vec3 corner = mix(boxMin, boxMax, vec3(i & 1, (i >> 1) & 1, (i >> 2) & 1));
+        vec4 clip   = viewProj * vec4(corner, 1.0);
+        outsideMin += uvec3(lessThan(clip.xyz, vec3(-clip.w, -clip.w, 0.0)));
+        outsideMax += uvec3(greaterThan(clip.xyz, vec3(clip.w)));
+        if (clip.w <= 0.0) {
+            crossesNear = true;
+        } else {
+            vec3 ndc = clip.xyz / clip.w;
+            ndcMin   = min(ndcMin, ndc);
+            ndcMax   = max(ndcMax, ndc);
+        }
+    }
+    if (any(equal(outsideMin, uvec3(8))) || any(equal(outsideMax, uvec3(8)))) {
+        return;
+    }
+
+#ifdef OCCLUSION
+    if (!crossesNear && isOccluded(ndcMin, ndcMax)) {
+        return;
+    }
+#endif
+
+    uint slot = atomicAdd(countBuffer.drawCount, 1);
+    outputBuffer.outputDraws[slot] = inputBuffer.inputDraws[index];
+}
+)";
+
+    struct CullingPushConstants
+    {
+        glm::mat4         viewProj;
+        vk::DeviceAddress boundsBuffer;
+        vk::DeviceAddress inputBuffer;
+        vk::DeviceAddress outputBuffer;
+        vk::DeviceAddress countBuffer;
+        int32_t           depthWidth;
+        int32_t           depthHeight;
+        uint32_t          instanceCount;
+        int32_t           pyramidLevels;
+    };
+} // namespace
+
+namespace vulkaninja
+{
+    GPUCulling::GPUCulling(const Context& context, const GPUCullingCreateInfo& createInfo) :
+        m_Context {&context}, m_MaxInstanceCount {createInfo.maxInstanceCount}, m_Occlusion {createInfo.occlusion},
+        m_ReversedDepth {createInfo.reversedDepth}
+    {
+        VKN_ASSERT(createInfo.maxInstanceCount > 0, "maxInstanceCount must be greater than 0.");
+
+        m_DrawBuffer = m_Context->createBuffer({
+            .usage     = BufferUsage::Indirect | vk::BufferUsageFlagBits::eShaderDeviceAddress,
+            .memory    = MemoryUsage::Device,
+            .size      = sizeof(vk::DrawIndexedIndirectCommand) * m_MaxInstanceCount,
+            .debugName = createInfo.debugName + "::drawBuffer",
+        });
+        m_CountBuffer = m_Context->createBuffer({
+            .usage     = BufferUsage::Indirect | vk::BufferUsageFlagBits::eShaderDeviceAddress,
+            .memory    = MemoryUsage::Device,
+            .size      = sizeof(uint32_t),
+            .debugName = createInfo.debugName + "::countBuffer",
+        });
+
+        std::vector<std::variant<std::string, std::tuple<std::string, std::string>>> keywords;
+        if (createInfo.bounds == CullingBounds::eAABB)
+        {
+            keywords.emplace_back("AABB");
+        }
+        if (createInfo.occlusion)
+        {
+            keywords.emplace_back("OCCLUSION");
+        }
+        if (createInfo.reversedDepth)
+        {
+            keywords.emplace_back("REVERSED_DEPTH");
+        }
+        m_Shader = Shader::createComputeShader(*m_Context, cullingCode, "GPUCulling.comp", keywords);
+
+        VKN_ASSERT(createInfo.frameCount > 0, "frameCount must be greater than 0.");
+        m_Frames.resize(createInfo.frameCount);
+        if (m_Occlusion)
+        {
+            for (auto& frame : m_Frames)
+            {
+                frame.descSet = m_Context->createDescriptorSet({
+                    .shaders = {m_Shader},
+                });
+            }
+        }
+        m_Pipeline = m_Context->createComputePipeline({
+            .descSetLayouts =
+                m_Occlusion ? m_Frames.front().descSet->getLayouts() : ArrayProxy<vk::DescriptorSetLayout> {},
+            .pushSize       = sizeof(CullingPushConstants),
+            .computeShader  = m_Shader,
+        });
+    }
+
+    void GPUCulling::beginFrame(uint32_t frameIndex)
+    {
+        m_FrameIndex = frameIndex % static_cast<uint32_t>(m_Frames.size());
+    }
+
+    void GPUCulling::cull(const CommandBufferHandle& commandBuffer, const GPUCullingDispatchInfo& dispatchInfo)
+    {
+        VKN_ASSERT(dispatchInfo.instanceCount <= m_MaxInstanceCount,
+                   "instanceCount {} exceeds maxInstanceCount {}.",
+                   dispatchInfo.instanceCount,
+                   m_MaxInstanceCount);
+
+        commandBuffer->fillBuffer(m_CountBuffer, 0);
+
+        CullingPushConstants pushConstants {
+            .viewProj      = dispatchInfo.viewProj,
+            .boundsBuffer  = dispatchInfo.boundsBuffer->getAddress(),
+            .inputBuffer   = dispatchInfo.drawBuffer->getAddress(),
+            .outputBuffer  = m_DrawBuffer->getAddress(),
+            .countBuffer   = m_CountBuffer->getAddress(),
+            .instanceCount = dispatchInfo.instanceCount,
+        };
+
+        if (m_Occlusion)
+        {
+            VKN_ASSERT(dispatchInfo.depthPyramid, "Occlusion culling needs a depth pyramid.");
+            VKN_ASSERT(dispatchInfo.depthPyramid->getReduction() ==
+                           (m_ReversedDepth ? DepthReduction::eMin : DepthReduction::eMax),
+                       "The depth pyramid must hold the farthest depth.");
+            const ImageHandle depthPyramid = dispatchInfo.depthPyramid->getImage();
+
+            // NOTE: Declared first so that the descriptor is written with the layout read by the dispatch.
+            // Only this frame's set is rewritten, since the others may still be read by frames in flight.
+            commandBuffer->declareUsage(depthPyramid, ResourceUsage::eShaderRead);
+            Frame& frame = m_Frames[m_FrameIndex];
+            if (frame.depthPyramid != depthPyramid)
+            {
+                frame.depthPyramid = depthPyramid;
+                frame.descSet->set("depthPyramid", ArrayProxy<ImageHandle> {depthPyramid});
+                frame.descSet->update();
+            }
+            pushConstants.depthWidth    = static_cast<int32_t>(dispatchInfo.depthPyramid->getDepthExtent()[0]);
+            pushConstants.depthHeight   = static_cast<int32_t>(dispatchInfo.depthPyramid->getDepthExtent()[1]);
+            pushConstants.pyramidLevels = static_cast<int32_t>(depthPyramid->getMipLevels());
+        }
+
+        commandBuffer->declareUsage(dispatchInfo.boundsBuffer, ResourceUsage::eShaderRead);
+        commandBuffer->declareUsage(dispatchInfo.drawBuffer, ResourceUsage::eShaderRead);
+        commandBuffer->declareUsage(m_DrawBuffer, ResourceUsage::eShaderWrite);
+        commandBuffer->declareUsage(m_CountBuffer, ResourceUsage::eShaderReadWrite);
+
+        commandBuffer->bindPipeline(m_Pipeline);
+        if (m_Occlusion)
+        {
+            commandBuffer->bindDescriptorSet(m_Pipeline, m_Frames[m_FrameIndex].descSet);
+        }
+        commandBuffer->pushConstants(m_Pipeline, &pushConstants);
+        commandBuffer->dispatch((dispatchInfo.instanceCount + 63) / 64, 1, 1);
+
+        // Declared here since draws inside rendering cannot record the barrier to the indirect read
+        commandBuffer->declareUsage(m_DrawBuffer, ResourceUsage::eIndirectBuffer);
+        commandBuffer->declareUsage(m_CountBuffer, ResourceUsage::eIndirectBuffer);
+    }
+} // namespace vulkaninja
@@ -21,8 +21,8 @@ namespace vulkaninja
     Image::Image(const Context& context, const ImageCreateInfo& createInfo)
         // NOTE: layout is updated by transitionLayout after this ctor.
         :
-        m_Context {&context}, m_DebugName {createInfo.debugName}, m_HasOwnership {true}, m_Extent {createInfo.extent},
-        m_Format {createInfo.format}, m_MipLevels {createInfo.mipLevels}
+        m_Context {&context}, m_DebugName {createInfo.debugName}, m_Usage {createInfo.usage}, m_HasOwnership {true},
+        m_Extent {createInfo.extent}, m_Format {createInfo.format}, m_MipLevels {createInfo.mipLevels}
     {
         // Compute mipmap level
         if (m_MipLevels == std::numeric_limits<uint32_t>::max())
@@ -40,51 +40,59 @@ namespace vulkaninja
         imageInfo.setSamples(vk::SampleCountFlagBits::e1);
         imageInfo.setUsage(createInfo.usage);
         imageInfo.setArrayLayers(m_LayerCount);
+
+        std::vector<uint32_t> queueFamilies = m_Context->getQueueFamilies();
+        if (createInfo.concurrent && queueFamilies.size() > 1)
+        {
+            imageInfo.setSharingMode(vk::SharingMode::eConcurrent);
+            imageInfo.setQueueFamilyIndices(queueFamilies);
+        }
+        if (getStorageFormat(m_Format) != m_Format && (m_Usage & vk::ImageUsageFlagBits::eStorage))
+        {
+            imageInfo.setFlags(vk::ImageCreateFlagBits::eMutableFormat | vk::ImageCreateFlagBits::eExtendedUsage);
+        }
         m_Image = m_Context->getDevice().createImage(imageInfo);
 
-        vk::MemoryRequirements requirements    = m_Context->getDevice().getImageMemoryRequirements(m_Image);
-        uint32_t               memoryTypeIndex = m_Context->findMemoryTypeIndex( //
-            requirements,
-            vk::MemoryPropertyFlagBits::eDeviceLocal);
+        switch (createInfo.imageType)
+        {
+            case vk::ImageType::e1D: {
+                m_ViewType = vk::ImageViewType::e1D;
+                break;
+            }
+            case vk::ImageType::e2D: {
+                m_ViewType = vk::ImageViewType::e2D;
+                break;
+            }
+            case vk::ImageType::e3D: {
+                m_ViewType = vk::ImageViewType::e3D;
+                break;
+            }
+            default: {
+                m_ViewType = {};
+                break;
+            }
+        }
+        m_ViewInfo = createInfo.viewInfo;
 
-        vk::MemoryAllocateInfo memoryInfo;
-        memoryInfo.setAllocationSize(requirements.size);
-        memoryInfo.setMemoryTypeIndex(memoryTypeIndex);
-        m_Memory = m_Context->getDevice().allocateMemory(memoryInfo);
+        if (!createInfo.aliasable)
+        {
+            vk::MemoryRequirements requirements    = getMemoryRequirements();
+            uint32_t               memoryTypeIndex = m_Context->findMemoryTypeIndex( //
+                requirements,
+                vk::MemoryPropertyFlagBits::eDeviceLocal);
 
-        m_Context->getDevice().bindImageMemory(m_Image, m_Memory, 0);
+            vk::MemoryAllocateInfo memoryInfo;
+            memoryInfo.setAllocationSize(requirements.size);
+            memoryInfo.setMemoryTypeIndex(memoryTypeIndex);
+            m_Memory = m_Context->getDevice().allocateMemory(memoryInfo);
 
-        // Image view
-        if (createInfo.viewInfo.has_value())
-        {
-            switch (createInfo.imageType)
-            {
-                case vk::ImageType::e1D: {
-                    m_ViewType = vk::ImageViewType::e1D;
-                    break;
-                }
-                case vk::ImageType::e2D: {
-                    m_ViewType = vk::ImageViewType::e2D;
-                    break;
-                }
-                case vk::ImageType::e3D: {
-                    m_ViewType = vk::ImageViewType::e3D;
-                    break;
-                }
-                default: {
-                    m_ViewType = {};
-                    break;
-                }
-            }
-            createImageView(m_ViewType, createInfo.viewInfo.value().aspect);
+            bindMemory(m_Memory, 0);
         }
 
         // Sampler
         if (createInfo.samplerInfo.has_value())
         {
-            createSampler(createInfo.samplerInfo.value().filter,
-                          createInfo.samplerInfo.value().addressMode,
-                          createInfo.samplerInfo.value().mipmapMode);
+            setSampler(createInfo.samplerInfo.value());
         }
 
         // Debug
@@ -94,6 +102,15 @@ namespace vulkaninja
         }
     }
 
+    void Image::bindMemory(vk::DeviceMemory memory, vk::DeviceSize offset)
+    {
+        m_Context->getDevice().bindImageMemory(m_Image, memory, offset);
+        if (m_ViewInfo.has_value())
+        {
+            createImageView(m_ViewType, m_ViewInfo->aspect);
+        }
+    }
+
     // Create based on information read from KTX
     // ImageView and Sampler are created on the app side
     Image::Image(const Context*    context,
@@ -108,7 +125,7 @@ namespace vulkaninja
                  uint32_t          levelCount,
                  uint32_t          layerCount) :
         m_Context {context}, m_Image {image}, m_Memory {deviceMemory}, m_ViewType {viewType}, m_HasOwnership {true},
-        m_Layout {imageLayout}, m_Extent {width, height, depth}, m_Format {imageFormat}, m_MipLevels {levelCount},
+        m_State {imageLayout}, m_Extent {width, height, depth}, m_Format {imageFormat}, m_MipLevels {levelCount},
         m_LayerCount {layerCount}
     {}
 
@@ -116,15 +133,15 @@ namespace vulkaninja
     {
         if (m_HasOwnership)
         {
-            if (m_Sampler)
-            {
-                m_Context->getDevice().destroySampler(m_Sampler);
-            }
             if (m_View)
             {
                 m_Context->getDevice().destroyImageView(m_View);
             }
-            m_Context->getDevice().freeMemory(m_Memory);
+            // NOTE: Aliasable images do not own their memory
+            if (m_Memory)
+            {
+                m_Context->getDevice().freeMemory(m_Memory);
+            }
             m_Context->getDevice().destroyImage(m_Image);
         }
     }
@@ -171,16 +188,14 @@ namespace vulkaninja
             commandBuffer->transitionLayout(image, vk::ImageLayout::eTransferDstOptimal);
             commandBuffer->copyBufferToImage(stagingBuffer, image);
 
-            // TODO: refactor
-            vk::ImageLayout newLayout = vk::ImageLayout::eShaderReadOnlyOptimal;
-            if (mipLevels > 1)
+            // NOTE: generateMipmaps leaves the image in ShaderReadOnlyOptimal
+            if (image->getMipLevels() > 1)
             {
-                newLayout = vk::ImageLayout::eTransferSrcOptimal;
+                image->generateMipmaps(*commandBuffer);
             }
-            commandBuffer->transitionLayout(image, newLayout);
-            if (mipLevels > 1)
+            else
             {
-                image->generateMipmaps(*commandBuffer);
+                commandBuffer->transitionLayout(image, vk::ImageLayout::eShaderReadOnlyOptimal);
             }
         });
 
@@ -228,13 +243,30 @@ namespace vulkaninja
         return image;
     }
 
+    auto Image::getStorageFormat(vk::Format format) -> vk::Format
+    {
+        switch (format)
+        {
+            case vk::Format::eR8Srgb:
+                return vk::Format::eR8Unorm;
+            case vk::Format::eR8G8Srgb:
+                return vk::Format::eR8G8Unorm;
+            case vk::Format::eR8G8B8A8Srgb:
+                return vk::Format::eR8G8B8A8Unorm;
+            case vk::Format::eB8G8R8A8Srgb:
+                return vk::Format::eB8G8R8A8Unorm;
+            case vk::Format::eA8B8G8R8SrgbPack32:
+                return vk::Format::eA8B8G8R8UnormPack32;
+            default:
+                return format;
+        }
+    }
+
     void Image::generateMipmaps(const CommandBuffer& commandBuffer)
     {
         VKN_ASSERT(m_MipLevels > 1, "mipLevels is not set greater than 1 when the image is created.");
 
         commandBuffer.beginDebugLabel("GenerateMipmap");
-        vk::ImageLayout oldLayout = m_Layout;
-        vk::ImageLayout newLayout = m_Layout;
 
         // Check if image format supports linear blitting
         vk::Filter           filter           = vk::Filter::eLinear;
@@ -258,62 +290,71 @@ namespace vulkaninja
             VKN_ASSERT(false, "This format does not suppoprt blitting: {}", vk::to_string(m_Format));
         }
 
-        // TODO: support 3D
         // TODO: move to command buffer
-        vk::ImageMemoryBarrier barrier {};
+        using Stage  = vk::PipelineStageFlagBits2;
+        using Access = vk::AccessFlagBits2;
+
+        vk::ImageMemoryBarrier2 barrier {};
         barrier.image                           = m_Image;
         barrier.srcQueueFamilyIndex             = VK_QUEUE_FAMILY_IGNORED;
         barrier.dstQueueFamilyIndex             = VK_QUEUE_FAMILY_IGNORED;
         barrier.subresourceRange.aspectMask     = m_Aspect;
         barrier.subresourceRange.baseArrayLayer = 0;
-        barrier.subresourceRange.layerCount     = 1;
+        barrier.subresourceRange.layerCount     = m_LayerCount;
         barrier.subresourceRange.levelCount     = 1;
 
         int32_t mipWidth  = m_Extent.width;
         int32_t mipHeight = m_Extent.height;
+        int32_t mipDepth  = m_Extent.depth;
 
         for (uint32_t i = 1; i < m_MipLevels; i++)
         {
             // Src (i - 1)
+            // NOTE: Level 0 is in the tracked state, the other levels were written by the previous blit
+            vk::ImageMemoryBarrier2 srcBarrier       = barrier;
+            srcBarrier.subresourceRange.baseMipLevel = i - 1;
+            srcBarrier.oldLayout                     = vk::ImageLayout::eTransferDstOptimal;
+            srcBarrier.srcStageMask                  = Stage::eBlit;
+            srcBarrier.srcAccessMask                 = Access::eTransferWrite;
+            srcBarrier.newLayout                     = vk::ImageLayout::eTransferSrcOptimal;
+            srcBarrier.dstStageMask                  = Stage::eBlit;
+            srcBarrier.dstAccessMask                 = Access::eTransferRead;
+            if (i == 1)
             {
-                // TODO: Set access mask properly
-                // NOTE: Level = 0 has not been transitioned yet, so old = existing layout
-                barrier.subresourceRange.baseMipLevel = i - 1;
-                barrier.oldLayout                     = i == 1 ? oldLayout : vk::ImageLayout::eTransferDstOptimal;
-                barrier.newLayout                     = vk::ImageLayout::eTransferSrcOptimal;
-                barrier.srcAccessMask                 = {};
-                barrier.dstAccessMask                 = vk::AccessFlagBits::eTransferRead;
-                commandBuffer.imageBarrier(
-                    barrier, vk::PipelineStageFlagBits::eTransfer, vk::PipelineStageFlagBits::eTransfer);
+                srcBarrier.oldLayout     = m_State.layout;
+                srcBarrier.srcStageMask  = m_State.stage;
+                srcBarrier.srcAccessMask = m_State.access & WriteAccess;
             }
+
             // Dst (i)
-            {
-                // NOTE: Dst will be written from now on, so old = undef is fine
-                // However, if you omit it, old information will remain, so be sure to overwrite it.
-                barrier.subresourceRange.baseMipLevel = i;
-                barrier.oldLayout                     = vk::ImageLayout::eUndefined;
-                barrier.newLayout                     = vk::ImageLayout::eTransferDstOptimal;
-                barrier.srcAccessMask                 = {};
-                barrier.dstAccessMask                 = vk::AccessFlagBits::eTransferWrite;
-                commandBuffer.imageBarrier(
-                    barrier, vk::PipelineStageFlagBits::eTransfer, vk::PipelineStageFlagBits::eTransfer);
-            }
+            // NOTE: Dst will be overwritten, so old = undef is fine.
+            // It still has to wait for previous readers of the image.
+            vk::ImageMemoryBarrier2 dstBarrier       = barrier;
+            dstBarrier.subresourceRange.baseMipLevel = i;
+            dstBarrier.oldLayout                     = vk::ImageLayout::eUndefined;
+            dstBarrier.srcStageMask                  = m_State.stage;
+            dstBarrier.srcAccessMask                 = Access::eNone;
+            dstBarrier.newLayout                     = vk::ImageLayout::eTransferDstOptimal;
+            dstBarrier.dstStageMask                  = Stage::eBlit;
+            dstBarrier.dstAccessMask                 = Access::eTransferWrite;
+
+            commandBuffer.imageBarrier({srcBarrier, dstBarrier});
 
             vk::ImageBlit blit {};
             blit.srcOffsets[0]                 = vk::Offset3D {0, 0, 0};
-            blit.srcOffsets[1]                 = vk::Offset3D {mipWidth, mipHeight, 1};
+            blit.srcOffsets[1]                 = vk::Offset3D {mipWidth, mipHeight, mipDepth};
             blit.srcSubresource.aspectMask     = m_Aspect;
             blit.srcSubresource.mipLevel       = i - 1;
             blit.srcSubresource.baseArrayLayer = 0;
-            blit.srcSubresource.layerCount     = 1;
+            blit.srcSubresource.layerCount     = m_LayerCount;
             blit.dstOffsets[0]                 = vk::Offset3D {0, 0, 0};
             blit.dstOffsets[1]                 = vk::Offset3D {mipWidth > 1 ? mipWidth / 2 : 1, //
                                                mipHeight > 1 ? mipHeight / 2 : 1,
-                                               1};
+                                               mipDepth > 1 ? mipDepth / 2 : 1};
             blit.dstSubresource.aspectMask     = m_Aspect;
             blit.dstSubresource.mipLevel       = i;
             blit.dstSubresource.baseArrayLayer = 0;
-            blit.dstSubresource.layerCount     = 1;
+            blit.dstSubresource.layerCount     = m_LayerCount;
 
             commandBuffer.commandBuffer->blitImage(m_Image,
                                                    vk::ImageLayout::eTransferSrcOptimal,
@@ -326,30 +367,37 @@ namespace vulkaninja
                 mipWidth /= 2;
             if (mipHeight > 1)
                 mipHeight /= 2;
+            if (mipDepth > 1)
+                mipDepth /= 2;
         }
 
-        // Transition all levels up to [0, N-1] from levels [0, 1, 2, ..., N-1, N]
-        barrier.subresourceRange.baseMipLevel = 0;
-        barrier.subresourceRange.levelCount   = m_MipLevels - 1;
-        barrier.oldLayout                     = vk::ImageLayout::eTransferSrcOptimal;
-        barrier.newLayout                     = newLayout;
-        barrier.srcAccessMask                 = vk::AccessFlagBits::eTransferRead;
-        barrier.dstAccessMask                 = vk::AccessFlagBits::eShaderRead;
-        commandBuffer.imageBarrier(
-            barrier, vk::PipelineStageFlagBits::eTransfer, vk::PipelineStageFlagBits::eAllCommands);
-
-        // Transition level N
-        barrier.subresourceRange.baseMipLevel = m_MipLevels - 1;
-        barrier.subresourceRange.levelCount   = 1;
-        barrier.oldLayout                     = vk::ImageLayout::eTransferDstOptimal;
-        barrier.newLayout                     = newLayout;
-        barrier.srcAccessMask                 = vk::AccessFlagBits::eTransferWrite;
-        barrier.dstAccessMask                 = vk::AccessFlagBits::eShaderRead;
-        commandBuffer.imageBarrier(
-            barrier, vk::PipelineStageFlagBits::eTransfer, vk::PipelineStageFlagBits::eAllCommands);
+        // Transition levels [0, N-1) from TransferSrc and level N-1 from TransferDst in one barrier
+        ResourceState readState = getResourceState(ResourceUsage::eShaderRead, m_Context->getShaderStages());
+
+        vk::ImageMemoryBarrier2 srcLevelsBarrier       = barrier;
+        srcLevelsBarrier.subresourceRange.baseMipLevel = 0;
+        srcLevelsBarrier.subresourceRange.levelCount   = m_MipLevels - 1;
+        srcLevelsBarrier.oldLayout                     = vk::ImageLayout::eTransferSrcOptimal;
+        srcLevelsBarrier.srcStageMask                  = Stage::eBlit;
+        srcLevelsBarrier.srcAccessMask                 = Access::eNone;
+
+        vk::ImageMemoryBarrier2 lastLevelBarrier       = barrier;
+        lastLevelBarrier.subresourceRange.baseMipLevel = m_MipLevels - 1;
+        lastLevelBarrier.subresourceRange.levelCount   = 1;
+        lastLevelBarrier.oldLayout                     = vk::ImageLayout::eTransferDstOptimal;
+        lastLevelBarrier.srcStageMask                  = Stage::eBlit;
+        lastLevelBarrier.srcAccessMask                 = Access::eTransferWrite;
+
+        for (auto* levelBarrier : {&srcLevelsBarrier, &lastLevelBarrier})
+        {
+            levelBarrier->newLayout     = readState.layout;
+            levelBarrier->dstStageMask  = readState.stage;
+            levelBarrier->dstAccessMask = readState.access;
+        }
+        commandBuffer.imageBarrier({srcLevelsBarrier, lastLevelBarrier});
 
         commandBuffer.endDebugLabel();
 
-        m_Layout = newLayout;
+        m_State = readState;
     }
 } // namespace vulkaninja
\ No newline at end of file
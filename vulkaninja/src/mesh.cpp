@@ -1,5 +1,68 @@
 #include "vulkaninja/mesh.hpp"
 #include "vulkaninja/command_buffer.hpp"
+#include "vulkaninja/common.hpp"
+
+#include <algorithm>
+#include <cstring>
+#include <limits>
+
+#include <glm/gtc/packing.hpp>
+
+namespace
+{
+    template<typename T>
+    void append(std::vector<uint8_t>& data, const T& value)
+    {
+        size_t offset = data.size();
+        data.resize(offset + sizeof(T));
+        std::memcpy(data.data() + offset, &value, sizeof(T));
+    }
+
+    auto getVertexStride(vk::Format format) -> uint32_t
+    {
+        switch (format)
+        {
+            case vk::Format::eR32G32B32Sfloat:
+                return 12;
+            case vk::Format::eR16G16B16A16Sfloat:
+            case vk::Format::eR16G16B16A16Snorm:
+                return 8;
+            case vk::Format::eR16G16B16Sfloat:
+            case vk::Format::eR16G16B16Snorm:
+                return 6;
+            default:
+                throw std::runtime_error("Unsupported acceleration structure vertex format: " + vk::to_string(format));
+        }
+    }
+
+    void appendPosition(std::vector<uint8_t>& data, vk::Format format, const glm::vec3& pos)
+    {
+        switch (format)
+        {
+            case vk::Format::eR32G32B32Sfloat:
+                append(data, pos);
+                break;
+            case vk::Format::eR16G16B16A16Sfloat:
+                append(data, glm::packHalf4x16(glm::vec4 {pos, 0.0f}));
+                break;
+            case vk::Format::eR16G16B16A16Snorm:
+                append(data, glm::packSnorm4x16(glm::vec4 {pos, 0.0f}));
+                break;
+            case vk::Format::eR16G16B16Sfloat:
+                append(data, glm::packHalf1x16(pos.x));
+                append(data, glm::packHalf1x16(pos.y));
+                append(data, glm::packHalf1x16(pos.z));
+                break;
+            case vk::Format::eR16G16B16Snorm:
+                append(data, glm::packSnorm1x16(pos.x));
+                append(data, glm::packSnorm1x16(pos.y));
+                append(data, glm::packSnorm1x16(pos.z));
+                break;
+            default:
+                throw std::runtime_error("Unsupported acceleration structure vertex format: " + vk::to_string(format));
+        }
+    }
+} // namespace
 
 namespace vulkaninja
 {
@@ -309,4 +372,173 @@ namespace vulkaninja
         std::vector<uint32_t> indices = {0, 1, 1, 2, 2, 3, 3, 0, 4, 5, 5, 6, 6, 7, 7, 4, 0, 4, 1, 5, 2, 6, 3, 7};
         return {context, createInfo.usage, MemoryUsage::Device, vertices, indices, createInfo.name};
     }
+
+    auto Mesh::createMergedMesh(const Context& context, MergedMeshCreateInfo createInfo) -> Mesh
+    {
+        std::vector<Vertex>    vertices;
+        std::vector<uint32_t>  indices;
+        std::vector<MeshRange> ranges;
+        for (const auto& mesh : createInfo.meshes)
+        {
+            ranges.push_back({
+                .firstIndex   = static_cast<uint32_t>(indices.size()),
+                .indexCount   = mesh.getIndicesCount(),
+                .vertexOffset = static_cast<int32_t>(vertices.size()),
+            });
+            vertices.insert(vertices.end(), mesh.vertices.begin(), mesh.vertices.end());
+            indices.insert(indices.end(), mesh.indices.begin(), mesh.indices.end());
+        }
+
+        Mesh mesh {context, createInfo.usage, MemoryUsage::Device, vertices, indices, createInfo.name};
+        mesh.ranges = std::move(ranges);
+        return mesh;
+    }
+
+    auto Mesh::buildDrawCommands(ArrayProxy<MeshDraw> draws) const -> std::vector<vk::DrawIndexedIndirectCommand>
+    {
+        std::vector<vk::DrawIndexedIndirectCommand> commands;
+        commands.reserve(draws.size());
+
+        uint32_t firstInstance = 0;
+        for (const auto& draw : draws)
+        {
+            VKN_ASSERT(draw.range < ranges.size(), "Mesh {} has no range {}.", name, draw.range);
+            const MeshRange& range = ranges[draw.range];
+            commands.push_back({
+                range.indexCount,
+                draw.instanceCount,
+                range.firstIndex,
+                range.vertexOffset,
+                firstInstance,
+            });
+            firstInstance += draw.instanceCount;
+        }
+        return commands;
+    }
+
+    auto Mesh::createAccelGeometries(const AccelMeshFormat& format) const -> std::vector<AccelGeometry>
+    {
+        VKN_ASSERT(isAccelVertexFormatSupported(*context, format.vertexFormat),
+                   "Vertex format {} is not supported by acceleration structures.",
+                   vk::to_string(format.vertexFormat));
+
+        bool normalized =
+            format.vertexFormat == vk::Format::eR16G16B16A16Snorm || format.vertexFormat == vk::Format::eR16G16B16Snorm;
+        uint32_t vertexStride = getVertexStride(format.vertexFormat);
+
+        std::vector<MeshRange> meshRanges = ranges;
+        if (meshRanges.empty())
+        {
+            meshRanges.push_back({.indexCount = getIndicesCount()});
+        }
+
+        std::vector<AccelGeometry>          geometries;
+        std::vector<uint8_t>                vertexData;
+        std::vector<uint8_t>                indexData;
+        std::vector<vk::TransformMatrixKHR> transforms;
+        for (const auto& range : meshRanges)
+        {
+            auto firstIndex = indices.begin() + range.firstIndex;
+            auto lastIndex  = firstIndex + range.indexCount;
+            VKN_ASSERT(range.indexCount > 0, "Mesh {} has an empty range.", name);
+            uint32_t vertexCount = *std::max_element(firstIndex, lastIndex) + 1;
+
+            glm::vec3 center {0.0f};
+            glm::vec3 extent {1.0f};
+            if (normalized)
+            {
+                glm::vec3 minPos {std::numeric_limits<float>::max()};
+                glm::vec3 maxPos {std::numeric_limits<float>::lowest()};
+                for (uint32_t i = 0; i < vertexCount; i++)
+                {
+                    minPos = glm::min(minPos, vertices[range.vertexOffset + i].pos);
+                    maxPos = glm::max(maxPos, vertices[range.vertexOffset + i].pos);
+                }
+                center = (minPos + maxPos) * 0.5f;
+                extent = glm::max((maxPos - minPos) * 0.5f, glm::vec3 {1e-6f});
+
+                glm::mat4 transform {1.0f};
+                transform[0][0] = extent.x;
+                transform[1][1] = extent.y;
+                transform[2][2] = extent.z;
+                transform[3]    = glm::vec4 {center, 1.0f};
+                transforms.push_back(toVkMatrix(transform));
+            }
+
+            // NOTE: Larger geometries cannot be indexed with 16 bits
+            vk::IndexType indexType = vertexCount > 65536 ? vk::IndexType::eUint32 : format.indexType;
+
+            // NOTE: Index data is aligned to the index size
+            indexData.resize((indexData.size() + 3) & ~size_t {3});
+
+            geometries.push_back({
+                .vertexOffset     = vertexData.size(),
+                .indexOffset      = indexData.size(),
+                .transformOffset  = normalized ? sizeof(vk::TransformMatrixKHR) * (transforms.size() - 1) : 0,
+                .vertexFormat     = format.vertexFormat,
+                .indexType        = indexType,
+                .vertexStride     = vertexStride,
+                .maxVertexCount   = vertexCount,
+                .maxTriangleCount = range.indexCount / 3,
+                .triangleCount    = range.indexCount / 3,
+            });
+
+            for (uint32_t i = 0; i < vertexCount; i++)
+            {
+                glm::vec3 pos = (vertices[range.vertexOffset + i].pos - center) / extent;
+                appendPosition(vertexData, format.vertexFormat, pos);
+            }
+            for (auto index = firstIndex; index != lastIndex; ++index)
+            {
+                if (indexType == vk::IndexType::eUint16)
+                {
+                    append(indexData, static_cast<uint16_t>(*index));
+                }
+                else
+                {
+                    append(indexData, *index);
+                }
+            }
+        }
+
+        BufferHandle accelVertexBuffer = context->createBuffer({
+            .usage     = BufferUsage::AccelInput,
+            .memory    = MemoryUsage::Device,
+            .size      = vertexData.size(),
+            .debugName = name + "::accelVertexBuffer",
+        });
+        BufferHandle accelIndexBuffer = context->createBuffer({
+            .usage     = BufferUsage::AccelInput,
+            .memory    = MemoryUsage::Device,
+            .size      = indexData.size(),
+            .debugName = name + "::accelIndexBuffer",
+        });
+        BufferHandle transformBuffer;
+        if (normalized)
+        {
+            transformBuffer = context->createBuffer({
+                .usage     = BufferUsage::AccelInput,
+                .memory    = MemoryUsage::Device,
+                .size      = sizeof(vk::TransformMatrixKHR) * transforms.size(),
+                .debugName = name + "::accelTransformBuffer",
+            });
+        }
+
+        context->oneTimeSubmit([&](CommandBufferHandle commandBuffer) {
+            commandBuffer->copyBuffer(accelVertexBuffer, vertexData.data());
+            commandBuffer->copyBuffer(accelIndexBuffer, indexData.data());
+            if (transformBuffer)
+            {
+                commandBuffer->copyBuffer(transformBuffer, transforms.data());
+            }
+        });
+
+        for (auto& geometry : geometries)
+        {
+            geometry.vertexBuffer    = accelVertexBuffer;
+            geometry.indexBuffer     = accelIndexBuffer;
+            geometry.transformBuffer = transformBuffer;
+        }
+        return geometries;
+    }
 } // namespace vulkaninja
\ No newline at end of file
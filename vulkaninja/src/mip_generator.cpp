@@ -0,0 +1,604 @@
+#include "vulkaninja/mip_generator.hpp"
+#include "vulkaninja/buffer.hpp"
+#include "vulkaninja/command_buffer.hpp"
+#include "vulkaninja/common.hpp"
+#include "vulkaninja/image.hpp"
+#include "vulkaninja/pipeline.hpp"
+#include "vulkaninja/shader.hpp"
+
+#include <algorithm>
+#include <cstring>
+
+namespace
+{
+    // 2D tiles of 64x64 texels are reduced by 6 levels through shared memory, 3D tiles of 8x8x8 by 3 levels.
+    // NOTE: Sizes follow Vulkan mip sizes. A level reduced from an odd size reads a 3-texel footprint per axis,
+    // which crosses tiles, so a dispatch stops its tiles before such a level and the next one starts from it.
+    const std::string mipCode = R"(
+#version 460
+#extension GL_EXT_buffer_reference : require
+
+#ifdef VOLUME
+#define LOCAL_SIZE  64
+#define TILE_LEVELS 3
+layout(binding = 0) uniform coherent image3D levels[MAX_BATCH_SIZE * MAX_LEVELS];
+#else
+#define LOCAL_SIZE  256
+#define TILE_LEVELS 6
+layout(binding = 0) uniform coherent image2DArray levels[MAX_BATCH_SIZE * MAX_LEVELS];
+#endif
+
+layout(local_size_x = LOCAL_SIZE) in;
+
+struct Job {
+    ivec4 size; // xyz: size of level 0
+    int   firstGroup;
+    int   tileCountX;
+    int   tileCountY;
+    int   tileCount;
+    int   baseLevel; // Read by the tiles
+    int   tileEnd;   // Tiles write the levels in (baseLevel, tileEnd)
+    int   levelEnd;  // The last workgroup writes the levels in [tileEnd, levelEnd)
+    int   layerCount;
+    int   srgb;
+    int   firstCounter; // One counter per layer
+    int   slot;         // In the descriptor array
+    int   padding;
+};
+
+layout(buffer_reference, std430) readonly buffer Jobs { Job jobs[]; };
+layout(buffer_reference, std430) coherent buffer Counters { uint counters[]; };
+
+layout(push_constant) uniform PushConstants {
+    Jobs     jobBuffer;
+    Counters counterBuffer;
+    int      jobCount;
+    int      groupCount;
+};
+
+shared bool isLastGroup;
+
+Job job;
+int group;
+int layer;
+int storeEnd;
+
+ivec3 getLevelSize(int level)
+{
+    return max(job.size.xyz >> level, ivec3(1));
+}
+
+vec3 toLinear(vec3 color)
+{
+    return mix(color / 12.92, pow((color + 0.055) / 1.055, vec3(2.4)), greaterThan(color, vec3(0.04045)));
+}
+
+vec3 toSrgb(vec3 color)
+{
+    return mix(color * 12.92, 1.055 * pow(color, vec3(1.0 / 2.4)) - 0.055, greaterThan(color, vec3(0.0031308)));
+}
+
+vec4 loadTexel(int level, ivec3 texel)
+{
+    texel = min(texel, getLevelSize(level) - 1);
+#ifdef VOLUME
+    vec4 value = imageLoad(levels[job.slot * MAX_LEVELS + level], texel);
+#else
+    vec4 value = imageLoad(levels[job.slot * MAX_LEVELS + level], ivec3(texel.xy, layer));
+#endif
+    if (job.srgb != 0) {
+        value.rgb = toLinear(value.rgb);
+    }
+    return value;
+}
+
+void storeTexel(int level, ivec3 texel, vec4 value)
+{
+    if (level >= storeEnd || any(greaterThanEqual(texel, getLevelSize(level)))) {
+        return;
+    }
+    if (job.srgb != 0) {
+        value.rgb = toSrgb(value.rgb);
+    }
+#ifdef VOLUME
+    imageStore(levels[job.slot * MAX_LEVELS + level], texel, value);
+#else
+    imageStore(levels[job.slot * MAX_LEVELS + level], ivec3(texel.xy, layer), value);
+#endif
+}
+
+// Weights of the texels at 2 * x, 2 * x + 1 and 2 * x + 2 along an axis of the previous level.
+// An odd size 2n + 1 is spread over n texels, so each one covers 2 + 1/n texels.
+vec3 getWeights(int prevSize, int x)
+{
+    if ((prevSize & 1) == 0 || prevSize == 1) {
+        return vec3(0.5, 0.5, 0.0);
+    }
+    int n = prevSize >> 1;
+    return vec3(n - x, n, x + 1) / float(prevSize);
+}
+
+// Box filter over the footprint of the texel in the previous level
+vec4 reduceTexel(int level, ivec3 texel)
+{
+    ivec3 prevSize = getLevelSize(level - 1);
+    ivec3 q        = texel * 2;
+    vec3  wx       = getWeights(prevSize.x, texel.x);
+    vec3  wy       = getWeights(prevSize.y, texel.y);
+#ifdef VOLUME
+    vec3 wz = getWeights(prevSize.z, texel.z);
+#else
+    vec3 wz = vec3(1.0, 0.0, 0.0);
+#endif
+
+    vec4 sum = vec4(0.0);
+    for (int z = 0; z < 3; z++) {
+        for (int y = 0; y < 3; y++) {
+            for (int x = 0; x < 3; x++) {
+                float weight = wx[x] * wy[y] * wz[z];
+                if (weight > 0.0) {
+                    sum += weight * loadTexel(level - 1, q + ivec3(x, y, z));
+                }
+            }
+        }
+    }
+    return sum;
+}
+
+#ifdef VOLUME
+shared vec4 tile[64];
+
+void reduceTile(int index)
+{
+    int   tileIndex = group - job.firstGroup;
+    ivec3 tileCoord = ivec3(tileIndex % job.tileCountX,
+                            (tileIndex / job.tileCountX) % job.tileCountY,
+                            tileIndex / (job.tileCountX * job.tileCountY));
+    int   base      = job.baseLevel;
+
+    // First level: 4x4x4 texels per tile
+    ivec3 p     = ivec3(index % 4, (index / 4) % 4, index / 16);
+    vec4  value = reduceTexel(base + 1, tileCoord * 4 + p);
+    storeTexel(base + 1, tileCoord * 4 + p, value);
+    tile[index] = value;
+    barrier();
+
+    // Second level: 2x2x2
+    if (index < 8) {
+        ivec3 q = ivec3(index & 1, (index >> 1) & 1, index >> 2);
+        value   = vec4(0.0);
+        for (int i = 0; i < 8; i++) {
+            ivec3 t = q * 2 + ivec3(i & 1, (i >> 1) & 1, i >> 2);
+            value += tile[t.x + t.y * 4 + t.z * 16];
+        }
+        value *= 0.125;
+        storeTexel(base + 2, tileCoord * 2 + q, value);
+    }
+    barrier();
+    if (index < 8) {
+        tile[index] = value;
+    }
+    barrier();
+
+    // Third level
+    if (index == 0) {
+        value = vec4(0.0);
+        for (int i = 0; i < 8; i++) {
+            value += tile[i];
+        }
+        storeTexel(base + 3, tileCoord, value * 0.125);
+    }
+}
+#else
+shared vec4 tile[16][16];
+
+// Reduces 2x2 values of the tile into its top-left SIZE x SIZE corner
+#define REDUCE_TILE(LEVEL, SIZE)                                                        \
+    {                                                                                   \
+        ivec2 p     = ivec2(index % SIZE, index / SIZE);                                \
+        vec4  value = vec4(0.0);                                                        \
+        if (index < SIZE * SIZE) {                                                      \
+            value = (tile[p.y * 2][p.x * 2] + tile[p.y * 2][p.x * 2 + 1] +              \
+                     tile[p.y * 2 + 1][p.x * 2] + tile[p.y * 2 + 1][p.x * 2 + 1]) * 0.25; \
+            storeTexel(LEVEL, ivec3(tileCoord * SIZE + p, 0), value);                   \
+        }                                                                               \
+        barrier();                                                                      \
+        if (index < SIZE * SIZE) {                                                      \
+            tile[p.y][p.x] = value;                                                     \
+        }                                                                               \
+        barrier();                                                                      \
+    }
+
+void reduceTile(int index)
+{
+    int   tileIndex = group - job.firstGroup;
+    ivec2 tileCoord = ivec2(tileIndex % job.tileCountX, tileIndex / job.tileCountX);
+    int   base      = job.baseLevel;
+
+    // First two levels: 4x4 texels of the base level per invocation
+    ivec3 origin = ivec3(tileCoord * 64 + ivec2(index % 16, index / 16) * 4, 0);
+    vec4  quads[4];
+    for (int q = 0; q < 4; q++) {
+        ivec3 texel = (origin + ivec3(q & 1, q >> 1, 0) * 2) / 2;
+        quads[q]    = reduceTexel(base + 1, texel);
+        storeTexel(base + 1, texel, quads[q]);
+    }
+    vec4 value = (quads[0] + quads[1] + quads[2] + quads[3]) * 0.25;
+    storeTexel(base + 2, origin / 4, value);
+    tile[index / 16][index % 16] = value;
+    barrier();
+
+    // Next four levels from shared memory
+    REDUCE_TILE(base + 3, 8)
+    REDUCE_TILE(base + 4, 4)
+    REDUCE_TILE(base + 5, 2)
+    REDUCE_TILE(base + 6, 1)
+}
+#endif
+
+void main()
+{
+    // Workgroups are spread over x and z, since a batch can exceed maxComputeWorkGroupCount[0]
+    group = int(gl_WorkGroupID.x + gl_WorkGroupID.z * gl_NumWorkGroups.x);
+    if (group >= groupCount) {
+        return;
+    }
+
+    // Find the job of this workgroup
+    int jobIndex = 0;
+    while (jobIndex + 1 < jobCount && group >= jobBuffer.jobs[jobIndex + 1].firstGroup) {
+        jobIndex++;
+    }
+    job   = jobBuffer.jobs[jobIndex];
+    layer = int(gl_WorkGroupID.y);
+    if (layer >= job.layerCount) {
+        return;
+    }
+
+    int index = int(gl_LocalInvocationIndex);
+    storeEnd  = job.tileEnd;
+    reduceTile(index);
+
+    if (job.levelEnd <= job.tileEnd) {
+        return;
+    }
+
+    // The last level of the tile must be visible to the last workgroup before it is counted
+    memoryBarrierImage();
+    barrier();
+    if (index == 0) {
+        uint count  = atomicAdd(counterBuffer.counters[job.firstCounter + layer], 1);
+        isLastGroup = count == uint(job.tileCount - 1);
+    }
+    barrier();
+    if (!isLastGroup) {
+        return;
+    }
+
+    storeEnd = job.levelEnd;
+    for (int level = job.tileEnd; level < job.levelEnd; level++) {
+        ivec3 size = getLevelSize(level);
+        for (int i = index; i < size.x * size.y * size.z; i += LOCAL_SIZE) {
+            ivec3 texel = ivec3(i % size.x, (i / size.x) % size.y, i / (size.x * size.y));
+            storeTexel(level, texel, reduceTexel(level, texel));
+        }
+        memoryBarrierImage();
+        barrier();
+    }
+
+    // Ready for the next dispatch
+    if (index == 0) {
+        counterBuffer.counters[job.firstCounter + layer] = 0;
+    }
+}
+)";
+
+    struct MipJob
+    {
+        int32_t size[4];
+        int32_t firstGroup;
+        int32_t tileCountX;
+        int32_t tileCountY;
+        int32_t tileCount;
+        int32_t baseLevel;
+        int32_t tileEnd;
+        int32_t levelEnd;
+        int32_t layerCount;
+        int32_t srgb;
+        int32_t firstCounter;
+        int32_t slot;
+        int32_t padding;
+    };
+
+    struct MipPushConstants
+    {
+        vk::DeviceAddress jobBuffer;
+        vk::DeviceAddress counterBuffer;
+        int32_t           jobCount;
+        int32_t           groupCount;
+    };
+} // namespace
+
+namespace vulkaninja
+{
+    MipGenerator::MipGenerator(const Context& context, const MipGeneratorCreateInfo& createInfo) :
+        m_Context {&context}, m_MaxDispatchCount {createInfo.maxDispatchCount},
+        m_MaxLayerCount {createInfo.maxLayerCount}
+    {
+        VKN_ASSERT(createInfo.frameCount > 0 && m_MaxDispatchCount > 0, "frameCount and maxDispatchCount must be > 0.");
+
+        vk::PhysicalDeviceFeatures features = m_Context->getPhysicalDevice().getFeatures();
+        VKN_ASSERT(features.shaderStorageImageReadWithoutFormat && features.shaderStorageImageWriteWithoutFormat,
+                   "MipGenerator needs shaderStorageImageReadWithoutFormat and shaderStorageImageWriteWithoutFormat.");
+        VKN_ASSERT(features.shaderStorageImageArrayDynamicIndexing,
+                   "MipGenerator needs shaderStorageImageArrayDynamicIndexing.");
+
+        vk::PhysicalDeviceLimits limits = m_Context->getPhysicalDeviceLimits();
+        std::ranges::copy(limits.maxComputeWorkGroupCount, m_MaxGroupCount.begin());
+
+        // NOTE: Every element is written, so no descriptor indexing feature is needed
+        vk::DescriptorSetLayoutBinding binding;
+        binding.setBinding(0);
+        binding.setDescriptorType(vk::DescriptorType::eStorageImage);
+        binding.setDescriptorCount(s_MAX_BATCH_SIZE * s_MAX_LEVELS);
+        binding.setStageFlags(vk::ShaderStageFlagBits::eCompute);
+
+        vk::DescriptorSetLayoutCreateInfo layoutInfo;
+        layoutInfo.setBindings(binding);
+        m_DescSetLayout = m_Context->getDevice().createDescriptorSetLayoutUnique(layoutInfo);
+
+        std::vector<std::variant<std::string, std::tuple<std::string, std::string>>> keywords {
+            std::tuple<std::string, std::string> {"MAX_BATCH_SIZE", std::to_string(s_MAX_BATCH_SIZE)},
+            std::tuple<std::string, std::string> {"MAX_LEVELS", std::to_string(s_MAX_LEVELS)},
+        };
+        m_Shader = Shader::createComputeShader(*m_Context, mipCode, "MipGenerator.comp", keywords);
+        keywords.emplace_back("VOLUME");
+        m_VolumeShader = Shader::createComputeShader(*m_Context, mipCode, "MipGenerator3D.comp", keywords);
+
+        m_Pipeline = m_Context->createComputePipeline({
+            .descSetLayouts = {*m_DescSetLayout},
+            .pushSize       = sizeof(MipPushConstants),
+            .computeShader  = m_Shader,
+        });
+        m_VolumePipeline = m_Context->createComputePipeline({
+            .descSetLayouts = {*m_DescSetLayout},
+            .pushSize       = sizeof(MipPushConstants),
+            .computeShader  = m_VolumeShader,
+        });
+
+        m_CounterBuffer = m_Context->createBuffer({
+            .usage     = BufferUsage::Storage,
+            .memory    = MemoryUsage::Device,
+            .size      = sizeof(uint32_t) * s_MAX_BATCH_SIZE * m_MaxLayerCount,
+            .debugName = createInfo.debugName + "::counterBuffer",
+        });
+        m_Context->oneTimeSubmit(
+            [&](CommandBufferHandle commandBuffer) { commandBuffer->fillBuffer(m_CounterBuffer, 0); });
+
+        vk::DescriptorPoolSize poolSize {vk::DescriptorType::eStorageImage,
+                                         m_MaxDispatchCount * s_MAX_BATCH_SIZE * s_MAX_LEVELS};
+        vk::DescriptorPoolCreateInfo poolInfo;
+        poolInfo.setPoolSizes(poolSize);
+        poolInfo.setMaxSets(m_MaxDispatchCount);
+
+        m_Frames.resize(createInfo.frameCount);
+        for (Frame& frame : m_Frames)
+        {
+            frame.descPool  = m_Context->getDevice().createDescriptorPoolUnique(poolInfo);
+            frame.jobBuffer = m_Context->createBuffer({
+                .usage     = BufferUsage::Storage,
+                .memory    = MemoryUsage::Host,
+                .size      = sizeof(MipJob) * s_MAX_BATCH_SIZE * m_MaxDispatchCount,
+                .debugName = createInfo.debugName + "::jobBuffer",
+            });
+        }
+    }
+
+    void MipGenerator::beginFrame(uint32_t frameIndex)
+    {
+        m_FrameIndex = frameIndex % static_cast<uint32_t>(m_Frames.size());
+
+        Frame& frame = m_Frames[m_FrameIndex];
+        m_Context->getDevice().resetDescriptorPool(*frame.descPool);
+        frame.views.clear();
+        frame.dispatchCount = 0;
+    }
+
+    void MipGenerator::generate(const CommandBufferHandle& commandBuffer, ArrayProxy<ImageHandle> images)
+    {
+        std::vector<ImageHandle> batch;
+        std::vector<ImageHandle> volumeBatch;
+        for (const ImageHandle& image : images)
+        {
+            if (image->getMipLevels() <= 1)
+            {
+                continue;
+            }
+            VKN_ASSERT(image->getUsage() & vk::ImageUsageFlagBits::eStorage, "Images need eStorage usage.");
+            VKN_ASSERT(image->getMipLevels() <= s_MAX_LEVELS, "mipLevels exceeds {}.", s_MAX_LEVELS);
+            VKN_ASSERT(m_Context->getPhysicalDevice()
+                               .getFormatProperties(Image::getStorageFormat(image->getFormat()))
+                               .optimalTilingFeatures &
+                           vk::FormatFeatureFlagBits::eStorageImage,
+                       "Format {} does not support storage images.",
+                       vk::to_string(Image::getStorageFormat(image->getFormat())));
+
+            bool  volume = image->getViewType() == vk::ImageViewType::e3D;
+            auto& target = volume ? volumeBatch : batch;
+            target.push_back(image);
+            if (target.size() == s_MAX_BATCH_SIZE)
+            {
+                dispatch(commandBuffer, target, volume);
+                target.clear();
+            }
+        }
+        if (!batch.empty())
+        {
+            dispatch(commandBuffer, batch, false);
+        }
+        if (!volumeBatch.empty())
+        {
+            dispatch(commandBuffer, volumeBatch, true);
+        }
+    }
+
+    void MipGenerator::dispatch(const CommandBufferHandle&      commandBuffer,
+                                const std::vector<ImageHandle>& images,
+                                bool                            volume)
+    {
+        Frame& frame = m_Frames[m_FrameIndex];
+
+        vk::DescriptorSetAllocateInfo allocInfo;
+        allocInfo.setDescriptorPool(*frame.descPool);
+        allocInfo.setSetLayouts(*m_DescSetLayout);
+        vk::DescriptorSet descSet = m_Context->getDevice().allocateDescriptorSets(allocInfo).front();
+
+        uint32_t tileSize   = volume ? 8 : 64;
+        uint32_t tileLevels = volume ? 3 : 6;
+
+        // Jobs of each dispatch, per image
+        std::vector<std::vector<MipJob>> passes;
+
+        std::vector<vk::DescriptorImageInfo> imageInfos;
+        for (uint32_t slot = 0; slot < images.size(); slot++)
+        {
+            const ImageHandle& image      = images[slot];
+            vk::Extent3D       extent     = image->getExtent();
+            uint32_t           levelCount = image->getMipLevels();
+            VKN_ASSERT(image->getLayerCount() <= m_MaxLayerCount, "layerCount exceeds {}.", m_MaxLayerCount);
+
+            auto getLevelSize = [&](uint32_t level) {
+                return vk::Extent3D {std::max(extent.width >> level, 1u),
+                                     std::max(extent.height >> level, 1u),
+                                     volume ? std::max(extent.depth >> level, 1u) : 1u};
+            };
+
+            // NOTE: The first level of a dispatch reads the image. Later ones are reduced in shared memory,
+            // which is exact only while the level read has even sizes.
+            auto isEven = [&](uint32_t level) {
+                vk::Extent3D size = getLevelSize(level);
+                return size.width % 2 == 0 && size.height % 2 == 0 && (!volume || size.depth % 2 == 0);
+            };
+
+            uint32_t baseLevel = 0;
+            for (uint32_t pass = 0;; pass++)
+            {
+                uint32_t tileEnd = baseLevel + 2;
+                while (tileEnd < std::min(baseLevel + tileLevels + 1, levelCount) && isEven(tileEnd - 1))
+                {
+                    tileEnd++;
+                }
+                tileEnd = std::min(tileEnd, levelCount);
+
+                vk::Extent3D baseSize   = getLevelSize(baseLevel);
+                uint32_t     tileCountX = (baseSize.width + tileSize - 1) / tileSize;
+                uint32_t     tileCountY = (baseSize.height + tileSize - 1) / tileSize;
+                uint32_t     tileCountZ = (baseSize.depth + tileSize - 1) / tileSize;
+                uint32_t     tileCount  = tileCountX * tileCountY * tileCountZ;
+
+                // The last workgroup finishes the image once the tiles have reduced all they can,
+                // or if it is the only one
+                bool isLastPass = tileEnd == levelCount || tileEnd == baseLevel + tileLevels + 1 || tileCount == 1;
+
+                if (passes.size() <= pass)
+                {
+                    passes.emplace_back();
+                }
+                passes[pass].push_back({
+                    .size         = {static_cast<int32_t>(extent.width),
+                                     static_cast<int32_t>(extent.height),
+                                     static_cast<int32_t>(extent.depth),
+                                     0},
+                    .tileCountX   = static_cast<int32_t>(tileCountX),
+                    .tileCountY   = static_cast<int32_t>(tileCountY),
+                    .tileCount    = static_cast<int32_t>(tileCount),
+                    .baseLevel    = static_cast<int32_t>(baseLevel),
+                    .tileEnd      = static_cast<int32_t>(tileEnd),
+                    .levelEnd     = static_cast<int32_t>(isLastPass ? levelCount : tileEnd),
+                    .layerCount   = static_cast<int32_t>(image->getLayerCount()),
+                    .srgb         = Image::getStorageFormat(image->getFormat()) != image->getFormat(),
+                    .firstCounter = static_cast<int32_t>(slot * m_MaxLayerCount),
+                    .slot         = static_cast<int32_t>(slot),
+                });
+                if (isLastPass)
+                {
+                    break;
+                }
+                baseLevel = tileEnd - 1;
+            }
+
+            for (uint32_t level = 0; level < s_MAX_LEVELS; level++)
+            {
+                if (level < levelCount)
+                {
+                    vk::ImageViewCreateInfo viewInfo;
+                    viewInfo.setImage(image->getImage());
+                    viewInfo.setViewType(volume ? vk::ImageViewType::e3D : vk::ImageViewType::e2DArray);
+                    viewInfo.setFormat(Image::getStorageFormat(image->getFormat()));
+                    viewInfo.setSubresourceRange(
+                        {vk::ImageAspectFlagBits::eColor, level, 1, 0, volume ? 1 : image->getLayerCount()});
+                    frame.views.push_back(m_Context->getDevice().createImageViewUnique(viewInfo));
+                }
+                // NOTE: Unused elements repeat the last level
+                imageInfos.push_back({{}, *frame.views.back(), vk::ImageLayout::eGeneral});
+            }
+        }
+        while (imageInfos.size() < s_MAX_BATCH_SIZE * s_MAX_LEVELS)
+        {
+            imageInfos.push_back(imageInfos.back());
+        }
+
+        vk::WriteDescriptorSet write;
+        write.setDstSet(descSet);
+        write.setDstBinding(0);
+        write.setDescriptorType(vk::DescriptorType::eStorageImage);
+        write.setImageInfo(imageInfos);
+        m_Context->getDevice().updateDescriptorSets(write, {});
+
+        const ComputePipelineHandle& pipeline = volume ? m_VolumePipeline : m_Pipeline;
+        commandBuffer->bindPipeline(pipeline);
+        commandBuffer->bindDescriptorSet(pipeline, descSet);
+
+        for (std::vector<MipJob>& jobs : passes)
+        {
+            VKN_ASSERT(frame.dispatchCount < m_MaxDispatchCount,
+                       "maxDispatchCount {} is exceeded.",
+                       m_MaxDispatchCount);
+            size_t jobOffset = sizeof(MipJob) * s_MAX_BATCH_SIZE * frame.dispatchCount;
+            frame.dispatchCount++;
+
+            uint32_t groupCount = 0;
+            uint32_t layerCount = 1;
+            for (MipJob& job : jobs)
+            {
+                job.firstGroup = static_cast<int32_t>(groupCount);
+                groupCount += job.tileCount;
+                layerCount = std::max(layerCount, static_cast<uint32_t>(job.layerCount));
+
+                // NOTE: Declared by each dispatch, so that it waits for the levels written by the previous one
+                commandBuffer->declareUsage(images[job.slot], ResourceUsage::eShaderReadWrite);
+            }
+            std::memcpy(static_cast<uint8_t*>(frame.jobBuffer->map()) + jobOffset,
+                        jobs.data(),
+                        sizeof(MipJob) * jobs.size());
+            commandBuffer->declareUsage(m_CounterBuffer, ResourceUsage::eShaderReadWrite);
+
+            MipPushConstants pushConstants {
+                .jobBuffer     = frame.jobBuffer->getAddress() + jobOffset,
+                .counterBuffer = m_CounterBuffer->getAddress(),
+                .jobCount      = static_cast<int32_t>(jobs.size()),
+                .groupCount    = static_cast<int32_t>(groupCount),
+            };
+            commandBuffer->pushConstants(pipeline, &pushConstants);
+
+            // Workgroups wrap from x into z beyond the limit of x
+            uint32_t groupCountX = std::min(groupCount, m_MaxGroupCount[0]);
+            uint32_t groupCountZ = (groupCount + groupCountX - 1) / groupCountX;
+            VKN_ASSERT(layerCount <= m_MaxGroupCount[1] && groupCountZ <= m_MaxGroupCount[2],
+                       "{} workgroups of {} layers exceed maxComputeWorkGroupCount.",
+                       groupCount,
+                       layerCount);
+            commandBuffer->dispatch(groupCountX, layerCount, groupCountZ);
+        }
+    }
+} // namespace vulkaninja
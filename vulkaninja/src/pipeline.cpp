@@ -2,9 +2,9 @@
 #include "vulkaninja/array_proxy.hpp"
 #include "vulkaninja/buffer.hpp"
 #include "vulkaninja/command_buffer.hpp"
+#include "vulkaninja/common.hpp"
 #include "vulkaninja/mesh.hpp"
-
-#include <iostream>
+#include "vulkaninja/shader_binding_table.hpp"
 
 namespace vulkaninja
 {
@@ -21,7 +21,7 @@ namespace vulkaninja
         pushRange.setStageFlags(m_ShaderStageFlags);
 
         vk::PipelineLayoutCreateInfo layoutInfo;
-        layoutInfo.setSetLayouts(createInfo.descSetLayout);
+        layoutInfo.setSetLayouts(createInfo.descSetLayouts);
         if (m_PushSize)
         {
             layoutInfo.setPushConstantRanges(pushRange);
@@ -192,7 +192,7 @@ namespace vulkaninja
         pushRange.setStageFlags(m_ShaderStageFlags);
 
         vk::PipelineLayoutCreateInfo layoutInfo;
-        layoutInfo.setSetLayouts(createInfo.descSetLayout);
+        layoutInfo.setSetLayouts(createInfo.descSetLayouts);
         if (m_PushSize)
         {
             layoutInfo.setPushConstantRanges(pushRange);
@@ -346,7 +346,7 @@ namespace vulkaninja
         pushRange.setStageFlags(m_ShaderStageFlags);
 
         vk::PipelineLayoutCreateInfo layoutInfo;
-        layoutInfo.setSetLayouts(createInfo.descSetLayout);
+        layoutInfo.setSetLayouts(createInfo.descSetLayouts);
         if (m_PushSize)
         {
             layoutInfo.setPushConstantRanges(pushRange);
@@ -378,61 +378,110 @@ namespace vulkaninja
         m_BindPoint = vk::PipelineBindPoint::eRayTracingKHR;
         m_PushSize  = createInfo.pushSize;
 
-        // Raygen
-        {
-            uint32_t rgenIndex = static_cast<uint32_t>(m_ShaderModules.size());
-            m_RgenCount        = 1;
-            m_ShaderModules.push_back(createInfo.rgenGroup.raygenShader->getModule());
-            m_ShaderStages.push_back({{}, vk::ShaderStageFlagBits::eRaygenKHR, m_ShaderModules.back(), "main"});
+        VKN_ASSERT(!createInfo.library || createInfo.libraries.empty(), "Libraries cannot link other libraries.");
+        m_Library = createInfo.library;
+
+        // NOTE: The SBT holds one handle per group
+        auto addGeneralGroup = [&](std::vector<uint32_t>& groups, uint32_t shaderIndex) {
+            groups.push_back(static_cast<uint32_t>(m_ShaderGroups.size()));
             m_ShaderGroups.push_back({vk::RayTracingShaderGroupTypeKHR::eGeneral,
-                                      rgenIndex,
+                                      shaderIndex,
                                       VK_SHADER_UNUSED_KHR,
                                       VK_SHADER_UNUSED_KHR,
                                       VK_SHADER_UNUSED_KHR});
+        };
+
+        // Raygen
+        if (createInfo.rgenGroup.raygenShader)
+        {
+            addGeneralGroup(m_RaygenGroups,
+                            addStage(createInfo.rgenGroup.raygenShader, vk::ShaderStageFlagBits::eRaygenKHR));
         }
 
         // Miss
         for (const auto& group : createInfo.missGroups)
         {
-            const auto& shader    = group.missShader;
-            uint32_t    missIndex = static_cast<uint32_t>(m_ShaderModules.size());
-            m_MissCount += 1;
-            m_ShaderModules.push_back(shader->getModule());
-            m_ShaderStages.push_back({{}, vk::ShaderStageFlagBits::eMissKHR, m_ShaderModules.back(), "main"});
-            m_ShaderGroups.push_back({vk::RayTracingShaderGroupTypeKHR::eGeneral,
-                                      missIndex,
-                                      VK_SHADER_UNUSED_KHR,
-                                      VK_SHADER_UNUSED_KHR,
-                                      VK_SHADER_UNUSED_KHR});
+            addGeneralGroup(m_MissGroups, addStage(group.missShader, vk::ShaderStageFlagBits::eMissKHR));
         }
 
         // Hit
         for (const auto& group : createInfo.hitGroups)
         {
-            const auto& chitShader = group.chitShader;
-            const auto& ahitShader = group.ahitShader;
-
             uint32_t chitIndex = VK_SHADER_UNUSED_KHR;
             uint32_t ahitIndex = VK_SHADER_UNUSED_KHR;
-            if (chitShader)
+            uint32_t intIndex  = VK_SHADER_UNUSED_KHR;
+            if (group.chitShader)
             {
-                chitIndex = static_cast<uint32_t>(m_ShaderModules.size());
-                m_HitCount += 1;
-                m_ShaderModules.push_back(chitShader->getModule());
-                m_ShaderStages.push_back({{}, vk::ShaderStageFlagBits::eClosestHitKHR, m_ShaderModules.back(), "main"});
+                chitIndex = addStage(group.chitShader, vk::ShaderStageFlagBits::eClosestHitKHR);
             }
-            if (ahitShader)
+            if (group.ahitShader)
             {
-                ahitIndex = static_cast<uint32_t>(m_ShaderModules.size());
-                m_HitCount += 1;
-                m_ShaderModules.push_back(ahitShader->getModule());
-                m_ShaderStages.push_back({{}, vk::ShaderStageFlagBits::eAnyHitKHR, m_ShaderModules.back(), "main"});
+                ahitIndex = addStage(group.ahitShader, vk::ShaderStageFlagBits::eAnyHitKHR);
             }
-            m_ShaderGroups.push_back({vk::RayTracingShaderGroupTypeKHR::eTrianglesHitGroup,
+            if (group.intShader)
+            {
+                intIndex = addStage(group.intShader, vk::ShaderStageFlagBits::eIntersectionKHR);
+            }
+            m_HitGroups.push_back(static_cast<uint32_t>(m_ShaderGroups.size()));
+            m_ShaderGroups.push_back({group.intShader ? vk::RayTracingShaderGroupTypeKHR::eProceduralHitGroup :
+                                                        vk::RayTracingShaderGroupTypeKHR::eTrianglesHitGroup,
                                       VK_SHADER_UNUSED_KHR,
                                       chitIndex,
                                       ahitIndex,
-                                      VK_SHADER_UNUSED_KHR});
+                                      intIndex});
+        }
+
+        // Callable
+        for (const auto& group : createInfo.callableGroups)
+        {
+            addGeneralGroup(m_CallableGroups, addStage(group.callableShader, vk::ShaderStageFlagBits::eCallableKHR));
+        }
+
+        // Libraries
+        // NOTE: Group indices of a linked library follow the groups of this pipeline and of the previous libraries
+        std::vector<vk::Pipeline> libraryPipelines;
+        auto                      groupCount = static_cast<uint32_t>(m_ShaderGroups.size());
+        for (const auto& library : createInfo.libraries)
+        {
+            VKN_ASSERT(library->m_Library, "Linked pipelines must be created with library = true.");
+            if (createInfo.linkTimeOptimization)
+            {
+                auto firstStage = static_cast<uint32_t>(m_ShaderStages.size());
+                m_Shaders.insert(m_Shaders.end(), library->m_Shaders.begin(), library->m_Shaders.end());
+                m_ShaderStages.insert(
+                    m_ShaderStages.end(), library->m_ShaderStages.begin(), library->m_ShaderStages.end());
+                for (auto group : library->m_ShaderGroups)
+                {
+                    for (uint32_t* shader : {&group.generalShader,
+                                             &group.closestHitShader,
+                                             &group.anyHitShader,
+                                             &group.intersectionShader})
+                    {
+                        if (*shader != VK_SHADER_UNUSED_KHR)
+                        {
+                            *shader += firstStage;
+                        }
+                    }
+                    m_ShaderGroups.push_back(group);
+                }
+            }
+            else
+            {
+                m_Libraries.push_back(library);
+                libraryPipelines.push_back(*library->m_Pipeline);
+            }
+
+            auto appendGroups = [&](std::vector<uint32_t>& groups, const std::vector<uint32_t>& libraryGroups) {
+                for (uint32_t group : libraryGroups)
+                {
+                    groups.push_back(groupCount + group);
+                }
+            };
+            appendGroups(m_RaygenGroups, library->m_RaygenGroups);
+            appendGroups(m_MissGroups, library->m_MissGroups);
+            appendGroups(m_HitGroups, library->m_HitGroups);
+            appendGroups(m_CallableGroups, library->m_CallableGroups);
+            groupCount += static_cast<uint32_t>(library->m_ShaderGroups.size());
         }
 
         vk::PushConstantRange pushRange;
@@ -441,18 +490,37 @@ namespace vulkaninja
         pushRange.setStageFlags(m_ShaderStageFlags);
 
         vk::PipelineLayoutCreateInfo layoutInfo;
-        layoutInfo.setSetLayouts(createInfo.descSetLayout);
+        layoutInfo.setSetLayouts(createInfo.descSetLayouts);
         if (m_PushSize)
         {
             layoutInfo.setPushConstantRanges(pushRange);
         }
         m_PipelineLayout = m_Context->getDevice().createPipelineLayoutUnique(layoutInfo);
 
+        vk::RayTracingPipelineInterfaceCreateInfoKHR interfaceInfo;
+        interfaceInfo.setMaxPipelineRayPayloadSize(createInfo.maxRayPayloadSize);
+        interfaceInfo.setMaxPipelineRayHitAttributeSize(createInfo.maxHitAttributeSize);
+
+        vk::PipelineLibraryCreateInfoKHR libraryInfo;
+        libraryInfo.setLibraries(libraryPipelines);
+
         vk::RayTracingPipelineCreateInfoKHR pipelineInfo;
         pipelineInfo.setStages(m_ShaderStages);
         pipelineInfo.setGroups(m_ShaderGroups);
         pipelineInfo.setMaxPipelineRayRecursionDepth(createInfo.maxRayRecursionDepth);
         pipelineInfo.setLayout(*m_PipelineLayout);
+        if (m_Library)
+        {
+            pipelineInfo.setFlags(vk::PipelineCreateFlagBits::eLibraryKHR);
+        }
+        if (m_Library || !createInfo.libraries.empty())
+        {
+            pipelineInfo.setPLibraryInterface(&interfaceInfo);
+        }
+        if (!libraryPipelines.empty())
+        {
+            pipelineInfo.setPLibraryInfo(&libraryInfo);
+        }
         auto res = m_Context->getDevice().createRayTracingPipelineKHRUnique(nullptr, nullptr, pipelineInfo);
         if (res.result != vk::Result::eSuccess)
         {
@@ -460,83 +528,33 @@ namespace vulkaninja
         }
         m_Pipeline = std::move(res.value);
 
-        createSBT();
-    }
-
-    void RayTracingPipeline::createSBT()
-    {
-        // Get Ray Tracing Properties
-        auto rtProperties =
-            m_Context->getPhysicalDeviceProperties2<vk::PhysicalDeviceRayTracingPipelinePropertiesKHR>();
-
-        auto alignUp = [&](uint32_t size, uint32_t alignment) -> uint32_t {
-            return (size + alignment - 1) & ~(alignment - 1);
-        };
-
-        // Calculate SBT size
-        uint32_t handleSize        = rtProperties.shaderGroupHandleSize;
-        uint32_t handleAlignment   = rtProperties.shaderGroupHandleAlignment;
-        uint32_t baseAlignment     = rtProperties.shaderGroupBaseAlignment;
-        uint32_t handleSizeAligned = alignUp(handleSize, handleAlignment);
-
-        m_RaygenRegion.setStride(alignUp(handleSizeAligned, baseAlignment));
-        m_RaygenRegion.setSize(m_RaygenRegion.stride);
-
-        m_RaygenRegion.setStride(handleSizeAligned);
-        m_RaygenRegion.setSize(alignUp(m_MissCount * handleSizeAligned, baseAlignment));
-
-        m_HitRegion.setStride(handleSizeAligned);
-        m_HitRegion.setSize(alignUp(m_HitCount * handleSizeAligned, baseAlignment));
-
-        // Create shader binding table
-        vk::DeviceSize sbtSize = m_RaygenRegion.size + m_MissRegion.size + m_HitRegion.size;
-        m_SbtBuffer            = m_Context->createBuffer({
-                       .usage  = BufferUsage::ShaderBindingTable,
-                       .memory = MemoryUsage::Host,
-                       .size   = sbtSize,
-        });
-
-        // Get shader group handles
-        uint32_t             handleCount       = m_RgenCount + m_MissCount + m_HitCount;
-        uint32_t             handleStorageSize = handleCount * handleSize;
-        std::vector<uint8_t> handleStorage(handleStorageSize);
-        auto                 result = m_Context->getDevice().getRayTracingShaderGroupHandlesKHR(
-            *m_Pipeline, 0, handleCount, handleStorageSize, handleStorage.data());
-        if (result != vk::Result::eSuccess)
-        {
-            std::cerr << "Failed to get ray tracing shader group handles.\n";
-            std::abort();
-        }
-
-        // Copy handles
-        uint8_t* sbtHead    = static_cast<uint8_t*>(m_SbtBuffer->map());
-        uint8_t* dstPtr     = sbtHead;
-        auto     copyHandle = [&](uint32_t index) {
-            std::memcpy(dstPtr, handleStorage.data() + handleSize * index, handleSize);
-        };
-
-        // Raygen
-        uint32_t handleIndex = 0;
-        copyHandle(handleIndex++);
-
-        // Miss
-        dstPtr = sbtHead + m_RaygenRegion.size;
-        for (uint32_t c = 0; c < m_MissCount; c++)
+        if (m_Library)
         {
-            copyHandle(handleIndex++);
-            dstPtr += m_MissRegion.stride;
+            return;
         }
 
-        // Hit
-        dstPtr = sbtHead + m_RaygenRegion.size + m_MissRegion.size;
-        for (uint32_t c = 0; c < m_HitCount; c++)
+        VKN_ASSERT(m_RaygenGroups.size() == 1, "Pipelines need exactly one raygen shader.");
+        uint32_t handleSize =
+            m_Context->getPhysicalDeviceProperties2<vk::PhysicalDeviceRayTracingPipelinePropertiesKHR>()
+                .shaderGroupHandleSize;
+        std::vector<uint8_t> handles = m_Context->getDevice().getRayTracingShaderGroupHandlesKHR<uint8_t>(
+            *m_Pipeline, 0, groupCount, static_cast<size_t>(groupCount) * handleSize);
+
+        // Reordered by kind, since library groups are interleaved with the groups of this pipeline
+        for (const auto* groups : {&m_RaygenGroups, &m_MissGroups, &m_HitGroups, &m_CallableGroups})
         {
-            copyHandle(handleIndex++);
-            dstPtr += m_HitRegion.stride;
+            for (uint32_t group : *groups)
+            {
+                auto first = handles.begin() + static_cast<ptrdiff_t>(group) * handleSize;
+                m_GroupHandles.insert(m_GroupHandles.end(), first, first + handleSize);
+            }
         }
+    }
 
-        m_RaygenRegion.setDeviceAddress(m_SbtBuffer->getAddress());
-        m_MissRegion.setDeviceAddress(m_SbtBuffer->getAddress() + m_RaygenRegion.size);
-        m_HitRegion.setDeviceAddress(m_SbtBuffer->getAddress() + m_RaygenRegion.size + m_MissRegion.size);
+    auto RayTracingPipeline::addStage(const ShaderHandle& shader, vk::ShaderStageFlagBits stage) -> uint32_t
+    {
+        m_Shaders.push_back(shader);
+        m_ShaderStages.push_back({{}, stage, shader->getModule(), "main"});
+        return static_cast<uint32_t>(m_ShaderStages.size() - 1);
     }
 } // namespace vulkaninja
\ No newline at end of file
@@ -0,0 +1,768 @@
+#include "vulkaninja/render_graph.hpp"
+#include "vulkaninja/buffer.hpp"
+#include "vulkaninja/command_buffer.hpp"
+#include "vulkaninja/common.hpp"
+
+#include <algorithm>
+#include <queue>
+#include <ranges>
+
+namespace
+{
+    using namespace vulkaninja;
+
+    auto getImageUsage(ResourceUsage usage) -> vk::ImageUsageFlags
+    {
+        switch (usage)
+        {
+            case ResourceUsage::eTransferSrc:
+            case ResourceUsage::eBlitSrc:
+                return vk::ImageUsageFlagBits::eTransferSrc;
+            case ResourceUsage::eTransferDst:
+            case ResourceUsage::eClearDst:
+            case ResourceUsage::eBlitDst:
+                return vk::ImageUsageFlagBits::eTransferDst;
+            case ResourceUsage::eShaderRead:
+                return vk::ImageUsageFlagBits::eSampled;
+            case ResourceUsage::eShaderWrite:
+            case ResourceUsage::eShaderReadWrite:
+                return vk::ImageUsageFlagBits::eStorage;
+            case ResourceUsage::eColorAttachment:
+                return vk::ImageUsageFlagBits::eColorAttachment;
+            case ResourceUsage::eDepthStencilAttachment:
+                return vk::ImageUsageFlagBits::eDepthStencilAttachment;
+            case ResourceUsage::eDepthStencilRead:
+                return vk::ImageUsageFlagBits::eDepthStencilAttachment | vk::ImageUsageFlagBits::eSampled;
+            default:
+                return {};
+        }
+    }
+
+    // Transient images can share one image if everything but the usage flags matches
+    auto isCompatible(const ImageCreateInfo& a, const ImageCreateInfo& b) -> bool
+    {
+        if (a.viewInfo.has_value() != b.viewInfo.has_value())
+        {
+            return false;
+        }
+        if (a.viewInfo && a.viewInfo->aspect != b.viewInfo->aspect)
+        {
+            return false;
+        }
+        return a.extent == b.extent && a.imageType == b.imageType && a.format == b.format &&
+               a.mipLevels == b.mipLevels && a.samplerInfo == b.samplerInfo && a.aliasable == b.aliasable;
+    }
+
+    auto alignUp(vk::DeviceSize size, vk::DeviceSize alignment) -> vk::DeviceSize
+    {
+        return (size + alignment - 1) & ~(alignment - 1);
+    }
+} // namespace
+
+namespace vulkaninja
+{
+    RenderGraph::RenderGraph(const Context& context, const RenderGraphCreateInfo& createInfo) :
+        m_Context {&context}, m_ShaderStages {context.getShaderStages()}, m_DebugName {createInfo.debugName}
+    {}
+
+    RenderGraph::RenderGraph(const RenderGraphCreateInfo& createInfo) :
+        m_ShaderStages {createInfo.shaderStages}, m_DebugName {createInfo.debugName}
+    {}
+
+    auto RenderGraph::importImage(const std::string& name, ImageHandle image, const ResourceState& initialState)
+        -> RenderGraphResource
+    {
+        m_Resources.push_back({
+            .name         = name,
+            .isImported   = true,
+            .image        = std::move(image),
+            .initialState = initialState,
+        });
+        m_Compiled = false;
+        return static_cast<RenderGraphResource>(m_Resources.size() - 1);
+    }
+
+    auto RenderGraph::importImage(const std::string& name, ImageHandle image) -> RenderGraphResource
+    {
+        VKN_ASSERT(image, "{} needs an initial state without an image.", name);
+        RenderGraphResource resource    = importImage(name, std::move(image), {});
+        m_Resources[resource].isTracked = true;
+        return resource;
+    }
+
+    auto RenderGraph::importBuffer(const std::string& name, BufferHandle buffer, const ResourceState& initialState)
+        -> RenderGraphResource
+    {
+        m_Resources.push_back({
+            .name         = name,
+            .isImported   = true,
+            .isBuffer     = true,
+            .buffer       = std::move(buffer),
+            .initialState = initialState,
+        });
+        m_Compiled = false;
+        return static_cast<RenderGraphResource>(m_Resources.size() - 1);
+    }
+
+    auto RenderGraph::importBuffer(const std::string& name, BufferHandle buffer) -> RenderGraphResource
+    {
+        VKN_ASSERT(buffer, "{} needs an initial state without a buffer.", name);
+        RenderGraphResource resource    = importBuffer(name, std::move(buffer), {});
+        m_Resources[resource].isTracked = true;
+        return resource;
+    }
+
+    auto RenderGraph::createImage(const std::string& name, const ImageCreateInfo& createInfo) -> RenderGraphResource
+    {
+        m_Resources.push_back({
+            .name       = name,
+            .createInfo = createInfo,
+        });
+        m_Compiled = false;
+        return static_cast<RenderGraphResource>(m_Resources.size() - 1);
+    }
+
+    auto RenderGraph::addPass(const RenderGraphPassCreateInfo& createInfo) -> uint32_t
+    {
+        for (const auto& access : createInfo.reads)
+        {
+            VKN_ASSERT(access.resource < m_Resources.size(), "Pass {} reads an unknown resource.", createInfo.name);
+        }
+        for (const auto& access : createInfo.writes)
+        {
+            VKN_ASSERT(access.resource < m_Resources.size(), "Pass {} writes an unknown resource.", createInfo.name);
+        }
+
+        m_Passes.push_back({
+            .name        = createInfo.name,
+            .reads       = {createInfo.reads.begin(), createInfo.reads.end()},
+            .writes      = {createInfo.writes.begin(), createInfo.writes.end()},
+            .sideEffects = createInfo.sideEffects,
+            .execute     = createInfo.execute,
+        });
+        m_Compiled = false;
+        return static_cast<uint32_t>(m_Passes.size() - 1);
+    }
+
+    void RenderGraph::compile()
+    {
+        cullPasses();
+        sortPasses();
+        aliasTransientImages();
+        computeBarriers();
+        m_Compiled = true;
+    }
+
+    void RenderGraph::cullPasses()
+    {
+        // Walk backwards from the passes whose results leave the graph
+        std::vector<bool> isNeeded(m_Resources.size(), false);
+        for (auto& pass : std::views::reverse(m_Passes))
+        {
+            bool isAlive = pass.sideEffects;
+            for (const auto& access : pass.writes)
+            {
+                isAlive |= m_Resources[access.resource].isImported || isNeeded[access.resource];
+            }
+
+            pass.culled = !isAlive;
+            if (isAlive)
+            {
+                for (const auto& access : pass.reads)
+                {
+                    isNeeded[access.resource] = true;
+                }
+            }
+        }
+    }
+
+    void RenderGraph::sortPasses()
+    {
+        // Dependencies follow the declaration order of accesses to each resource:
+        // read after write, write after read and write after write.
+        std::vector<std::vector<uint32_t>> successors(m_Passes.size());
+        std::vector<uint32_t>              inDegrees(m_Passes.size(), 0);
+        auto                               addEdge = [&](uint32_t from, uint32_t to) {
+            if (from != to)
+            {
+                successors[from].push_back(to);
+                inDegrees[to]++;
+            }
+        };
+
+        std::vector<uint32_t>              lastWriters(m_Resources.size(), UINT32_MAX);
+        std::vector<std::vector<uint32_t>> readers(m_Resources.size());
+        for (uint32_t i = 0; i < m_Passes.size(); i++)
+        {
+            const Pass& pass = m_Passes[i];
+            if (pass.culled)
+            {
+                continue;
+            }
+
+            for (const auto& access : pass.reads)
+            {
+                if (lastWriters[access.resource] != UINT32_MAX)
+                {
+                    addEdge(lastWriters[access.resource], i);
+                }
+                readers[access.resource].push_back(i);
+            }
+            for (const auto& access : pass.writes)
+            {
+                if (lastWriters[access.resource] != UINT32_MAX)
+                {
+                    addEdge(lastWriters[access.resource], i);
+                }
+                for (uint32_t reader : readers[access.resource])
+                {
+                    addEdge(reader, i);
+                }
+                readers[access.resource].clear();
+                lastWriters[access.resource] = i;
+            }
+        }
+
+        // NOTE: Ready passes are taken in declaration order so that the result is deterministic.
+        std::priority_queue<uint32_t, std::vector<uint32_t>, std::greater<>> readyPasses;
+        for (uint32_t i = 0; i < m_Passes.size(); i++)
+        {
+            if (!m_Passes[i].culled && inDegrees[i] == 0)
+            {
+                readyPasses.push(i);
+            }
+        }
+
+        m_CompiledPasses.clear();
+        while (!readyPasses.empty())
+        {
+            uint32_t pass = readyPasses.top();
+            readyPasses.pop();
+            m_CompiledPasses.push_back({.pass = pass});
+            for (uint32_t successor : successors[pass])
+            {
+                if (--inDegrees[successor] == 0)
+                {
+                    readyPasses.push(successor);
+                }
+            }
+        }
+    }
+
+    void RenderGraph::aliasTransientImages()
+    {
+        std::vector<RenderGraphResource> transients;
+        for (RenderGraphResource i = 0; i < m_Resources.size(); i++)
+        {
+            Resource& resource = m_Resources[i];
+            resource.physicalIndex = UINT32_MAX;
+            resource.firstUse      = UINT32_MAX;
+            resource.lastUse       = 0;
+            resource.usage         = resource.createInfo.usage;
+            if (!resource.isImported)
+            {
+                transients.push_back(i);
+            }
+        }
+
+        for (uint32_t i = 0; i < m_CompiledPasses.size(); i++)
+        {
+            const Pass& pass = m_Passes[m_CompiledPasses[i].pass];
+            for (const auto& accesses : {std::cref(pass.reads), std::cref(pass.writes)})
+            {
+                for (const auto& access : accesses.get())
+                {
+                    Resource& resource = m_Resources[access.resource];
+                    resource.firstUse  = std::min(resource.firstUse, i);
+                    resource.lastUse   = std::max(resource.lastUse, i);
+                    resource.usage |= getImageUsage(access.usage);
+                }
+            }
+        }
+
+        // Greedy placement in order of first use. Transients used only by culled passes are never created.
+        std::ranges::sort(transients, {}, [&](RenderGraphResource i) { return m_Resources[i].firstUse; });
+
+        std::vector<PhysicalImage> previousImages = std::move(m_PhysicalImages);
+        m_PhysicalImages.clear();
+
+        for (RenderGraphResource i : transients)
+        {
+            Resource& resource = m_Resources[i];
+            if (resource.firstUse == UINT32_MAX)
+            {
+                continue;
+            }
+
+            for (uint32_t j = 0; j < m_PhysicalImages.size(); j++)
+            {
+                const PhysicalImage& physicalImage = m_PhysicalImages[j];
+                if (physicalImage.lastUse < resource.firstUse &&
+                    isCompatible(physicalImage.createInfo, resource.createInfo))
+                {
+                    resource.physicalIndex = j;
+                    break;
+                }
+            }
+            if (resource.physicalIndex == UINT32_MAX)
+            {
+                resource.physicalIndex = static_cast<uint32_t>(m_PhysicalImages.size());
+                m_PhysicalImages.push_back({
+                    .createInfo    = resource.createInfo,
+                    .firstResource = i,
+                    .firstUse      = resource.firstUse,
+                });
+            }
+
+            PhysicalImage& physicalImage = m_PhysicalImages[resource.physicalIndex];
+            physicalImage.lastUse = resource.lastUse;
+            physicalImage.createInfo.usage |= resource.usage;
+        }
+
+        // Attachments never read outside a render pass may live in lazily allocated memory
+        constexpr vk::ImageUsageFlags attachmentUsage = vk::ImageUsageFlagBits::eColorAttachment |
+                                                        vk::ImageUsageFlagBits::eDepthStencilAttachment |
+                                                        vk::ImageUsageFlagBits::eInputAttachment;
+        for (auto& physicalImage : m_PhysicalImages)
+        {
+            ImageCreateInfo& createInfo = physicalImage.createInfo;
+            if (createInfo.aliasable && !(createInfo.usage & ~attachmentUsage))
+            {
+                createInfo.usage |= vk::ImageUsageFlagBits::eTransientAttachment;
+            }
+        }
+
+        // NOTE: Images from the previous compile are kept if they still fit, so recompiling an unchanged graph
+        // does not recreate them. Aliasable images cannot be bound again and are always recreated with the heaps.
+        // The others may still be used by frames in flight, so they are retired instead of destroyed.
+        retireHeaps();
+        for (auto& physicalImage : m_PhysicalImages)
+        {
+            if (physicalImage.createInfo.aliasable)
+            {
+                continue;
+            }
+            auto it = std::ranges::find_if(previousImages, [&](const PhysicalImage& previousImage) {
+                return previousImage.image && previousImage.createInfo.usage == physicalImage.createInfo.usage &&
+                       isCompatible(previousImage.createInfo, physicalImage.createInfo);
+            });
+            if (it != previousImages.end())
+            {
+                physicalImage.image = std::move(it->image);
+            }
+        }
+        for (auto& previousImage : previousImages)
+        {
+            if (previousImage.image)
+            {
+                m_RetiredResources.push_back(std::move(previousImage.image));
+            }
+        }
+    }
+
+    void RenderGraph::computeBarriers()
+    {
+        std::vector<ResourceState> states(m_Resources.size());
+        for (RenderGraphResource i = 0; i < m_Resources.size(); i++)
+        {
+            states[i] = getInitialState(m_Resources[i]);
+        }
+
+        // Physical images created by execute() continue from the last frame
+        for (auto& physicalImage : m_PhysicalImages)
+        {
+            physicalImage.lastState = physicalImage.image ? physicalImage.image->getState() : ResourceState {};
+        }
+        m_PassStates.resize(m_CompiledPasses.size());
+
+        for (uint32_t i = 0; i < m_CompiledPasses.size(); i++)
+        {
+            RenderGraphCompiledPass& compiledPass = m_CompiledPasses[i];
+            const Pass&              pass         = m_Passes[compiledPass.pass];
+            compiledPass.barriers.clear();
+            compiledPass.aliasSrcState = {};
+            compiledPass.aliasDstState = {};
+
+            for (const auto& accesses : {std::cref(pass.reads), std::cref(pass.writes)})
+            {
+                for (const auto& access : accesses.get())
+                {
+                    Resource&      resource = m_Resources[access.resource];
+                    ResourceState& state    = states[access.resource];
+                    ResourceState  dstState = getResourceState(access.usage, m_ShaderStages);
+
+                    // The contents of a transient image are discarded on first use,
+                    // but the previous occupant of its physical image must be done with it.
+                    if (!resource.isImported && resource.firstUse == i)
+                    {
+                        const PhysicalImage& physicalImage = m_PhysicalImages[resource.physicalIndex];
+                        const ResourceState& lastState     = physicalImage.lastState;
+                        state = {vk::ImageLayout::eUndefined, lastState.stage, lastState.access};
+
+                        // Other images used the same memory, possibly with other layouts. A barrier on this image
+                        // covers only its own accesses, so their writes are waited for with a global memory barrier.
+                        // NOTE: The layout transition of this image must also wait for them.
+                        for (uint32_t alias : physicalImage.aliases)
+                        {
+                            const ResourceState& aliasState = m_PhysicalImages[alias].lastState;
+                            state.stage |= aliasState.stage;
+                            compiledPass.aliasSrcState.stage |= aliasState.stage;
+                            compiledPass.aliasSrcState.access |= aliasState.access;
+                        }
+                        if (compiledPass.aliasSrcState.stage)
+                        {
+                            compiledPass.aliasDstState.stage |= dstState.stage;
+                            compiledPass.aliasDstState.access |= dstState.access;
+                        }
+                    }
+
+                    // NOTE: Same merge rule as CommandBuffer::declareUsage()
+                    auto it = std::ranges::find(compiledPass.barriers, access.resource, &RenderGraphBarrier::resource);
+                    if (it != compiledPass.barriers.end() && state == dstState)
+                    {
+                        continue;
+                    }
+
+                    std::optional<ResourceState> srcState = advanceState(state, dstState, !resource.isBuffer);
+                    if (!srcState)
+                    {
+                        continue;
+                    }
+                    if (it != compiledPass.barriers.end())
+                    {
+                        it->dstState.layout = dstState.layout;
+                        it->dstState.stage |= dstState.stage;
+                        it->dstState.access |= dstState.access;
+                    }
+                    else
+                    {
+                        compiledPass.barriers.push_back({access.resource, *srcState, dstState});
+                    }
+                }
+            }
+
+            std::vector<PassState>& passStates = m_PassStates[i];
+            passStates.clear();
+            for (const auto& accesses : {std::cref(pass.reads), std::cref(pass.writes)})
+            {
+                for (const auto& access : accesses.get())
+                {
+                    Resource& resource = m_Resources[access.resource];
+                    if (!resource.isImported)
+                    {
+                        m_PhysicalImages[resource.physicalIndex].lastState = states[access.resource];
+                    }
+                    if (std::ranges::find(passStates, access.resource, &PassState::resource) == passStates.end())
+                    {
+                        passStates.push_back({access.resource, states[access.resource]});
+                    }
+                }
+            }
+        }
+
+        for (RenderGraphResource i = 0; i < m_Resources.size(); i++)
+        {
+            m_Resources[i].finalState = states[i];
+        }
+
+        // In steady state, the first occupant of a physical image waits for the last one of the previous frame.
+        // NOTE: Created images already started from the state the previous frame left them in.
+        for (const auto& physicalImage : m_PhysicalImages)
+        {
+            if (physicalImage.image)
+            {
+                continue;
+            }
+            const Resource& resource = m_Resources[physicalImage.firstResource];
+            auto&           barriers = m_CompiledPasses[resource.firstUse].barriers;
+            auto it = std::ranges::find(barriers, physicalImage.firstResource, &RenderGraphBarrier::resource);
+            if (it != barriers.end())
+            {
+                it->srcState.stage  = physicalImage.lastState.stage;
+                it->srcState.access = physicalImage.lastState.access;
+            }
+        }
+    }
+
+    void RenderGraph::execute(const CommandBufferHandle& commandBuffer)
+    {
+        VKN_ASSERT(m_Context, "An offline RenderGraph can only be compiled.");
+        if (!m_Compiled)
+        {
+            compile();
+        }
+
+        bool hasNewAliasableImages = false;
+        for (auto& physicalImage : m_PhysicalImages)
+        {
+            if (!physicalImage.image)
+            {
+                physicalImage.image = m_Context->createImage(physicalImage.createInfo);
+                hasNewAliasableImages |= physicalImage.createInfo.aliasable;
+            }
+        }
+        if (hasNewAliasableImages)
+        {
+            allocateHeaps();
+        }
+        for (auto& resource : m_Resources)
+        {
+            if (!resource.isImported && resource.physicalIndex != UINT32_MAX)
+            {
+                resource.image = m_PhysicalImages[resource.physicalIndex].image;
+            }
+        }
+
+        for (auto& resource : m_RetiredResources)
+        {
+            commandBuffer->keepAlive(std::move(resource));
+        }
+        m_RetiredResources.clear();
+
+        // NOTE: Computed again now that every image exists, so that the barriers start from
+        // the states tracked on imported resources and on the images of the previous frame.
+        computeBarriers();
+
+        if (!m_DebugName.empty())
+        {
+            commandBuffer->beginDebugLabel(m_DebugName.c_str());
+        }
+
+        std::vector<vk::BufferMemoryBarrier2> bufferBarriers;
+        std::vector<vk::ImageMemoryBarrier2>  imageBarriers;
+        std::vector<vk::MemoryBarrier2>       memoryBarriers;
+        for (uint32_t i = 0; i < m_CompiledPasses.size(); i++)
+        {
+            const RenderGraphCompiledPass& compiledPass = m_CompiledPasses[i];
+            const Pass&                    pass         = m_Passes[compiledPass.pass];
+
+            bufferBarriers.clear();
+            imageBarriers.clear();
+            memoryBarriers.clear();
+            if (compiledPass.aliasSrcState.stage)
+            {
+                vk::MemoryBarrier2& barrier = memoryBarriers.emplace_back();
+                barrier.setSrcStageMask(compiledPass.aliasSrcState.stage);
+                barrier.setDstStageMask(compiledPass.aliasDstState.stage);
+                barrier.setSrcAccessMask(compiledPass.aliasSrcState.access & WriteAccess);
+                barrier.setDstAccessMask(compiledPass.aliasDstState.access);
+            }
+            for (const auto& compiledBarrier : compiledPass.barriers)
+            {
+                const Resource& resource = m_Resources[compiledBarrier.resource];
+                if (resource.isBuffer)
+                {
+                    vk::BufferMemoryBarrier2& barrier = bufferBarriers.emplace_back();
+                    barrier.setSrcQueueFamilyIndex(VK_QUEUE_FAMILY_IGNORED);
+                    barrier.setDstQueueFamilyIndex(VK_QUEUE_FAMILY_IGNORED);
+                    barrier.setBuffer(resource.buffer->getBuffer());
+                    barrier.setOffset(0);
+                    barrier.setSize(VK_WHOLE_SIZE);
+                    barrier.setSrcStageMask(compiledBarrier.srcState.stage);
+                    barrier.setDstStageMask(compiledBarrier.dstState.stage);
+                    barrier.setSrcAccessMask(compiledBarrier.srcState.access & WriteAccess);
+                    barrier.setDstAccessMask(compiledBarrier.dstState.access);
+                    continue;
+                }
+
+                const Image&             image   = *resource.image;
+                vk::ImageMemoryBarrier2& barrier = imageBarriers.emplace_back();
+                barrier.setSrcQueueFamilyIndex(VK_QUEUE_FAMILY_IGNORED);
+                barrier.setDstQueueFamilyIndex(VK_QUEUE_FAMILY_IGNORED);
+                barrier.setImage(image.getImage());
+                barrier.setOldLayout(compiledBarrier.srcState.layout);
+                barrier.setNewLayout(compiledBarrier.dstState.layout);
+                barrier.setSrcStageMask(compiledBarrier.srcState.stage);
+                barrier.setDstStageMask(compiledBarrier.dstState.stage);
+                barrier.setSrcAccessMask(compiledBarrier.srcState.access & WriteAccess);
+                barrier.setDstAccessMask(compiledBarrier.dstState.access);
+                barrier.subresourceRange.aspectMask     = image.getAspectMask();
+                barrier.subresourceRange.baseMipLevel   = 0;
+                barrier.subresourceRange.baseArrayLayer = 0;
+                barrier.subresourceRange.layerCount     = image.getLayerCount();
+                barrier.subresourceRange.levelCount     = image.getMipLevels();
+            }
+            commandBuffer->pipelineBarrier(bufferBarriers, imageBarriers, memoryBarriers);
+
+            // The tracked states follow the graph, so commands declared in the pass start from them
+            for (const auto& passState : m_PassStates[i])
+            {
+                const Resource& resource = m_Resources[passState.resource];
+                if (resource.isBuffer)
+                {
+                    resource.buffer->setState(passState.state);
+                }
+                else
+                {
+                    resource.image->setState(passState.state);
+                }
+            }
+
+            commandBuffer->beginDebugLabel(pass.name.c_str());
+            if (pass.execute)
+            {
+                pass.execute(commandBuffer);
+            }
+            commandBuffer->endDebugLabel();
+        }
+
+        if (!m_DebugName.empty())
+        {
+            commandBuffer->endDebugLabel();
+        }
+    }
+
+    void RenderGraph::allocateHeaps()
+    {
+        // NOTE: Images needing different memory types cannot share memory, so there is one heap per type.
+        vk::PhysicalDeviceMemoryProperties memoryProperties = m_Context->getPhysicalDevice().getMemoryProperties();
+
+        std::vector<std::vector<uint32_t>>  groups(memoryProperties.memoryTypeCount);
+        std::vector<vk::MemoryRequirements> requirements(m_PhysicalImages.size());
+        for (uint32_t i = 0; i < m_PhysicalImages.size(); i++)
+        {
+            const PhysicalImage& physicalImage = m_PhysicalImages[i];
+            if (!physicalImage.createInfo.aliasable)
+            {
+                continue;
+            }
+            requirements[i] = physicalImage.image->getMemoryRequirements();
+
+            // Lazily allocated memory is only committed if the tiles are spilled, e.g. on mobile GPUs
+            uint32_t memoryTypeIndex = UINT32_MAX;
+            if (physicalImage.createInfo.usage & vk::ImageUsageFlagBits::eTransientAttachment)
+            {
+                for (uint32_t j = 0; j < memoryProperties.memoryTypeCount; j++)
+                {
+                    if ((requirements[i].memoryTypeBits & (1 << j)) &&
+                        (memoryProperties.memoryTypes[j].propertyFlags & vk::MemoryPropertyFlagBits::eLazilyAllocated))
+                    {
+                        memoryTypeIndex = j;
+                        break;
+                    }
+                }
+            }
+            if (memoryTypeIndex == UINT32_MAX)
+            {
+                memoryTypeIndex =
+                    m_Context->findMemoryTypeIndex(requirements[i], vk::MemoryPropertyFlagBits::eDeviceLocal);
+            }
+            groups[memoryTypeIndex].push_back(i);
+        }
+
+        auto isAliveTogether = [&](uint32_t a, uint32_t b) {
+            return m_PhysicalImages[a].firstUse <= m_PhysicalImages[b].lastUse &&
+                   m_PhysicalImages[b].firstUse <= m_PhysicalImages[a].lastUse;
+        };
+
+        retireHeaps();
+        for (uint32_t memoryTypeIndex = 0; memoryTypeIndex < groups.size(); memoryTypeIndex++)
+        {
+            std::vector<uint32_t>& group = groups[memoryTypeIndex];
+            if (group.empty())
+            {
+                continue;
+            }
+
+            // Largest first, each at the lowest offset not used by an image alive at the same time.
+            // The heap then grows only to the peak of live memory.
+            std::ranges::sort(group, std::greater<>(), [&](uint32_t i) { return requirements[i].size; });
+
+            std::vector<vk::DeviceSize> offsets(m_PhysicalImages.size(), 0);
+            std::vector<uint32_t>       placedImages;
+            vk::DeviceSize              heapSize = 0;
+            for (uint32_t i : group)
+            {
+                vk::DeviceSize offset  = 0;
+                bool           isMoved = true;
+                while (isMoved)
+                {
+                    isMoved = false;
+                    for (uint32_t j : placedImages)
+                    {
+                        bool isOverlapped = offset < offsets[j] + requirements[j].size &&
+                                            offsets[j] < offset + requirements[i].size;
+                        if (isOverlapped && isAliveTogether(i, j))
+                        {
+                            offset  = alignUp(offsets[j] + requirements[j].size, requirements[i].alignment);
+                            isMoved = true;
+                        }
+                    }
+                }
+                offsets[i] = offset;
+                heapSize   = std::max(heapSize, offset + requirements[i].size);
+                placedImages.push_back(i);
+            }
+
+            // Images sharing memory at different times must wait for each other before discarding the contents
+            for (uint32_t i : group)
+            {
+                m_PhysicalImages[i].aliases.clear();
+                for (uint32_t j : group)
+                {
+                    if (i != j && offsets[i] < offsets[j] + requirements[j].size &&
+                        offsets[j] < offsets[i] + requirements[i].size)
+                    {
+                        m_PhysicalImages[i].aliases.push_back(j);
+                    }
+                }
+            }
+
+            vk::MemoryAllocateInfo memoryInfo;
+            memoryInfo.setAllocationSize(heapSize);
+            memoryInfo.setMemoryTypeIndex(memoryTypeIndex);
+
+            Heap& heap  = m_Heaps.emplace_back();
+            heap.memory = m_Context->getDevice().allocateMemoryUnique(memoryInfo);
+            heap.size   = heapSize;
+            if (!m_DebugName.empty())
+            {
+                m_Context->setDebugName(*heap.memory, (m_DebugName + "::heap").c_str());
+            }
+            for (uint32_t i : group)
+            {
+                m_PhysicalImages[i].image->bindMemory(*heap.memory, offsets[i]);
+            }
+        }
+    }
+
+    void RenderGraph::retireHeaps()
+    {
+        for (auto& heap : m_Heaps)
+        {
+            m_RetiredResources.push_back(std::make_shared<Heap>(std::move(heap)));
+        }
+        m_Heaps.clear();
+    }
+
+    auto RenderGraph::getInitialState(const Resource& resource) const -> ResourceState
+    {
+        if (!resource.isTracked)
+        {
+            return resource.initialState;
+        }
+        return resource.isBuffer ? resource.buffer->getState() : resource.image->getState();
+    }
+
+    auto RenderGraph::getHeapSize() const -> vk::DeviceSize
+    {
+        vk::DeviceSize heapSize = 0;
+        for (const auto& heap : m_Heaps)
+        {
+            heapSize += heap.size;
+        }
+        return heapSize;
+    }
+
+    auto RenderGraph::getImage(RenderGraphResource resource) const -> ImageHandle
+    {
+        VKN_ASSERT(!m_Resources[resource].isBuffer, "{} is not an image.", m_Resources[resource].name);
+        return m_Resources[resource].image;
+    }
+
+    auto RenderGraph::getBuffer(RenderGraphResource resource) const -> BufferHandle
+    {
+        VKN_ASSERT(m_Resources[resource].isBuffer, "{} is not a buffer.", m_Resources[resource].name);
+        return m_Resources[resource].buffer;
+    }
+} // namespace vulkaninja
@@ -0,0 +1,202 @@
+#include "vulkaninja/resource_state.hpp"
+
+namespace vulkaninja
+{
+    using Stage  = vk::PipelineStageFlagBits2;
+    using Access = vk::AccessFlagBits2;
+    using Layout = vk::ImageLayout;
+
+    auto getResourceState(ResourceUsage usage, vk::PipelineStageFlags2 shaderStages) -> ResourceState
+    {
+        static constexpr vk::PipelineStageFlags2 depthStages = Stage::eEarlyFragmentTests | Stage::eLateFragmentTests;
+
+        switch (usage)
+        {
+            case ResourceUsage::eUndefined:
+                return {Layout::eUndefined, Stage::eNone, Access::eNone};
+            case ResourceUsage::eTransferSrc:
+                return {Layout::eTransferSrcOptimal, Stage::eCopy, Access::eTransferRead};
+            case ResourceUsage::eTransferDst:
+                return {Layout::eTransferDstOptimal, Stage::eCopy, Access::eTransferWrite};
+            case ResourceUsage::eClearDst:
+                return {Layout::eTransferDstOptimal, Stage::eClear, Access::eTransferWrite};
+            case ResourceUsage::eBlitSrc:
+                return {Layout::eTransferSrcOptimal, Stage::eBlit, Access::eTransferRead};
+            case ResourceUsage::eBlitDst:
+                return {Layout::eTransferDstOptimal, Stage::eBlit, Access::eTransferWrite};
+            case ResourceUsage::eVertexBuffer:
+                return {Layout::eUndefined, Stage::eVertexAttributeInput, Access::eVertexAttributeRead};
+            case ResourceUsage::eIndexBuffer:
+                return {Layout::eUndefined, Stage::eIndexInput, Access::eIndexRead};
+            case ResourceUsage::eIndirectBuffer:
+                return {Layout::eUndefined, Stage::eDrawIndirect, Access::eIndirectCommandRead};
+            case ResourceUsage::eUniformBuffer:
+                return {Layout::eUndefined, shaderStages, Access::eUniformRead};
+            case ResourceUsage::eShaderRead:
+                return {Layout::eShaderReadOnlyOptimal,
+                        shaderStages,
+                        Access::eShaderSampledRead | Access::eShaderStorageRead};
+            case ResourceUsage::eShaderWrite:
+                return {Layout::eGeneral, shaderStages, Access::eShaderStorageWrite};
+            case ResourceUsage::eShaderReadWrite:
+                return {Layout::eGeneral, shaderStages, Access::eShaderStorageRead | Access::eShaderStorageWrite};
+            case ResourceUsage::eColorAttachment:
+                return {Layout::eColorAttachmentOptimal,
+                        Stage::eColorAttachmentOutput,
+                        Access::eColorAttachmentRead | Access::eColorAttachmentWrite};
+            case ResourceUsage::eDepthStencilAttachment:
+                return {Layout::eDepthStencilAttachmentOptimal,
+                        depthStages,
+                        Access::eDepthStencilAttachmentRead | Access::eDepthStencilAttachmentWrite};
+            case ResourceUsage::eDepthStencilRead:
+                return {Layout::eDepthStencilReadOnlyOptimal,
+                        depthStages | shaderStages,
+                        Access::eDepthStencilAttachmentRead | Access::eShaderSampledRead};
+            case ResourceUsage::eAccelBuildInput:
+                return {Layout::eUndefined, Stage::eAccelerationStructureBuildKHR, Access::eShaderRead};
+            case ResourceUsage::eAccelBuild:
+                return {Layout::eUndefined,
+                        Stage::eAccelerationStructureBuildKHR,
+                        Access::eAccelerationStructureReadKHR | Access::eAccelerationStructureWriteKHR};
+            case ResourceUsage::eAccelBuildSource:
+                return {Layout::eUndefined,
+                        Stage::eAccelerationStructureBuildKHR,
+                        Access::eAccelerationStructureReadKHR};
+            case ResourceUsage::eAccelRead:
+                return {Layout::eUndefined, shaderStages, Access::eAccelerationStructureReadKHR};
+            case ResourceUsage::eShaderBindingTable:
+                return {Layout::eUndefined, Stage::eRayTracingShaderKHR, Access::eShaderRead};
+            case ResourceUsage::ePresent:
+                return {Layout::ePresentSrcKHR, Stage::eNone, Access::eNone};
+            case ResourceUsage::eHostRead:
+                return {Layout::eGeneral, Stage::eHost, Access::eHostRead};
+            case ResourceUsage::eHostWrite:
+                return {Layout::eGeneral, Stage::eHost, Access::eHostWrite};
+        }
+        return {Layout::eGeneral, Stage::eAllCommands, Access::eMemoryRead | Access::eMemoryWrite};
+    }
+
+    auto getResourceState(vk::ImageLayout         layout,
+                          vk::ImageAspectFlags    aspect,
+                          vk::PipelineStageFlags2 shaderStages) -> ResourceState
+    {
+        bool isDepthStencil = static_cast<bool>(aspect & (vk::ImageAspectFlagBits::eDepth | //
+                                                          vk::ImageAspectFlagBits::eStencil));
+        switch (layout)
+        {
+            case Layout::eUndefined:
+                return getResourceState(ResourceUsage::eUndefined, shaderStages);
+            case Layout::eShaderReadOnlyOptimal:
+                return getResourceState(ResourceUsage::eShaderRead, shaderStages);
+            case Layout::eColorAttachmentOptimal:
+                return getResourceState(ResourceUsage::eColorAttachment, shaderStages);
+            case Layout::eDepthAttachmentOptimal:
+            case Layout::eDepthStencilAttachmentOptimal:
+                return getResourceState(ResourceUsage::eDepthStencilAttachment, shaderStages);
+            case Layout::eDepthReadOnlyOptimal:
+            case Layout::eDepthStencilReadOnlyOptimal:
+                return getResourceState(ResourceUsage::eDepthStencilRead, shaderStages);
+            case Layout::ePresentSrcKHR:
+                return getResourceState(ResourceUsage::ePresent, shaderStages);
+            default:
+                break;
+        }
+
+        // Layouts that do not tell the exact command or depend on the aspect
+        ResourceState state;
+        if (layout == Layout::eTransferSrcOptimal)
+        {
+            state = {layout, Stage::eAllTransfer, Access::eTransferRead};
+        }
+        else if (layout == Layout::eTransferDstOptimal)
+        {
+            state = {layout, Stage::eAllTransfer, Access::eTransferWrite};
+        }
+        else if (layout == Layout::eAttachmentOptimal)
+        {
+            state = getResourceState(isDepthStencil ? ResourceUsage::eDepthStencilAttachment :
+                                                      ResourceUsage::eColorAttachment,
+                                     shaderStages);
+        }
+        else if (layout == Layout::eReadOnlyOptimal)
+        {
+            state = getResourceState(isDepthStencil ? ResourceUsage::eDepthStencilRead : ResourceUsage::eShaderRead,
+                                     shaderStages);
+        }
+        else
+        {
+            // NOTE: eGeneral can be used by any command, so it is synchronized conservatively.
+            state = {layout, Stage::eAllCommands, Access::eMemoryRead | Access::eMemoryWrite};
+        }
+        state.layout = layout;
+        return state;
+    }
+
+    auto advanceState(ResourceState& state, const ResourceState& dstState, bool isImage)
+        -> std::optional<ResourceState>
+    {
+        ResourceState srcState = state;
+
+        bool isReadOnly   = !(srcState.access & WriteAccess) && !(dstState.access & WriteAccess);
+        bool isLayoutKept = !isImage || srcState.layout == dstState.layout;
+        if (isReadOnly && isLayoutKept)
+        {
+            // Readers accumulate so that the next write waits for all of them
+            state.stage |= dstState.stage;
+            state.access |= dstState.access;
+
+            // NOTE: Reads after reads need a barrier only if the previous barrier did not cover these stages.
+            bool isCovered = !(dstState.stage & ~srcState.stage) && !(dstState.access & ~srcState.access);
+            if (isCovered || !srcState.stage)
+            {
+                return std::nullopt;
+            }
+            return srcState;
+        }
+
+        state = dstState;
+
+        // NOTE: Nothing to wait for if the buffer has not been used by any command yet
+        if (!isImage && !srcState.stage)
+        {
+            return std::nullopt;
+        }
+        return srcState;
+    }
+
+    auto toLegacyStage(vk::PipelineStageFlags2 stage, bool isSrc) -> vk::PipelineStageFlags
+    {
+        if (!stage)
+        {
+            return isSrc ? vk::PipelineStageFlagBits::eTopOfPipe : vk::PipelineStageFlagBits::eBottomOfPipe;
+        }
+
+        // NOTE: Flags shared with vkCmdPipelineBarrier have the same bit values
+        auto legacy = vk::PipelineStageFlags(static_cast<VkPipelineStageFlags>(
+            static_cast<VkPipelineStageFlags2>(stage) & static_cast<VkPipelineStageFlags2>(0xFFFFFFFF)));
+        if (stage & (Stage::eCopy | Stage::eBlit | Stage::eClear | Stage::eResolve))
+        {
+            legacy |= vk::PipelineStageFlagBits::eTransfer;
+        }
+        if (stage & (Stage::eIndexInput | Stage::eVertexAttributeInput))
+        {
+            legacy |= vk::PipelineStageFlagBits::eVertexInput;
+        }
+        return legacy;
+    }
+
+    auto toLegacyAccess(vk::AccessFlags2 access) -> vk::AccessFlags
+    {
+        auto legacy = vk::AccessFlags(static_cast<VkAccessFlags>(static_cast<VkAccessFlags2>(access) &
+                                                                 static_cast<VkAccessFlags2>(0xFFFFFFFF)));
+        if (access & (Access::eShaderSampledRead | Access::eShaderStorageRead))
+        {
+            legacy |= vk::AccessFlagBits::eShaderRead;
+        }
+        if (access & Access::eShaderStorageWrite)
+        {
+            legacy |= vk::AccessFlagBits::eShaderWrite;
+        }
+        return legacy;
+    }
+} // namespace vulkaninja
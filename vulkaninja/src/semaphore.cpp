@@ -0,0 +1,48 @@
+#include "vulkaninja/semaphore.hpp"
+#include "vulkaninja/common.hpp"
+#include "vulkaninja/context.hpp"
+
+namespace vulkaninja
+{
+    Semaphore::Semaphore(const Context& context, const SemaphoreCreateInfo& createInfo) :
+        m_Context(&context), m_Timeline(createInfo.timeline)
+    {
+        vk::SemaphoreTypeCreateInfo typeInfo;
+        typeInfo.setSemaphoreType(vk::SemaphoreType::eTimeline);
+        typeInfo.setInitialValue(createInfo.initialValue);
+
+        vk::SemaphoreCreateInfo semaphoreInfo;
+        if (m_Timeline)
+        {
+            semaphoreInfo.setPNext(&typeInfo);
+        }
+        m_Semaphore = m_Context->getDevice().createSemaphoreUnique(semaphoreInfo);
+    }
+
+    auto Semaphore::getValue() const -> uint64_t
+    {
+        VKN_ASSERT(m_Timeline, "This semaphore is not a timeline semaphore.");
+        return m_Context->getDevice().getSemaphoreCounterValue(*m_Semaphore);
+    }
+
+    void Semaphore::wait(uint64_t value) const
+    {
+        VKN_ASSERT(m_Timeline, "This semaphore is not a timeline semaphore.");
+        vk::SemaphoreWaitInfo waitInfo;
+        waitInfo.setSemaphores(*m_Semaphore);
+        waitInfo.setValues(value);
+        if (m_Context->getDevice().waitSemaphores(waitInfo, UINT64_MAX) != vk::Result::eSuccess)
+        {
+            throw std::runtime_error("Failed to wait for semaphore");
+        }
+    }
+
+    void Semaphore::signal(uint64_t value) const
+    {
+        VKN_ASSERT(m_Timeline, "This semaphore is not a timeline semaphore.");
+        vk::SemaphoreSignalInfo signalInfo;
+        signalInfo.setSemaphore(*m_Semaphore);
+        signalInfo.setValue(value);
+        m_Context->getDevice().signalSemaphore(signalInfo);
+    }
+} // namespace vulkaninja
@@ -1,4 +1,5 @@
 #include "vulkaninja/shader.hpp"
+#include "vulkaninja/shader_compiler.hpp"
 
 namespace vulkaninja
 {
@@ -9,4 +10,23 @@ namespace vulkaninja
         moduleInfo.setCode(m_SpvCode);
         m_ShaderModule = context.getDevice().createShaderModuleUnique(moduleInfo);
     }
+
+    auto Shader::createComputeShader(
+        const Context&                                                                      context,
+        const std::string&                                                                  code,
+        const std::string&                                                                  name,
+        const std::vector<std::variant<std::string, std::tuple<std::string, std::string>>>& keywords) -> ShaderHandle
+    {
+        std::vector<uint32_t> spv;
+        std::string           message;
+        if (!ShaderCompiler::compileShaderFromSource(
+                code, ShaderCompiler::ShaderStage::eCompute, "main", name, keywords, spv, message))
+        {
+            throw std::runtime_error("Failed to compile " + name + ": " + message);
+        }
+        return context.createShader({
+            .code  = spv,
+            .stage = vk::ShaderStageFlagBits::eCompute,
+        });
+    }
 } // namespace vulkaninja
\ No newline at end of file
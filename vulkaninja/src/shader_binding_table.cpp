@@ -0,0 +1,151 @@
+#include "vulkaninja/shader_binding_table.hpp"
+#include "vulkaninja/command_buffer.hpp"
+#include "vulkaninja/common.hpp"
+#include "vulkaninja/pipeline.hpp"
+
+#include <cstring>
+
+namespace
+{
+    auto alignUp(vk::DeviceSize size, vk::DeviceSize alignment) -> vk::DeviceSize
+    {
+        return (size + alignment - 1) & ~(alignment - 1);
+    }
+} // namespace
+
+namespace vulkaninja
+{
+    ShaderBindingTable::ShaderBindingTable(const Context& context, const ShaderBindingTableCreateInfo& createInfo) :
+        m_Context {&context}
+    {
+        VKN_ASSERT(createInfo.pipeline, "ShaderBindingTable needs a pipeline.");
+        const RayTracingPipeline& pipeline = *createInfo.pipeline;
+        m_GroupHandles                     = pipeline.getGroupHandles();
+
+        auto rtProperties =
+            m_Context->getPhysicalDeviceProperties2<vk::PhysicalDeviceRayTracingPipelinePropertiesKHR>();
+        m_HandleSize                 = rtProperties.shaderGroupHandleSize;
+        vk::DeviceSize baseAlignment = rtProperties.shaderGroupBaseAlignment;
+
+        // Raygen, whose stride must equal its size
+        vk::DeviceSize handleSizeAligned = alignUp(m_HandleSize, rtProperties.shaderGroupHandleAlignment);
+        vk::DeviceSize raygenSize        = alignUp(handleSizeAligned, baseAlignment);
+        m_RaygenRegion.setStride(raygenSize);
+        m_RaygenRegion.setSize(raygenSize);
+
+        m_Miss.firstGroup     = 1;
+        m_Miss.groupCount     = pipeline.getMissGroupCount();
+        m_Miss.dataSize       = createInfo.missDataSize;
+        m_Miss.recordCount    = createInfo.missRecords.empty() ? m_Miss.groupCount : createInfo.missRecords.size();
+        m_Hit.firstGroup      = m_Miss.firstGroup + m_Miss.groupCount;
+        m_Hit.groupCount      = pipeline.getHitGroupCount();
+        m_Hit.dataSize        = createInfo.hitDataSize;
+        m_Hit.recordCount     = createInfo.hitRecords.empty() ? m_Hit.groupCount : createInfo.hitRecords.size();
+        m_Callable.firstGroup = m_Hit.firstGroup + m_Hit.groupCount;
+        m_Callable.groupCount = pipeline.getCallableGroupCount();
+        m_Callable.dataSize   = createInfo.callableDataSize;
+        m_Callable.recordCount =
+            createInfo.callableRecords.empty() ? m_Callable.groupCount : createInfo.callableRecords.size();
+
+        // Each region starts at the base alignment
+        vk::DeviceSize offset = raygenSize;
+        for (Region* region : {&m_Miss, &m_Hit, &m_Callable})
+        {
+            region->stride = static_cast<uint32_t>(
+                alignUp(m_HandleSize + region->dataSize, rtProperties.shaderGroupHandleAlignment));
+            region->offset = offset;
+            VKN_ASSERT(region->stride <= rtProperties.maxShaderGroupStride,
+                       "Shader record stride {} exceeds the limit {}.",
+                       region->stride,
+                       rtProperties.maxShaderGroupStride);
+            offset += alignUp(static_cast<vk::DeviceSize>(region->recordCount) * region->stride, baseAlignment);
+        }
+
+        m_Buffer = m_Context->createBuffer({
+            .usage     = BufferUsage::ShaderBindingTable,
+            .memory    = MemoryUsage::Device,
+            .size      = offset,
+            .debugName = createInfo.debugName,
+        });
+        m_Data.resize(offset);
+
+        std::memcpy(m_Data.data(), m_GroupHandles.data(), m_HandleSize);
+        auto writeRecords = [&](const Region& region, ArrayProxy<ShaderRecord> records) {
+            for (uint32_t i = 0; i < region.recordCount; i++)
+            {
+                writeRecord(region, i, records.empty() ? ShaderRecord {.group = i} : records[i]);
+            }
+        };
+        writeRecords(m_Miss, createInfo.missRecords);
+        writeRecords(m_Hit, createInfo.hitRecords);
+        writeRecords(m_Callable, createInfo.callableRecords);
+
+        // NOTE: Empty regions keep a null address, as traceRaysKHR expects for unused regions
+        auto toDeviceRegion = [&](const Region& region) {
+            vk::StridedDeviceAddressRegionKHR deviceRegion;
+            if (region.recordCount > 0)
+            {
+                deviceRegion.setDeviceAddress(m_Buffer->getAddress() + region.offset);
+                deviceRegion.setStride(region.stride);
+                deviceRegion.setSize(static_cast<vk::DeviceSize>(region.recordCount) * region.stride);
+            }
+            return deviceRegion;
+        };
+        m_RaygenRegion.setDeviceAddress(m_Buffer->getAddress());
+        m_MissRegion     = toDeviceRegion(m_Miss);
+        m_HitRegion      = toDeviceRegion(m_Hit);
+        m_CallableRegion = toDeviceRegion(m_Callable);
+
+        m_Context->oneTimeSubmit([&](CommandBufferHandle commandBuffer) {
+            commandBuffer->copyBuffer(m_Buffer, m_Data.data());
+        });
+        m_DirtyRecords.clear();
+    }
+
+    auto ShaderBindingTable::getRegion(ShaderRecordRegion region) -> Region&
+    {
+        switch (region)
+        {
+            case ShaderRecordRegion::eMiss:
+                return m_Miss;
+            case ShaderRecordRegion::eHit:
+                return m_Hit;
+            case ShaderRecordRegion::eCallable:
+                return m_Callable;
+        }
+        throw std::runtime_error("Unknown shader record region");
+    }
+
+    void ShaderBindingTable::writeRecord(const Region& region, uint32_t index, const ShaderRecord& record)
+    {
+        VKN_ASSERT(index < region.recordCount, "Record {} is out of range {}.", index, region.recordCount);
+        VKN_ASSERT(record.group < region.groupCount, "Group {} is out of range {}.", record.group, region.groupCount);
+
+        vk::DeviceSize offset = region.offset + static_cast<vk::DeviceSize>(index) * region.stride;
+        uint8_t*       dst    = m_Data.data() + offset;
+        std::memcpy(dst, m_GroupHandles.data() + (region.firstGroup + record.group) * m_HandleSize, m_HandleSize);
+        if (record.data)
+        {
+            std::memcpy(dst + m_HandleSize, record.data, region.dataSize);
+        }
+        else
+        {
+            std::memset(dst + m_HandleSize, 0, region.dataSize);
+        }
+        m_DirtyRecords.push_back({offset, region.stride});
+    }
+
+    void ShaderBindingTable::setRecord(ShaderRecordRegion region, uint32_t index, const ShaderRecord& record)
+    {
+        writeRecord(getRegion(region), index, record);
+    }
+
+    void ShaderBindingTable::upload(const CommandBufferHandle& commandBuffer)
+    {
+        for (const auto& record : m_DirtyRecords)
+        {
+            commandBuffer->updateBuffer(m_Buffer, record.offset, record.size, m_Data.data() + record.offset);
+        }
+        m_DirtyRecords.clear();
+    }
+} // namespace vulkaninja
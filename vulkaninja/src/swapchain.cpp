@@ -1,5 +1,6 @@
 #include "vulkaninja/swapchain.hpp"
 #include "vulkaninja/fence.hpp"
+#include "vulkaninja/image.hpp"
 
 namespace vulkaninja
 {
@@ -28,6 +29,7 @@ namespace vulkaninja
 
     void Swapchain::resize(uint32_t width, uint32_t height)
     {
+        m_ColorImages.clear();
         m_SwapchainImageViews.clear();
         m_SwapchainImages.clear();
         m_Swapchain.reset();
@@ -67,6 +69,11 @@ namespace vulkaninja
                                     vk::ComponentSwizzle::eB,
                                     vk::ComponentSwizzle::eA})
                     .setSubresourceRange({vk::ImageAspectFlagBits::eColor, 0, 1, 0, 1})));
+            m_ColorImages.push_back(std::make_shared<Image>(image,
+                                                            *m_SwapchainImageViews.back(),
+                                                            vk::Extent3D {width, height, 1},
+                                                            m_Format,
+                                                            vk::ImageAspectFlagBits::eColor));
         }
 
         // Create command buffers and sync objects
@@ -95,6 +102,13 @@ namespace vulkaninja
             *m_Swapchain, UINT64_MAX, *m_ImageAcquiredSemaphores[m_InflightIndex]);
         m_ImageIndex = acquireResult.value;
 
+        // NOTE: The previous contents are discarded.
+        // The first barrier must wait at the stage where the acquire semaphore is waited in App::run.
+        m_ColorImages[m_ImageIndex]->setState({
+            .layout = vk::ImageLayout::eUndefined,
+            .stage  = vk::PipelineStageFlagBits2::eColorAttachmentOutput,
+        });
+
         // Reset fence
         m_Fences[m_InflightIndex]->reset();
     }